@@ -4,4 +4,10 @@ if [ -f ./minimal_movidius ]; then
     rm ./minimal_movidius
 fi
 
-g++ -std=c++11 -g -O0 movidiusdevice.cpp main.cpp -lcrypto -lmvnc -o minimal_movidius
+g++ -std=c++11 -g -O0 movidiusdevice.cpp movidius_fp16.cpp movidius_preprocess.cpp movidius_pixelformat.cpp movidius_threadpool.cpp movidius_backend.cpp movidius_simbackend.cpp movidius_pool.cpp movidius_graphfile.cpp movidius_network.cpp movidius_integrity.cpp movidius_telemetry.cpp movidius_profile.cpp movidius_postprocess.cpp movidius_decode.cpp main.cpp -lcrypto -lmvnc -pthread -o minimal_movidius
+
+g++ -std=c++11 -g -O0 movidius_pack.cpp movidius_network.cpp movidius_graphfile.cpp movidius_preprocess.cpp movidius_pixelformat.cpp movidius_threadpool.cpp movidius_fp16.cpp -lcrypto -pthread -o movidius_pack
+
+g++ -std=c++11 -O2 movidius_bench.cpp movidiusdevice.cpp movidius_fp16.cpp movidius_preprocess.cpp movidius_pixelformat.cpp movidius_threadpool.cpp movidius_backend.cpp movidius_simbackend.cpp movidius_pool.cpp movidius_graphfile.cpp movidius_network.cpp movidius_integrity.cpp movidius_telemetry.cpp movidius_profile.cpp movidius_postprocess.cpp movidius_decode.cpp -lcrypto -lmvnc -pthread -o movidius_bench
+
+g++ -std=c++11 -O2 movidius_microbench.cpp movidiusdevice.cpp movidius_fp16.cpp movidius_preprocess.cpp movidius_pixelformat.cpp movidius_threadpool.cpp movidius_backend.cpp movidius_simbackend.cpp movidius_pool.cpp movidius_graphfile.cpp movidius_network.cpp movidius_integrity.cpp movidius_telemetry.cpp movidius_profile.cpp movidius_postprocess.cpp -lcrypto -lmvnc -pthread -o movidius_microbench
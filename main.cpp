@@ -1,200 +1,292 @@
 #include <mvnc.h>
+#include <algorithm>
 #include <vector>
 #include <stdio.h>
+#include <stdint.h>
 #include <string>
-#include <chrono>
+#include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include <dirent.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 #include "movidiusdevice.h"
+#include "movidius_decode.h"
+#include "movidius_pool.h"
 
-const int req_width = 227;
-const int req_height = 227;
-const bool show_perfs = false;
 const bool show_results = false;
 
-int runNetwork(const std::vector<std::string>& fnames,
-               const std::vector<unsigned char*>& images,
-               movidius_device* movidius_dev,
-               const std::string& networkPath)
+/**
+ * Uploads the network to every stick of the pool, returns its graph or NULL on failure
+ */
+const movidius_graph* uploadNetwork(movidius_pool* pool, const std::string& networkPath)
 {
-    std::chrono::high_resolution_clock::time_point t1;
-    std::chrono::high_resolution_clock::time_point t2;
-    std::chrono::high_resolution_clock::time_point t3;
-
-    strcpy(movidius_dev->networkPath,  networkPath.c_str());
-    int ret = movidius_uploadNetwork(movidius_dev);
+    // only the first run of a network uploads it, later runs switch back to the resident graph
+    int ret = movidius_poolUploadNetwork(pool, networkPath.c_str());
 
     if (ret != 0)
     {
         fprintf(stderr, "Failed allocating graph: %d\n", ret);
-        return 1;
+        return NULL;
     }
 
-    float* results = NULL;
-    if (movidius_dev->numCategories == 0)
+    const movidius_graph* graph = NULL;
+    for (unsigned int i = 0; i < pool->numDevices && graph == NULL; i++)
+        graph = pool->devices[i].graph;
+
+    if (graph == NULL || graph->numCategories == 0)
     {
         fprintf(stderr, "no categories after loading network\n");
-        return 1;
+        return NULL;
     }
 
-    results = new float[movidius_dev->numCategories];
-    memset(results, 0, sizeof(float) * movidius_dev->numCategories);
+    return graph;
+}
 
-    for (int c = 0; c < fnames.size(); c++)
+void printResults(const std::string& fname, const movidius_graph* graph, const float* results)
+{
+    if (!show_results)
+        return;
+
+    for (int cat = 0; cat < graph->numCategories; cat++)
+        fprintf(stderr, "%s category %d (%s): %f\n", fname.c_str(), cat, graph->categories[cat], results[cat]);
+}
+
+/**
+ * Runs the network on the images as they come out of the decoder, so the sticks start working
+ * on the first image while the others are still being decoded
+ * The decoded frames are kept in frames for the runs after this one
+ */
+int streamNetwork(const std::vector<std::string>& fnames,
+                  movidius_decoder* decoder,
+                  std::vector<movidius_decodedframe>& frames,
+                  movidius_pool* pool,
+                  const std::string& networkPath)
+{
+    const movidius_graph* graph = uploadNetwork(pool, networkPath);
+    if (graph == NULL)
+        return 1;
+
+    int numCategories = graph->numCategories;
+    std::vector<float> results(numCategories, 0.0f);
+
+    unsigned int pending = (unsigned int)fnames.size();
+    int ret = 0;
+
+    // after a failure nothing new is started, but what is on the sticks is still collected
+    while ((pending > 0 && ret == 0) || pool->numOrder > 0)
     {
-        t1 = std::chrono::high_resolution_clock::now();
-        if (movidius_convertImage((movidius_RGB*)images.at(c), req_width,req_height, movidius_dev) != 0)
-        {
-            fprintf(stderr, "failed converting image to 16bit float format\n");
-            return 1;
-        }
+        movidius_device* dev = NULL;
+        int rc = pending > 0 && ret == 0 ? movidius_poolAcquire(pool, &dev) : MOVIDIUS_QUEUE_FULL;
 
-        t2 = std::chrono::high_resolution_clock::now();
+        if (rc == 0)
+        {
+            movidius_decodedframe frame;
+            rc = movidius_nextFrame(decoder, &frame);
+            pending--;
 
-        int ret = movidius_runInference(movidius_dev, results);
+            if (rc == 0)
+            {
+                frames.at(frame.index) = frame;
+                rc = movidius_convertFrame(frame.pixels, MOVIDIUS_PIXEL_RGB, frame.width, frame.height,
+                                           frame.stride, NULL, MOVIDIUS_RESIZE_AREA, dev);
+            }
+            if (rc == 0)
+                rc = movidius_poolSubmit(pool, dev, (void*)(uintptr_t)frame.index);
 
-        t3 = std::chrono::high_resolution_clock::now();
+            if (rc != 0)
+            {
+                fprintf(stderr, "runinference failure: %d for image %s\n", rc, fnames.at(frame.index).c_str());
+                ret = rc;
+            }
+            continue;
+        }
 
-        if (ret != 0)
+        if (rc != MOVIDIUS_QUEUE_FULL && pool->numOrder == 0)
         {
-            fprintf(stderr, "runinference failure: %d for image %s\n", ret, fnames.at(c).c_str());
-            return 1;
+            ret = rc;
+            break;
         }
 
-        auto dur1 = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
-        auto dur2 = std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count();
+        void* tag = NULL;
+        unsigned int inflight = pool->numOrder;
+        rc = movidius_poolWait(pool, results.data(), numCategories, &tag, NULL);
 
-        if (show_perfs)
+        unsigned int c = (unsigned int)(uintptr_t)tag;
+        if (rc != 0)
         {
-            fprintf(stderr, "convertImage(): %d us\n", dur1);
-            fprintf(stderr, "runInference(): %d us\n", dur2);
+            fprintf(stderr, "runinference failure: %d for image %s\n", rc, fnames.at(c).c_str());
+            ret = rc;
+
+            // the stick failed without giving up the image, waiting again would not get any further
+            if (pool->numOrder == inflight)
+                break;
+            continue;
         }
 
-        if (show_results)
+        printResults(fnames.at(c), graph, results.data());
+    }
+
+    return ret != 0 ? 1 : 0;
+}
+
+int runNetwork(const std::vector<std::string>& fnames,
+               const std::vector<movidius_decodedframe>& frames,
+               movidius_pool* pool,
+               const std::string& networkPath)
+{
+    const movidius_graph* graph = uploadNetwork(pool, networkPath);
+    if (graph == NULL)
+        return 1;
+
+    int numCategories = graph->numCategories;
+
+    // any size works, movidius_convertFrame() scales the images to what the network expects
+    std::vector<movidius_batchitem> items(frames.size());
+    for (size_t c = 0; c < frames.size(); c++)
+    {
+        const movidius_decodedframe& frame = frames.at(c);
+        movidius_batchitem item = { frame.pixels, MOVIDIUS_PIXEL_RGB, frame.width, frame.height, frame.stride, NULL };
+        items[c] = item;
+    }
+
+    std::vector<float> results(frames.size() * numCategories, 0.0f);
+    std::vector<int> status(frames.size(), 0);
+
+    // keeps every stick busy, converting the next image while the previous ones are being inferred
+    int ret = movidius_poolRunBatch(pool, items.data(), (unsigned int)items.size(), MOVIDIUS_RESIZE_AREA,
+                                    results.data(), numCategories, status.data());
+
+    for (size_t c = 0; c < frames.size(); c++)
+    {
+        if (status.at(c) != 0)
         {
-            for (int cat = 0; cat < movidius_dev->numCategories; cat++)
-            {
-                fprintf(stderr, "category %d (%s): %f\n", cat, movidius_dev->categories[cat], results[cat]);
-            }
+            fprintf(stderr, "runinference failure: %d for image %s\n", status.at(c), fnames.at(c).c_str());
+            continue;
         }
+
+        printResults(fnames.at(c), graph, &results[c * numCategories]);
     }
 
-    ret = movidius_deallocateGraph(movidius_dev);
-    if (ret != 0)
+    return ret != 0 ? 1 : 0;
+}
+
+/**
+ * Adds the image files in a directory, sorted by name, or the path itself if it is not a directory
+ */
+void addImages(const char* path, std::vector<std::string>& fnames)
+{
+    DIR* dir = opendir(path);
+    if (dir == NULL)
     {
-        fprintf(stderr, "Failed deallocating graph: %d\n", ret);
-        return 1;
+        fnames.push_back(path);
+        return;
     }
 
-    delete[] results;
-    results = NULL;
-    return 0;
+    static const char* extensions[] = { ".png", ".jpg", ".jpeg", ".bmp", ".tga", ".gif", ".pgm", ".ppm" };
+
+    std::vector<std::string> found;
+    while (struct dirent* entry = readdir(dir))
+    {
+        const char* dot = strrchr(entry->d_name, '.');
+        for (size_t i = 0; dot != NULL && i < sizeof(extensions) / sizeof(extensions[0]); i++)
+        {
+            if (strcasecmp(dot, extensions[i]) == 0)
+            {
+                found.push_back(std::string(path) + "/" + entry->d_name);
+                break;
+            }
+        }
+    }
+    closedir(dir);
+
+    std::sort(found.begin(), found.end());
+    fnames.insert(fnames.end(), found.begin(), found.end());
 }
 
 int main(int argc, char** argv)
 {
-    movidius_device movidius_dev;
-    memset(&movidius_dev, 0, sizeof(movidius_device));
+    std::vector<std::string> fnames;
 
-    if (movidius_openDevice(&movidius_dev) != 0)
-        return 1;
+    // image files or directories of them, the samples by default
+    for (int i = 1; i < argc; i++)
+        addImages(argv[i], fnames);
 
-    std::vector<unsigned char*> images;
-    std::vector<std::string> fnames;
+    if (argc < 2)
+    {
+        fnames.push_back("./sample_1505732941144.png");
+        fnames.push_back("./sample_1505732942167.png");
+        fnames.push_back("./sample_1505732945220.png");
+        fnames.push_back("./sample_1505732946240.png");
+        fnames.push_back("./sample_1505732947259.png");
+        fnames.push_back("./sample_1505732948277.png");
+        fnames.push_back("./sample_1505732949297.png");
+        fnames.push_back("./sample_1505732952353.png");
+    }
 
-    fnames.push_back("./sample_1505732941144.png");
-    fnames.push_back("./sample_1505732942167.png");
-    fnames.push_back("./sample_1505732945220.png");
-    fnames.push_back("./sample_1505732946240.png");
-    fnames.push_back("./sample_1505732947259.png");
-    fnames.push_back("./sample_1505732948277.png");
-    fnames.push_back("./sample_1505732949297.png");
-    fnames.push_back("./sample_1505732952353.png");
-
-    // load images from disk
-    for (int c = 0; c < fnames.size(); c++)
+    if (fnames.empty())
     {
-        int width, height, cp;
-        width = height = cp = 0;
+        fprintf(stderr, "No images found\n");
+        return 1;
+    }
 
-        unsigned char* img = stbi_load(fnames.at(c).c_str(), &width, &height, &cp, 3); 
-        if (img == NULL)
-        {
-            fprintf(stderr, "The image %s could not be loaded\n", fnames.at(c).c_str());
-            return 1;
-        }
+    movidius_pool movidius_pool;
+    memset(&movidius_pool, 0, sizeof(movidius_pool));
 
-        if (width != req_width || height != req_height)
-        {
-            fprintf(stderr, "Invalid size for image %s. Expected %d x %d, got %d x %d\n",
-                    fnames.at(c).c_str(), width, height, req_width, req_height);
-            return 1;
-        }
+    if (movidius_openPool(&movidius_pool, 0) != 0)
+        return 1;
 
-        images.push_back(img);
+    std::vector<const char*> paths;
+    for (size_t c = 0; c < fnames.size(); c++)
+        paths.push_back(fnames.at(c).c_str());
+
+    // decoding runs ahead of the sticks by a few images per stick, enough to never leave one waiting
+    movidius_decoder* decoder = movidius_createDecoder(paths.data(), (unsigned int)paths.size(), 0,
+                                                       2 * MOVIDIUS_MAX_INFLIGHT * movidius_pool.numDevices);
+    if (decoder == NULL)
+    {
+        movidius_closePool(&movidius_pool);
+        return 1;
     }
 
+    std::vector<movidius_decodedframe> frames(fnames.size());
+    memset(frames.data(), 0, frames.size() * sizeof(movidius_decodedframe));
+
+    const char* networks[] = { "./network/Age", "./network/Gender", "./network/Age",
+                               "./network/Gender", "./network/Age", "./network/Gender" };
+
     int loops = 0;
     int loops_total = 4;
     int ret = 0;
 
-    // run networks a few times
-    while (loops < loops_total)
+    // run networks a few times, the first run takes the images straight from the decoder
+    while (loops < loops_total && ret == 0)
     {
         loops++;
 
-        ret = runNetwork(fnames, images, &movidius_dev, "./network/Age");
-        if (ret != 0)
-        {
-            fprintf(stderr, "Age network failed: %d\n", ret);
-            break;
-        }
-
-        ret = runNetwork(fnames, images, &movidius_dev, "./network/Gender");
-        if (ret != 0)
-        {
-            fprintf(stderr, "Gender network failed: %d\n", ret);
-            break;
-        }
-
-        ret = runNetwork(fnames, images, &movidius_dev, "./network/Age");
-        if (ret != 0)
-        {
-            fprintf(stderr, "Age network failed: %d\n", ret);
-            break;
-        }
-
-        ret = runNetwork(fnames, images, &movidius_dev, "./network/Gender");
-        if (ret != 0)
-        {
-            fprintf(stderr, "Gender network failed: %d\n", ret);
-            break;
-        }
-
-        ret = runNetwork(fnames, images, &movidius_dev, "./network/Age");
-        if (ret != 0)
+        for (size_t n = 0; n < sizeof(networks) / sizeof(networks[0]) && ret == 0; n++)
         {
-            fprintf(stderr, "Age network failed: %d\n", ret);
-            break;
-        }
+            if (decoder != NULL)
+            {
+                ret = streamNetwork(fnames, decoder, frames, &movidius_pool, networks[n]);
+                movidius_destroyDecoder(decoder);
+                decoder = NULL;
+            }
+            else
+                ret = runNetwork(fnames, frames, &movidius_pool, networks[n]);
 
-        ret = runNetwork(fnames, images, &movidius_dev, "./network/Gender");
-        if (ret != 0)
-        {
-            fprintf(stderr, "Gender network failed: %d\n", ret);
-            break;
+            if (ret != 0)
+                fprintf(stderr, "%s network failed: %d\n", networks[n], ret);
         }
 
-        fprintf(stderr, "Done with loop %d / %d\n", loops, loops_total);
+        if (ret == 0)
+            fprintf(stderr, "Done with loop %d / %d\n", loops, loops_total);
     }
 
-    for (int c = 0; c < images.size(); c++)
-        free(images.at(c));
-    images.clear();
+    for (size_t c = 0; c < frames.size(); c++)
+        movidius_releaseFrame(&frames.at(c));
+    frames.clear();
 
-    movidius_closeDevice(&movidius_dev, false);
+    movidius_closePool(&movidius_pool);
 
     return ret;
 }
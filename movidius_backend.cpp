@@ -0,0 +1,35 @@
+#include "movidius_backend.h"
+#include <stddef.h>
+
+static const movidius_backend ncsdk_backend =
+{
+    "ncsdk",
+    mvncGetDeviceName,
+    mvncOpenDevice,
+    mvncCloseDevice,
+    mvncAllocateGraph,
+    mvncDeallocateGraph,
+    mvncSetGlobalOption,
+    mvncSetGraphOption,
+    mvncGetGraphOption,
+    mvncGetDeviceOption,
+    mvncLoadTensor,
+    mvncGetResult
+};
+
+static const movidius_backend* current_backend = &ncsdk_backend;
+
+const movidius_backend* movidius_ncsdkBackend()
+{
+    return &ncsdk_backend;
+}
+
+const movidius_backend* movidius_getBackend()
+{
+    return current_backend;
+}
+
+void movidius_setBackend(const movidius_backend* backend)
+{
+    current_backend = backend != NULL ? backend : &ncsdk_backend;
+}
@@ -0,0 +1,55 @@
+#ifndef MOVIDIUS_BACKEND_H
+#define MOVIDIUS_BACKEND_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <mvnc.h>
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+/**
+ * The mvnc calls the movidius_* functions make, gathered into a table so they can be
+ * pointed at something other than the NCSDK, like the simulated sticks in movidius_simbackend.h
+ * Every entry has the same signature and meaning as the mvnc function of the same name
+ */
+typedef struct
+{
+    const char* name;
+
+    mvncStatus (*getDeviceName)(int index, char* name, unsigned int nameSize);
+    mvncStatus (*openDevice)(const char* name, void** deviceHandle);
+    mvncStatus (*closeDevice)(void* deviceHandle);
+    mvncStatus (*allocateGraph)(void* deviceHandle, void** graphHandle, const void* graphFile,
+                                unsigned int graphFileLength);
+    mvncStatus (*deallocateGraph)(void* graphHandle);
+    mvncStatus (*setGlobalOption)(int option, const void* data, unsigned int dataLength);
+    mvncStatus (*setGraphOption)(void* graphHandle, int option, const void* data, unsigned int dataLength);
+    mvncStatus (*getGraphOption)(void* graphHandle, int option, void* data, unsigned int* dataLength);
+    mvncStatus (*getDeviceOption)(void* deviceHandle, int option, void* data, unsigned int* dataLength);
+    mvncStatus (*loadTensor)(void* graphHandle, const void* inputTensor, unsigned int inputTensorLength,
+                             void* userParam);
+    mvncStatus (*getResult)(void* graphHandle, void** outputData, unsigned int* outputDataLength,
+                            void** userParam);
+} movidius_backend;
+
+/**
+ * The table calling straight into libmvnc
+ */
+extern const movidius_backend* movidius_ncsdkBackend();
+
+/**
+ * The backend all movidius_* functions currently use, the NCSDK unless changed
+ */
+extern const movidius_backend* movidius_getBackend();
+
+/**
+ * Switches the backend, NULL goes back to the NCSDK
+ * Only switch while no devices are open, handles from one backend mean nothing to another
+ */
+extern void movidius_setBackend(const movidius_backend* backend);
+
+#endif // MOVIDIUS_BACKEND_H
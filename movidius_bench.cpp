@@ -0,0 +1,595 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "stb_image.h"
+#include "movidius_pool.h"
+#include "movidius_simbackend.h"
+#include "movidius_telemetry.h"
+
+/**
+ * Measures inference throughput, latency and where the time goes for a list of networks,
+ * spread over all sticks of a pool. Runs on real sticks, or on the simulated ones of
+ * movidius_simbackend.h for repeatable numbers without hardware
+ * Usage: movidius_bench [options], see bench_usage()
+ */
+
+struct bench_options
+{
+    std::vector<std::string> networks;
+    std::vector<std::string> images;
+    unsigned int devices;
+    unsigned int warmup;
+    unsigned int iterations;
+    unsigned int frames;
+    unsigned int frameWidth;
+    unsigned int frameHeight;
+    int filter;
+    const char* json;
+
+    bool sim;
+    movidius_simconfig simConfig;
+    unsigned int simInputSize;
+};
+
+struct bench_image
+{
+    unsigned char* pixels;
+    unsigned int width;
+    unsigned int height;
+
+    /**
+     * True if stbi_load() made the pixels, they go back with stbi_image_free(), synthetic frames with free()
+     */
+    bool decoded;
+};
+
+/**
+ * Timings of one stage in milliseconds, one per image or inference
+ */
+struct bench_stage
+{
+    std::vector<double> ms;
+};
+
+struct bench_result
+{
+    std::string network;
+    unsigned int inferences;
+    double seconds;
+
+    // from the start of converting an image until its result is collected
+    bench_stage latency;
+    bench_stage convert;
+    bench_stage loadTensor;
+
+    // includes the time spent waiting for the stick to finish
+    bench_stage getResult;
+
+    // only the total is known, the queries happen inside collecting results
+    double telemetryMs;
+};
+
+static void bench_usage(const char* name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --network PATH        network folder or bundle, repeat for several (default ./network/Age ./network/Gender)\n"
+            "  --image PATH          image file, repeat for several (default synthetic frames)\n"
+            "  --frames N            number of synthetic frames (default 8)\n"
+            "  --frame WxH           size of the synthetic frames (default 640x480)\n"
+            "  --filter area|bilinear  resize filter (default area)\n"
+            "  --devices N           sticks to use, 0 for all (default 0)\n"
+            "  --warmup N            unmeasured passes over the images per network (default 2)\n"
+            "  --iterations N        measured passes over the images per network (default 10)\n"
+            "  --json PATH           write the results as JSON, - for stdout\n"
+            "  --sim N               use N simulated sticks instead of mvnc\n"
+            "  --sim-inference-ms X  time every simulated inference takes (default 5)\n"
+            "  --sim-transfer-ms X   time loading a tensor takes (default 1)\n"
+            "  --sim-categories N    outputs of the generated network (default 1000)\n"
+            "  --sim-input N         input size of the generated network (default 227)\n"
+            "Without --network, --sim generates a network to run\n", name);
+}
+
+static double bench_nowMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int bench_parse(int argc, char** argv, bench_options& options)
+{
+    options.devices = 0;
+    options.warmup = 2;
+    options.iterations = 10;
+    options.frames = 8;
+    options.frameWidth = 640;
+    options.frameHeight = 480;
+    options.filter = MOVIDIUS_RESIZE_AREA;
+    options.json = NULL;
+    options.sim = false;
+    memset(&options.simConfig, 0, sizeof(options.simConfig));
+    options.simConfig.inferenceMs = 5;
+    options.simConfig.transferMs = 1;
+    options.simConfig.outputs = 1000;
+    options.simConfig.stages = 10;
+    options.simInputSize = 227;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool ok = value != NULL;
+
+        if (arg == "--network" && ok)
+            options.networks.push_back(value);
+        else if (arg == "--image" && ok)
+            options.images.push_back(value);
+        else if (arg == "--frames" && ok)
+            options.frames = atoi(value);
+        else if (arg == "--frame" && ok)
+            ok = sscanf(value, "%ux%u", &options.frameWidth, &options.frameHeight) == 2;
+        else if (arg == "--filter" && ok)
+        {
+            options.filter = strcmp(value, "bilinear") == 0 ? MOVIDIUS_RESIZE_BILINEAR : MOVIDIUS_RESIZE_AREA;
+            ok = strcmp(value, "bilinear") == 0 || strcmp(value, "area") == 0;
+        }
+        else if (arg == "--devices" && ok)
+            options.devices = atoi(value);
+        else if (arg == "--warmup" && ok)
+            options.warmup = atoi(value);
+        else if (arg == "--iterations" && ok)
+            options.iterations = atoi(value);
+        else if (arg == "--json" && ok)
+            options.json = value;
+        else if (arg == "--sim" && ok)
+        {
+            options.sim = true;
+            options.simConfig.devices = atoi(value);
+        }
+        else if (arg == "--sim-inference-ms" && ok)
+            options.simConfig.inferenceMs = atof(value);
+        else if (arg == "--sim-transfer-ms" && ok)
+            options.simConfig.transferMs = atof(value);
+        else if (arg == "--sim-categories" && ok)
+            options.simConfig.outputs = atoi(value);
+        else if (arg == "--sim-input" && ok)
+            options.simInputSize = atoi(value);
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+            return 1;
+        }
+        i++;
+    }
+
+    if (options.iterations == 0 || options.frameWidth == 0 || options.frameHeight == 0 ||
+        (options.sim && (options.simConfig.devices == 0 || options.simConfig.outputs == 0 || options.simInputSize == 0)))
+    {
+        fprintf(stderr, "Iterations, frame sizes and simulated sticks must not be 0\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Writes a network the simulated sticks run to a new temporary directory
+ * Returns 0 on success
+ */
+static int bench_makeSimNetwork(const bench_options& options, std::string& dir)
+{
+    char pattern[] = "/tmp/movidius_bench.XXXXXX";
+    if (mkdtemp(pattern) == NULL)
+    {
+        fprintf(stderr, "Cannot create a directory for the simulated network\n");
+        return 1;
+    }
+
+    dir = pattern;
+    return movidius_simWriteNetwork(dir.c_str(), options.simConfig.outputs, options.simInputSize,
+                                    options.simConfig.stages) != 0;
+}
+
+/**
+ * Decodes the image files, or makes the synthetic frames when there are none
+ * Returns 0 on success
+ */
+static int bench_loadImages(const bench_options& options, std::vector<bench_image>& images, bench_stage& decode)
+{
+    for (size_t i = 0; i < options.images.size(); i++)
+    {
+        int width = 0;
+        int height = 0;
+        int cp = 0;
+
+        double start = bench_nowMs();
+        unsigned char* pixels = stbi_load(options.images[i].c_str(), &width, &height, &cp, 3);
+        decode.ms.push_back(bench_nowMs() - start);
+
+        if (pixels == NULL)
+        {
+            fprintf(stderr, "The image %s could not be loaded\n", options.images[i].c_str());
+            return 1;
+        }
+
+        bench_image image = { pixels, (unsigned int)width, (unsigned int)height, true };
+        images.push_back(image);
+    }
+
+    if (!options.images.empty())
+        return 0;
+
+    // the same noise every run, so every run converts the same pixels
+    unsigned int seed = 12345;
+    for (unsigned int i = 0; i < options.frames; i++)
+    {
+        size_t size = 3 * (size_t)options.frameWidth * options.frameHeight;
+        unsigned char* pixels = (unsigned char*)malloc(size);
+        for (size_t p = 0; p < size; p++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            pixels[p] = (unsigned char)(seed >> 16);
+        }
+
+        bench_image image = { pixels, options.frameWidth, options.frameHeight, false };
+        images.push_back(image);
+    }
+
+    return 0;
+}
+
+static double bench_telemetryMs(movidius_pool* pool)
+{
+    double ms = 0;
+    for (unsigned int i = 0; i < pool->numDevices; i++)
+    {
+        movidius_telemetry telemetry;
+        movidius_getTelemetry(&pool->devices[i], &telemetry);
+        ms += telemetry.queryMs;
+    }
+    return ms;
+}
+
+/**
+ * One pass over every image, keeping all sticks busy like movidius_poolRunBatch() does but timing
+ * every step. Images lost to an unplugged stick go to another one
+ * @param result: Where the timings go, NULL for warm-up passes
+ * Returns 0 on success
+ */
+static int bench_pass(movidius_pool* pool, const std::vector<bench_image>& images, int filter,
+                      std::vector<float>& results, bench_result* result)
+{
+    std::vector<double> started(images.size());
+    std::vector<unsigned int> retry;
+    unsigned int next = 0;
+
+    while (next < images.size() || !retry.empty() || pool->numOrder > 0)
+    {
+        movidius_device* dev = NULL;
+        bool more = next < images.size() || !retry.empty();
+        int rc = more ? movidius_poolAcquire(pool, &dev) : MOVIDIUS_QUEUE_FULL;
+
+        if (rc == 0)
+        {
+            unsigned int item;
+            if (!retry.empty())
+            {
+                item = retry.back();
+                retry.pop_back();
+            }
+            else
+                item = next++;
+
+            const bench_image& image = images[item];
+            double t1 = bench_nowMs();
+            rc = movidius_convertFrame(image.pixels, MOVIDIUS_PIXEL_RGB, image.width, image.height, 3 * image.width,
+                                       NULL, filter, dev);
+            double t2 = bench_nowMs();
+            if (rc == 0)
+                rc = movidius_poolSubmit(pool, dev, (void*)(uintptr_t)item);
+            double t3 = bench_nowMs();
+
+            if (rc == MOVIDIUS_DEVICE_GONE)
+            {
+                retry.push_back(item);
+                continue;
+            }
+
+            if (rc != 0)
+            {
+                fprintf(stderr, "Submitting image %u failed: %d\n", item, rc);
+                return rc;
+            }
+
+            started[item] = t1;
+            if (result != NULL)
+            {
+                result->convert.ms.push_back(t2 - t1);
+                result->loadTensor.ms.push_back(t3 - t2);
+            }
+            continue;
+        }
+
+        if (rc != MOVIDIUS_QUEUE_FULL && pool->numOrder == 0)
+        {
+            fprintf(stderr, "No usable sticks left: %d\n", rc);
+            return rc;
+        }
+
+        void* tag = NULL;
+        double t1 = bench_nowMs();
+        rc = movidius_poolWait(pool, results.data(), results.size(), &tag, NULL);
+        double t2 = bench_nowMs();
+
+        unsigned int done = (unsigned int)(uintptr_t)tag;
+        if (rc == MOVIDIUS_DEVICE_GONE)
+        {
+            retry.push_back(done);
+            continue;
+        }
+
+        if (rc != 0)
+        {
+            fprintf(stderr, "Collecting image %u failed: %d\n", done, rc);
+            return rc;
+        }
+
+        if (result != NULL)
+        {
+            result->getResult.ms.push_back(t2 - t1);
+            result->latency.ms.push_back(t2 - started[done]);
+            result->inferences++;
+        }
+    }
+
+    return 0;
+}
+
+static int bench_network(movidius_pool* pool, const bench_options& options, const std::string& network,
+                         const std::vector<bench_image>& images, bench_result& result)
+{
+    result.network = network;
+    result.inferences = 0;
+    result.seconds = 0;
+    result.telemetryMs = 0;
+
+    int rc = movidius_poolUploadNetwork(pool, network.c_str());
+    if (rc != 0)
+    {
+        fprintf(stderr, "Uploading %s failed: %d\n", network.c_str(), rc);
+        return rc;
+    }
+
+    // room for the largest network the sticks hold, the library checks it fits
+    unsigned int outputs = 1;
+    for (unsigned int i = 0; i < pool->numDevices; i++)
+    {
+        if (pool->devices[i].graph != NULL)
+            outputs = std::max(outputs, (unsigned int)pool->devices[i].graph->numCategories);
+    }
+    if (options.sim)
+        outputs = std::max(outputs, options.simConfig.outputs);
+    std::vector<float> results(outputs);
+
+    for (unsigned int i = 0; i < options.warmup; i++)
+    {
+        rc = bench_pass(pool, images, options.filter, results, NULL);
+        if (rc != 0)
+            return rc;
+    }
+
+    double telemetry = bench_telemetryMs(pool);
+    double start = bench_nowMs();
+
+    for (unsigned int i = 0; i < options.iterations; i++)
+    {
+        rc = bench_pass(pool, images, options.filter, results, &result);
+        if (rc != 0)
+            return rc;
+    }
+
+    result.seconds = (bench_nowMs() - start) / 1000.0;
+    result.telemetryMs = bench_telemetryMs(pool) - telemetry;
+    return 0;
+}
+
+/**
+ * The value below which the given fraction of the sorted samples fall, nearest rank
+ */
+static double bench_percentile(const std::vector<double>& sorted, double fraction)
+{
+    if (sorted.empty())
+        return 0;
+
+    size_t rank = (size_t)(fraction * sorted.size() + 0.999999);
+    return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+static void bench_writeStage(FILE* out, const bench_stage& stage)
+{
+    std::vector<double> sorted = stage.ms;
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum = 0;
+    for (size_t i = 0; i < sorted.size(); i++)
+        sum += sorted[i];
+
+    fprintf(out, "{\"count\":%u,\"mean_ms\":%.4f,\"p50_ms\":%.4f,\"p90_ms\":%.4f,\"p99_ms\":%.4f,\"max_ms\":%.4f}",
+            (unsigned int)sorted.size(), sorted.empty() ? 0 : sum / sorted.size(), bench_percentile(sorted, 0.5),
+            bench_percentile(sorted, 0.9), bench_percentile(sorted, 0.99), sorted.empty() ? 0 : sorted.back());
+}
+
+static void bench_writeString(FILE* out, const std::string& text)
+{
+    fputc('"', out);
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static void bench_writeJson(FILE* out, const bench_options& options, unsigned int devices, unsigned int images,
+                            const bench_stage& decode, const std::vector<bench_result>& results)
+{
+    fprintf(out, "{\"backend\":\"%s\",\"devices\":%u,\"warmup\":%u,\"iterations\":%u,\"images\":%u,\"filter\":\"%s\",\n",
+            options.sim ? "sim" : "mvnc", devices, options.warmup, options.iterations, images,
+            options.filter == MOVIDIUS_RESIZE_AREA ? "area" : "bilinear");
+    fprintf(out, "\"decode\":");
+    bench_writeStage(out, decode);
+    fprintf(out, ",\n\"networks\":[");
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const bench_result& r = results[i];
+        fprintf(out, "%s\n{\"network\":", i == 0 ? "" : ",");
+        bench_writeString(out, r.network);
+        fprintf(out, ",\"inferences\":%u,\"seconds\":%.4f,\"throughput\":%.2f,\n\"latency\":", r.inferences,
+                r.seconds, r.seconds > 0 ? r.inferences / r.seconds : 0);
+        bench_writeStage(out, r.latency);
+        fprintf(out, ",\n\"stages\":{\"convert\":");
+        bench_writeStage(out, r.convert);
+        fprintf(out, ",\n\"load_tensor\":");
+        bench_writeStage(out, r.loadTensor);
+        fprintf(out, ",\n\"get_result\":");
+        bench_writeStage(out, r.getResult);
+        fprintf(out, ",\n\"telemetry\":{\"total_ms\":%.4f,\"mean_ms\":%.4f}}}", r.telemetryMs,
+                r.inferences > 0 ? r.telemetryMs / r.inferences : 0);
+    }
+
+    fprintf(out, "\n]}\n");
+}
+
+static void bench_printStage(FILE* out, const char* name, const bench_stage& stage)
+{
+    std::vector<double> sorted = stage.ms;
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum = 0;
+    for (size_t i = 0; i < sorted.size(); i++)
+        sum += sorted[i];
+
+    fprintf(out, "  %-12s mean %8.3f  p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f ms\n", name,
+           sorted.empty() ? 0 : sum / sorted.size(), bench_percentile(sorted, 0.5), bench_percentile(sorted, 0.9),
+           bench_percentile(sorted, 0.99), sorted.empty() ? 0 : sorted.back());
+}
+
+int main(int argc, char** argv)
+{
+    bench_options options;
+    if (bench_parse(argc, argv, options) != 0)
+    {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    std::string simNetwork;
+    if (options.sim)
+    {
+        movidius_setBackend(movidius_simBackend(&options.simConfig));
+
+        if (options.networks.empty())
+        {
+            if (bench_makeSimNetwork(options, simNetwork) != 0)
+            {
+                if (!simNetwork.empty())
+                    movidius_simRemoveNetwork(simNetwork.c_str());
+                return 1;
+            }
+            options.networks.push_back(simNetwork);
+        }
+    }
+
+    if (options.networks.empty())
+    {
+        options.networks.push_back("./network/Age");
+        options.networks.push_back("./network/Gender");
+    }
+
+    std::vector<bench_image> images;
+    bench_stage decode;
+    int ret = bench_loadImages(options, images, decode);
+
+    movidius_pool pool;
+    memset(&pool, 0, sizeof(pool));
+    if (ret == 0 && movidius_openPool(&pool, options.devices) != 0)
+        ret = 1;
+
+    std::vector<bench_result> results(options.networks.size());
+    for (size_t i = 0; i < options.networks.size() && ret == 0; i++)
+    {
+        if (bench_network(&pool, options, options.networks[i], images, results[i]) != 0)
+            ret = 1;
+    }
+
+    // JSON on stdout keeps it to itself
+    FILE* summary = options.json != NULL && strcmp(options.json, "-") == 0 ? stderr : stdout;
+
+    if (ret == 0)
+    {
+        if (!decode.ms.empty())
+        {
+            fprintf(summary, "%u images\n", (unsigned int)images.size());
+            bench_printStage(summary, "decode", decode);
+        }
+
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const bench_result& r = results[i];
+            fprintf(summary, "%s: %u inferences on %u sticks, %.1f inferences/s\n", r.network.c_str(), r.inferences,
+                   movidius_poolHealthyDevices(&pool), r.seconds > 0 ? r.inferences / r.seconds : 0);
+            bench_printStage(summary, "latency", r.latency);
+            bench_printStage(summary, "convert", r.convert);
+            bench_printStage(summary, "load tensor", r.loadTensor);
+            bench_printStage(summary, "get result", r.getResult);
+            fprintf(summary, "  %-12s mean %8.3f ms\n", "telemetry", r.inferences > 0 ? r.telemetryMs / r.inferences : 0);
+        }
+    }
+
+    if (ret == 0 && options.json != NULL)
+    {
+        FILE* out = strcmp(options.json, "-") == 0 ? stdout : fopen(options.json, "w");
+        if (out == NULL)
+        {
+            fprintf(stderr, "Cannot write file: %s\n", options.json);
+            ret = 1;
+        }
+        else
+        {
+            bench_writeJson(out, options, pool.numDevices, images.size(), decode, results);
+            if (out != stdout && fclose(out) != 0)
+                ret = 1;
+        }
+    }
+
+    if (pool.devices != NULL)
+        movidius_closePool(&pool);
+
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        if (images[i].decoded)
+            stbi_image_free(images[i].pixels);
+        else
+            free(images[i].pixels);
+    }
+
+    if (!simNetwork.empty())
+        movidius_simRemoveNetwork(simNetwork.c_str());
+
+    return ret;
+}
@@ -0,0 +1,280 @@
+#include "movidius_decode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/**
+ * Every block handed to stb_image starts with a header this large, keeping the pixels aligned
+ * The header holds the size class of the block, so freeing and growing need no size
+ */
+static const size_t decode_alignment = 64;
+
+/**
+ * Blocks are powers of two from this size up, a freed block serves the next request of its class
+ * Images of one size reuse the same blocks, at the cost of up to twice the memory for each
+ */
+static const size_t decode_min_block = 4096;
+static const unsigned int decode_classes = 32;
+
+static std::mutex decode_mutex;
+static std::vector<void*> decode_blocks[decode_classes];
+static unsigned int decode_decoders = 0;
+
+static size_t decode_classSize(unsigned int size_class)
+{
+    return decode_min_block << size_class;
+}
+
+static void* decode_malloc(size_t size)
+{
+    unsigned int size_class = 0;
+    while (size_class < decode_classes && decode_classSize(size_class) < size)
+        size_class++;
+    if (size_class == decode_classes)
+        return NULL;
+
+    void* block = NULL;
+    {
+        std::lock_guard<std::mutex> lock(decode_mutex);
+        if (!decode_blocks[size_class].empty())
+        {
+            block = decode_blocks[size_class].back();
+            decode_blocks[size_class].pop_back();
+        }
+    }
+
+    if (block == NULL)
+    {
+        if (posix_memalign(&block, decode_alignment, decode_alignment + decode_classSize(size_class)) != 0)
+            return NULL;
+        *(unsigned int*)block = size_class;
+    }
+
+    return (char*)block + decode_alignment;
+}
+
+static void decode_free(void* p)
+{
+    if (p == NULL)
+        return;
+
+    void* block = (char*)p - decode_alignment;
+    unsigned int size_class = *(unsigned int*)block;
+
+    // without a decoder nothing reuses the block, e.g. a frame released after movidius_destroyDecoder()
+    std::lock_guard<std::mutex> lock(decode_mutex);
+    if (decode_decoders == 0)
+        free(block);
+    else
+        decode_blocks[size_class].push_back(block);
+}
+
+static void* decode_realloc(void* p, size_t size)
+{
+    if (p == NULL)
+        return decode_malloc(size);
+
+    size_t capacity = decode_classSize(*(unsigned int*)((char*)p - decode_alignment));
+    if (size <= capacity)
+        return p;
+
+    void* grown = decode_malloc(size);
+    if (grown == NULL)
+        return NULL;
+
+    memcpy(grown, p, capacity);
+    decode_free(p);
+    return grown;
+}
+
+/**
+ * Frees the recycled blocks, called with decode_mutex held
+ */
+static void decode_trim()
+{
+    for (unsigned int i = 0; i < decode_classes; i++)
+    {
+        for (size_t j = 0; j < decode_blocks[i].size(); j++)
+            free(decode_blocks[i][j]);
+        std::vector<void*>().swap(decode_blocks[i]);
+    }
+}
+
+#define STBI_MALLOC(size) decode_malloc(size)
+#define STBI_REALLOC(p, size) decode_realloc(p, size)
+#define STBI_FREE(p) decode_free(p)
+// the failure reason is a global that every decoding thread would write at once
+#define STBI_NO_FAILURE_STRINGS
+#define STB_IMAGE_IMPLEMENTATION
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wunused-value"
+#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
+#include "stb_image.h"
+#pragma GCC diagnostic pop
+
+/**
+ * A finished file waiting for movidius_nextFrame()
+ */
+struct decode_result
+{
+    movidius_decodedframe frame;
+    int rc;
+};
+
+struct movidius_decoder
+{
+    const char* const* paths;
+    unsigned int count;
+    unsigned int queueDepth;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable room;
+    std::deque<decode_result> results;
+
+    /**
+     * Next file a worker picks up, files being decoded right now, and files handed out
+     */
+    unsigned int next;
+    unsigned int decoding;
+    unsigned int delivered;
+    bool stopping;
+};
+
+static void decode_worker(movidius_decoder* decoder)
+{
+    for (;;)
+    {
+        unsigned int index;
+        {
+            std::unique_lock<std::mutex> lock(decoder->mutex);
+            decoder->room.wait(lock, [&] {
+                return decoder->stopping || decoder->next >= decoder->count ||
+                       decoder->results.size() + decoder->decoding < decoder->queueDepth;
+            });
+
+            if (decoder->stopping || decoder->next >= decoder->count)
+                return;
+
+            index = decoder->next++;
+            decoder->decoding++;
+        }
+
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+
+        decode_result result;
+        memset(&result, 0, sizeof(result));
+        result.frame.index = index;
+        result.frame.pixels = stbi_load(decoder->paths[index], &width, &height, &channels, 3);
+        result.frame.width = (unsigned int)width;
+        result.frame.height = (unsigned int)height;
+        result.frame.stride = 3 * (unsigned int)width;
+        result.rc = result.frame.pixels != NULL ? 0 : DATA_LOAD_FAILED;
+
+        std::lock_guard<std::mutex> lock(decoder->mutex);
+        decoder->decoding--;
+        decoder->results.push_back(result);
+        decoder->ready.notify_one();
+    }
+}
+
+movidius_decoder* movidius_createDecoder(const char* const* paths, unsigned int count,
+                                         unsigned int threads, unsigned int queue_depth)
+{
+    if (threads == 0)
+    {
+        unsigned int cpus = std::thread::hardware_concurrency();
+        threads = cpus > 1 ? cpus - 1 : 1;
+    }
+
+    movidius_decoder* decoder = new movidius_decoder;
+    decoder->paths = paths;
+    decoder->count = count;
+    decoder->queueDepth = std::max(queue_depth, 1u);
+    decoder->next = 0;
+    decoder->decoding = 0;
+    decoder->delivered = 0;
+    decoder->stopping = false;
+
+    {
+        std::lock_guard<std::mutex> lock(decode_mutex);
+        decode_decoders++;
+    }
+
+    // more threads than files would only sit idle
+    threads = std::min(threads, std::max(count, 1u));
+    for (unsigned int i = 0; i < threads; i++)
+    {
+        try
+        {
+            decoder->workers.push_back(std::thread(decode_worker, decoder));
+        }
+        catch (const std::system_error& e)
+        {
+            fprintf(stderr, "movidius: failed starting decoding thread %d: %s\n", i, e.what());
+            movidius_destroyDecoder(decoder);
+            return NULL;
+        }
+    }
+
+    return decoder;
+}
+
+int movidius_nextFrame(movidius_decoder* decoder, movidius_decodedframe* frame)
+{
+    std::unique_lock<std::mutex> lock(decoder->mutex);
+    if (decoder->delivered >= decoder->count)
+        return NOT_ALLOWED_THIS_TIME;
+
+    decoder->ready.wait(lock, [&] { return !decoder->results.empty(); });
+
+    decode_result result = decoder->results.front();
+    decoder->results.pop_front();
+    decoder->delivered++;
+    decoder->room.notify_one();
+
+    *frame = result.frame;
+    if (result.rc != 0)
+        fprintf(stderr, "movidius: the image %s could not be decoded\n", decoder->paths[result.frame.index]);
+    return result.rc;
+}
+
+void movidius_releaseFrame(movidius_decodedframe* frame)
+{
+    stbi_image_free(frame->pixels);
+    frame->pixels = NULL;
+}
+
+void movidius_destroyDecoder(movidius_decoder* decoder)
+{
+    if (decoder == NULL)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(decoder->mutex);
+        decoder->stopping = true;
+    }
+    decoder->room.notify_all();
+
+    for (size_t i = 0; i < decoder->workers.size(); i++)
+        decoder->workers[i].join();
+
+    for (size_t i = 0; i < decoder->results.size(); i++)
+        movidius_releaseFrame(&decoder->results[i].frame);
+
+    delete decoder;
+
+    std::lock_guard<std::mutex> lock(decode_mutex);
+    if (--decode_decoders == 0)
+        decode_trim();
+}
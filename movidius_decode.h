@@ -0,0 +1,64 @@
+#ifndef MOVIDIUS_DECODE_H
+#define MOVIDIUS_DECODE_H
+
+#include "movidiusdevice.h"
+
+/**
+ * Decodes image files on worker threads and hands them out as soon as each one is ready,
+ * so inference on the first images starts while the rest are still being decoded
+ * Decoded frames are RGB888, 64 byte aligned, and come from buffers that are recycled once
+ * released, so a long list of files does not hit the heap for every image
+ * Workers stay at most queue_depth frames ahead of the consumer
+ *
+ * Includes the stb_image implementation, so programs linking this only include stb_image.h
+ */
+struct movidius_decoder;
+
+/**
+ * One decoded image, pass pixels to movidius_convertFrame() with MOVIDIUS_PIXEL_RGB
+ */
+typedef struct
+{
+    /**
+     * Position of the file in the list given to movidius_createDecoder()
+     */
+    unsigned int index;
+
+    /**
+     * NULL if the file could not be decoded
+     */
+    unsigned char* pixels;
+    unsigned int width;
+    unsigned int height;
+    unsigned int stride;
+} movidius_decodedframe;
+
+/**
+ * Starts decoding the count files in paths, which must stay valid until the decoder is destroyed
+ * @param threads: Decoding threads, 0 picks one less than the cpus so the caller has one for itself
+ * @param queue_depth: Most frames decoded but not taken with movidius_nextFrame() yet, at least 1
+ * Returns NULL if the threads could not be started
+ */
+extern movidius_decoder* movidius_createDecoder(const char* const* paths, unsigned int count,
+                                                unsigned int threads, unsigned int queue_depth);
+
+/**
+ * Takes the next decoded frame, blocking until one is ready
+ * Frames come in the order they finish decoding, frame->index tells which file they are
+ * Returns 0 on success, DATA_LOAD_FAILED with frame->index set and frame->pixels NULL if
+ * that file could not be decoded, NOT_ALLOWED_THIS_TIME once every file has been handed out
+ */
+extern int movidius_nextFrame(movidius_decoder* decoder, movidius_decodedframe* frame);
+
+/**
+ * Gives the buffer of a frame back for decoding the next images, pixels is set to NULL
+ * Frames can be kept as long as needed, also after the decoder is destroyed
+ */
+extern void movidius_releaseFrame(movidius_decodedframe* frame);
+
+/**
+ * Stops the threads, frees the frames nobody took and the recycled buffers
+ */
+extern void movidius_destroyDecoder(movidius_decoder* decoder);
+
+#endif // MOVIDIUS_DECODE_H
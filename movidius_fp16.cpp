@@ -0,0 +1,353 @@
+#include "movidius_fp16.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MOVIDIUS_FP16_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define MOVIDIUS_FP16_NEON 1
+#include <arm_neon.h>
+#endif
+
+/**
+ * The hardware conversions round to nearest even while float2half() rounds
+ * half away from zero. Setting the lowest significand bit before converting
+ * turns an exact tie into a value slightly above it, and leaves every other
+ * input on the same side of the rounding point, so both agree afterwards.
+ * Inf would turn into a NaN this way and hardware quiets NaN payloads, so the
+ * few lanes holding those are patched up with the scalar function
+ */
+static const unsigned fp16_sticky_bit = 0x00000001u;
+
+void floattofp16_scalar(unsigned char *dst, float *src, unsigned nelem)
+{
+    unsigned short *_dst = (unsigned short *)dst;
+    unsigned *_src = (unsigned *)src;
+
+    for (unsigned i = 0; i < nelem; i++)
+        _dst[i] = float2half(_src[i]);
+}
+
+void fp16tofloat_scalar(float *dst, unsigned char *src, unsigned nelem)
+{
+    unsigned *_dst = (unsigned *)dst;
+    unsigned short *_src = (unsigned short *)src;
+
+    for (unsigned i = 0; i < nelem; i++)
+        _dst[i] = half2float(_src[i]);
+}
+
+static void floattofp16_branchless(unsigned char *dst, float *src, unsigned nelem)
+{
+    unsigned short *_dst = (unsigned short *)dst;
+    unsigned *_src = (unsigned *)src;
+
+    for (unsigned i = 0; i < nelem; i++)
+        _dst[i] = float2half_branchless(_src[i]);
+}
+
+static void fp16tofloat_branchless(float *dst, unsigned char *src, unsigned nelem)
+{
+    unsigned *_dst = (unsigned *)dst;
+    unsigned short *_src = (unsigned short *)src;
+
+    for (unsigned i = 0; i < nelem; i++)
+        _dst[i] = half2float_branchless(_src[i]);
+}
+
+#ifdef MOVIDIUS_FP16_X86
+
+__attribute__((target("avx,f16c")))
+static void floattofp16_f16c(unsigned char *dst, float *src, unsigned nelem)
+{
+    unsigned short *_dst = (unsigned short *)dst;
+    unsigned *_src = (unsigned *)src;
+    const __m256 sticky = _mm256_castsi256_ps(_mm256_set1_epi32(fp16_sticky_bit));
+    const __m256 absmask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 inf = _mm256_castsi256_ps(_mm256_set1_epi32(0x7f800000));
+    unsigned i = 0;
+
+    for (; i + 8 <= nelem; i += 8)
+    {
+        __m256 v = _mm256_loadu_ps(src + i);
+        __m128i h = _mm256_cvtps_ph(_mm256_or_ps(v, sticky), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(_dst + i), h);
+
+        int special = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_and_ps(v, absmask), inf, _CMP_NLT_UQ));
+        while (special)
+        {
+            int lane = __builtin_ctz(special);
+            _dst[i + lane] = float2half(_src[i + lane]);
+            special &= special - 1;
+        }
+    }
+
+    for (; i < nelem; i++)
+        _dst[i] = float2half(_src[i]);
+}
+
+__attribute__((target("avx,f16c")))
+static void fp16tofloat_f16c(float *dst, unsigned char *src, unsigned nelem)
+{
+    unsigned *_dst = (unsigned *)dst;
+    unsigned short *_src = (unsigned short *)src;
+    unsigned i = 0;
+
+    for (; i + 8 <= nelem; i += 8)
+    {
+        __m256 f = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(_src + i)));
+        _mm256_storeu_ps(dst + i, f);
+
+        // signaling NaNs get quieted by the hardware, half2float() keeps the payload as is
+        int nans = _mm256_movemask_ps(_mm256_cmp_ps(f, f, _CMP_UNORD_Q));
+        while (nans)
+        {
+            int lane = __builtin_ctz(nans);
+            _dst[i + lane] = half2float(_src[i + lane]);
+            nans &= nans - 1;
+        }
+    }
+
+    for (; i < nelem; i++)
+        _dst[i] = half2float(_src[i]);
+}
+
+__attribute__((target("avx512f")))
+static void floattofp16_avx512(unsigned char *dst, float *src, unsigned nelem)
+{
+    unsigned short *_dst = (unsigned short *)dst;
+    unsigned *_src = (unsigned *)src;
+    const __m512i sticky = _mm512_set1_epi32(fp16_sticky_bit);
+    const __m512 inf = _mm512_castsi512_ps(_mm512_set1_epi32(0x7f800000));
+    unsigned i = 0;
+
+    for (; i + 16 <= nelem; i += 16)
+    {
+        __m512 v = _mm512_loadu_ps(src + i);
+        __m512 rounded = _mm512_castsi512_ps(_mm512_or_epi32(_mm512_castps_si512(v), sticky));
+        __m256i h = _mm512_maskz_cvtps_ph(0xffff, rounded, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm256_storeu_si256((__m256i*)(_dst + i), h);
+
+        __mmask16 special = _mm512_cmp_ps_mask(_mm512_abs_ps(v), inf, _CMP_NLT_UQ);
+        while (special)
+        {
+            int lane = __builtin_ctz(special);
+            _dst[i + lane] = float2half(_src[i + lane]);
+            special &= special - 1;
+        }
+    }
+
+    for (; i < nelem; i++)
+        _dst[i] = float2half(_src[i]);
+}
+
+__attribute__((target("avx512f")))
+static void fp16tofloat_avx512(float *dst, unsigned char *src, unsigned nelem)
+{
+    unsigned *_dst = (unsigned *)dst;
+    unsigned short *_src = (unsigned short *)src;
+    unsigned i = 0;
+
+    for (; i + 16 <= nelem; i += 16)
+    {
+        __m512 f = _mm512_maskz_cvtph_ps(0xffff, _mm256_loadu_si256((const __m256i*)(_src + i)));
+        _mm512_storeu_ps(dst + i, f);
+
+        __mmask16 nans = _mm512_cmp_ps_mask(f, f, _CMP_UNORD_Q);
+        while (nans)
+        {
+            int lane = __builtin_ctz(nans);
+            _dst[i + lane] = half2float(_src[i + lane]);
+            nans &= nans - 1;
+        }
+    }
+
+    for (; i < nelem; i++)
+        _dst[i] = half2float(_src[i]);
+}
+
+#endif // MOVIDIUS_FP16_X86
+
+#ifdef MOVIDIUS_FP16_NEON
+
+static void floattofp16_neon(unsigned char *dst, float *src, unsigned nelem)
+{
+    unsigned short *_dst = (unsigned short *)dst;
+    unsigned *_src = (unsigned *)src;
+    const uint32x4_t sticky = vdupq_n_u32(fp16_sticky_bit);
+    const uint32x4_t absmask = vdupq_n_u32(0x7fffffffu);
+    const uint32x4_t inf = vdupq_n_u32(0x7f800000u);
+    unsigned i = 0;
+
+    for (; i + 4 <= nelem; i += 4)
+    {
+        uint32x4_t v = vreinterpretq_u32_f32(vld1q_f32(src + i));
+        float16x4_t h = vcvt_f16_f32(vreinterpretq_f32_u32(vorrq_u32(v, sticky)));
+        vst1_u16(_dst + i, vreinterpret_u16_f16(h));
+
+        if (vmaxvq_u32(vcgeq_u32(vandq_u32(v, absmask), inf)))
+        {
+            for (unsigned lane = i; lane < i + 4; lane++)
+                _dst[lane] = float2half(_src[lane]);
+        }
+    }
+
+    for (; i < nelem; i++)
+        _dst[i] = float2half(_src[i]);
+}
+
+static void fp16tofloat_neon(float *dst, unsigned char *src, unsigned nelem)
+{
+    unsigned *_dst = (unsigned *)dst;
+    unsigned short *_src = (unsigned short *)src;
+    unsigned i = 0;
+
+    for (; i + 4 <= nelem; i += 4)
+    {
+        float32x4_t f = vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(_src + i)));
+        vst1q_f32(dst + i, f);
+
+        if (vminvq_u32(vceqq_f32(f, f)) == 0)
+        {
+            for (unsigned lane = i; lane < i + 4; lane++)
+                _dst[lane] = half2float(_src[lane]);
+        }
+    }
+
+    for (; i < nelem; i++)
+        _dst[i] = half2float(_src[i]);
+}
+
+#endif // MOVIDIUS_FP16_NEON
+
+typedef void (*floattofp16_fn)(unsigned char*, float*, unsigned);
+typedef void (*fp16tofloat_fn)(float*, unsigned char*, unsigned);
+
+struct fp16_dispatch
+{
+    int kernel;
+    floattofp16_fn toHalf;
+    fp16tofloat_fn toFloat;
+};
+
+static bool fp16_kernelSupported(int kernel)
+{
+    switch (kernel)
+    {
+    case FP16_KERNEL_SCALAR:
+    case FP16_KERNEL_BRANCHLESS:
+        return true;
+#ifdef MOVIDIUS_FP16_X86
+    case FP16_KERNEL_F16C:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+    case FP16_KERNEL_AVX512:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f");
+#endif
+#ifdef MOVIDIUS_FP16_NEON
+    case FP16_KERNEL_NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+static int fp16_bestKernel()
+{
+    const int preferred[] = { FP16_KERNEL_AVX512, FP16_KERNEL_F16C, FP16_KERNEL_NEON };
+
+    for (unsigned i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++)
+    {
+        if (fp16_kernelSupported(preferred[i]))
+            return preferred[i];
+    }
+
+    return FP16_KERNEL_BRANCHLESS;
+}
+
+static fp16_dispatch fp16_makeDispatch(int kernel)
+{
+    fp16_dispatch d;
+    d.kernel = kernel;
+
+    switch (kernel)
+    {
+#ifdef MOVIDIUS_FP16_X86
+    case FP16_KERNEL_F16C:
+        d.toHalf = floattofp16_f16c;
+        d.toFloat = fp16tofloat_f16c;
+        break;
+    case FP16_KERNEL_AVX512:
+        d.toHalf = floattofp16_avx512;
+        d.toFloat = fp16tofloat_avx512;
+        break;
+#endif
+#ifdef MOVIDIUS_FP16_NEON
+    case FP16_KERNEL_NEON:
+        d.toHalf = floattofp16_neon;
+        d.toFloat = fp16tofloat_neon;
+        break;
+#endif
+    case FP16_KERNEL_BRANCHLESS:
+        d.toHalf = floattofp16_branchless;
+        d.toFloat = fp16tofloat_branchless;
+        break;
+    default:
+        d.kernel = FP16_KERNEL_SCALAR;
+        d.toHalf = floattofp16_scalar;
+        d.toFloat = fp16tofloat_scalar;
+        break;
+    }
+
+    return d;
+}
+
+static fp16_dispatch& fp16_active()
+{
+    static fp16_dispatch active = fp16_makeDispatch(fp16_bestKernel());
+    return active;
+}
+
+void floattofp16(unsigned char *dst, float *src, unsigned nelem)
+{
+    fp16_active().toHalf(dst, src, nelem);
+}
+
+void fp16tofloat(float *dst, unsigned char *src, unsigned nelem)
+{
+    fp16_active().toFloat(dst, src, nelem);
+}
+
+int fp16_selectKernel(int kernel)
+{
+    if (kernel == FP16_KERNEL_AUTO)
+        kernel = fp16_bestKernel();
+
+    if (!fp16_kernelSupported(kernel))
+        return -1;
+
+    fp16_active() = fp16_makeDispatch(kernel);
+    return 0;
+}
+
+int fp16_currentKernel()
+{
+    return fp16_active().kernel;
+}
+
+const char* fp16_kernelName(int kernel)
+{
+    switch (kernel)
+    {
+    case FP16_KERNEL_AUTO: return "auto";
+    case FP16_KERNEL_SCALAR: return "scalar";
+    case FP16_KERNEL_BRANCHLESS: return "branchless";
+    case FP16_KERNEL_F16C: return "f16c";
+    case FP16_KERNEL_AVX512: return "avx512";
+    case FP16_KERNEL_NEON: return "neon";
+    default: return "unknown";
+    }
+}
@@ -1,6 +1,11 @@
+#ifndef MOVIDIUS_FP16_H
+#define MOVIDIUS_FP16_H
+
+#include <stdint.h>
+
 // Copied from Numpy
 
-static unsigned half2float(unsigned short h)
+static inline unsigned half2float(unsigned short h)
 {
     unsigned short h_exp, h_sig;
     unsigned f_sgn, f_exp, f_sig;
@@ -32,7 +37,7 @@ static unsigned half2float(unsigned short h)
     }
 }
 
-unsigned short float2half(unsigned f)
+static inline unsigned short float2half(unsigned f)
 {
     unsigned f_exp, f_sig;
     unsigned short h_sgn, h_exp, h_sig;
@@ -147,23 +152,117 @@ unsigned short float2half(unsigned f)
 #endif
 }
 
-void floattofp16(unsigned char *dst, float *src, unsigned nelem)
+
+/**
+ * Branchless equivalent of half2float(), every input takes the same path so
+ * the compiler is free to vectorize loops calling this
+ */
+static inline unsigned half2float_branchless(unsigned short h)
 {
-	unsigned i;
-	unsigned short *_dst = (unsigned short *)dst;
-	unsigned *_src = (unsigned *)src;
-	
-	for(i = 0; i < nelem; i++)
-		_dst[i] = float2half(_src[i]);
+    unsigned h_exp = h & 0x7c00u;
+    unsigned h_sig = h & 0x03ffu;
+    unsigned f_sgn = ((unsigned)h & 0x8000u) << 16;
+
+    /* Normalized: rebias the exponent */
+    unsigned normal = (((unsigned)h & 0x7fffu) + 0x1c000u) << 13;
+    /* Inf or NaN: all-ones exponent and a copy of the significand */
+    unsigned special = 0x7f800000u | (h_sig << 13);
+    /* Zero or subnormal: h_sig * 2^-24 is exactly representable as a float */
+    union { float f; unsigned u; } sub;
+    sub.f = (float)h_sig * 5.9604644775390625e-8f;
+
+    unsigned is_zero_exp = 0u - (unsigned)(h_exp == 0);
+    unsigned is_max_exp = 0u - (unsigned)(h_exp == 0x7c00u);
+
+    unsigned f = (sub.u & is_zero_exp) | (normal & ~is_zero_exp);
+    f = (special & is_max_exp) | (f & ~is_max_exp);
+    return f_sgn | f;
 }
 
-void fp16tofloat(float *dst, unsigned char *src, unsigned nelem)
+/**
+ * Branchless equivalent of float2half(), including its round half away from zero
+ * behaviour and the NaN payload propagation
+ */
+static inline unsigned short float2half_branchless(unsigned f)
 {
-	unsigned i;
-	unsigned *_dst = (unsigned *)dst;
-	unsigned short *_src = (unsigned short *)src;
-	
-	for(i = 0; i < nelem; i++)
-		_dst[i] = half2float(_src[i]);
+    unsigned h_sgn = (f & 0x80000000u) >> 16;
+    unsigned f_abs = f & 0x7fffffffu;
+    unsigned f_exp = f_abs >> 23;
+    unsigned f_sig = f & 0x007fffffu;
+
+    /* Regular case, the rounding carry may spill into the exponent which is correct */
+    unsigned normal = (f_abs - 0x38000000u + 0x00001000u) >> 13;
+
+    /*
+     * Subnormal half. Exponents below 102 shift the significand so far that the
+     * result is zero, the shift is clamped to keep it defined for float subnormals
+     */
+    unsigned shift = 113u - f_exp;
+    shift = shift > 31u ? 31u : shift;
+    unsigned sub = (((0x00800000u | f_sig) >> shift) + 0x00001000u) >> 13;
+
+    /* Inf or NaN, making sure a NaN stays a NaN */
+    unsigned nan_sig = f_sig >> 13;
+    unsigned special = 0x7c00u | nan_sig | (unsigned)(f_sig != 0 && nan_sig == 0);
+
+    unsigned is_normal = 0u - (unsigned)(f_abs >= 0x38800000u);
+    unsigned is_overflow = 0u - (unsigned)(f_abs >= 0x47800000u);
+    unsigned is_special = 0u - (unsigned)(f_abs >= 0x7f800000u);
+
+    unsigned h = (normal & is_normal) | (sub & ~is_normal);
+    h = (0x7c00u & is_overflow) | (h & ~is_overflow);
+    h = (special & is_special) | (h & ~is_special);
+    return (unsigned short)(h_sgn | h);
 }
 
+/**
+ * Implementations available for floattofp16() and fp16tofloat()
+ * All of them produce bit identical output to float2half() and half2float()
+ */
+enum
+{
+    FP16_KERNEL_AUTO = 0,
+    FP16_KERNEL_SCALAR = 1,
+    FP16_KERNEL_BRANCHLESS = 2,
+    FP16_KERNEL_F16C = 3,
+    FP16_KERNEL_AVX512 = 4,
+    FP16_KERNEL_NEON = 5
+};
+
+/**
+ * Converts nelem floats from src to half floats in dst using the fastest
+ * kernel supported by the CPU, or the one forced with fp16_selectKernel()
+ */
+extern void floattofp16(unsigned char *dst, float *src, unsigned nelem);
+
+/**
+ * Converts nelem half floats from src to floats in dst, see floattofp16()
+ */
+extern void fp16tofloat(float *dst, unsigned char *src, unsigned nelem);
+
+/**
+ * The plain per element loops over float2half() and half2float()
+ * These are the reference the other kernels are compared against
+ */
+extern void floattofp16_scalar(unsigned char *dst, float *src, unsigned nelem);
+extern void fp16tofloat_scalar(float *dst, unsigned char *src, unsigned nelem);
+
+/**
+ * Forces floattofp16() and fp16tofloat() to use the given FP16_KERNEL_* implementation
+ * FP16_KERNEL_AUTO restores the runtime detected one
+ * Not thread safe, call this before starting any conversions
+ * Returns 0 on success, -1 if the kernel is not supported by this CPU or build
+ */
+extern int fp16_selectKernel(int kernel);
+
+/**
+ * Returns the FP16_KERNEL_* implementation currently in use
+ */
+extern int fp16_currentKernel();
+
+/**
+ * Returns a printable name for the given FP16_KERNEL_* value
+ */
+extern const char* fp16_kernelName(int kernel);
+
+#endif // MOVIDIUS_FP16_H
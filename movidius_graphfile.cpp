@@ -0,0 +1,196 @@
+#include "movidius_graphfile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mutex>
+#include <vector>
+
+struct movidius_graphfile
+{
+    void* data;
+    unsigned int length;
+    bool mapped;
+    int refs;
+
+    // identity of the file on disk, a replaced or rewritten file gets a new entry
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+};
+
+static std::mutex graphfile_mutex;
+static std::vector<movidius_graphfile*> graphfile_open;
+static int graphfile_options = MOVIDIUS_GRAPHFILE_WILLNEED;
+
+static bool graphfile_same(const movidius_graphfile* file, const struct stat& st)
+{
+    return file->device == st.st_dev && file->inode == st.st_ino && file->size == st.st_size &&
+           file->modified.tv_sec == st.st_mtim.tv_sec && file->modified.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+static void* graphfile_read(int fd, const char* path, unsigned int length)
+{
+    char* buf = (char*)malloc(length);
+    if (buf == NULL)
+    {
+        fprintf(stderr, "movidius: Cannot allocate buffer of size %u for file %s\n", length, path);
+        return NULL;
+    }
+
+    unsigned int done = 0;
+    while (done < length)
+    {
+        ssize_t got = read(fd, buf + done, length - done);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+        {
+            fprintf(stderr, "movidius: Failed reading %u bytes from file %s\n", length, path);
+            free(buf);
+            return NULL;
+        }
+        done += (unsigned int)got;
+    }
+
+    return buf;
+}
+
+static void* graphfile_map(int fd, const char* path, unsigned int length, int options)
+{
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (options & MOVIDIUS_GRAPHFILE_POPULATE)
+        flags |= MAP_POPULATE;
+#endif
+
+    void* data = mmap(NULL, length, PROT_READ, flags, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "movidius: Cannot map file %s: %s, reading it instead\n", path, strerror(errno));
+        return NULL;
+    }
+
+    if ((options & MOVIDIUS_GRAPHFILE_WILLNEED) && madvise(data, length, MADV_WILLNEED) != 0)
+        fprintf(stderr, "movidius: madvise failed for %s: %s\n", path, strerror(errno));
+
+    return data;
+}
+
+void movidius_setGraphFileOptions(int options)
+{
+    std::lock_guard<std::mutex> lock(graphfile_mutex);
+    graphfile_options = options;
+}
+
+movidius_graphfile* movidius_openGraphFile(const char* path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        fprintf(stderr, "movidius: Cannot read file: %s\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        fprintf(stderr, "movidius: Cannot read file: %s\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    if (st.st_size == 0 || (unsigned long long)st.st_size > 0xffffffffULL)
+    {
+        fprintf(stderr, "movidius: invalid file length %lld for %s\n", (long long)st.st_size, path);
+        close(fd);
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> lock(graphfile_mutex);
+
+    for (size_t i = 0; i < graphfile_open.size(); i++)
+    {
+        if (graphfile_same(graphfile_open[i], st))
+        {
+            close(fd);
+            graphfile_open[i]->refs++;
+            return graphfile_open[i];
+        }
+    }
+
+    unsigned int length = (unsigned int)st.st_size;
+    void* data = NULL;
+    bool mapped = false;
+
+    if (!(graphfile_options & MOVIDIUS_GRAPHFILE_READ))
+    {
+        data = graphfile_map(fd, path, length, graphfile_options);
+        mapped = data != NULL;
+    }
+
+    if (data == NULL)
+        data = graphfile_read(fd, path, length);
+
+    // a mapping stays valid after the descriptor is closed
+    close(fd);
+
+    if (data == NULL)
+        return NULL;
+
+    movidius_graphfile* file = new movidius_graphfile;
+    file->data = data;
+    file->length = length;
+    file->mapped = mapped;
+    file->refs = 1;
+    file->device = st.st_dev;
+    file->inode = st.st_ino;
+    file->size = st.st_size;
+    file->modified = st.st_mtim;
+
+    graphfile_open.push_back(file);
+    return file;
+}
+
+void movidius_releaseGraphFile(movidius_graphfile* file)
+{
+    if (file == NULL)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(graphfile_mutex);
+        if (--file->refs > 0)
+            return;
+
+        for (size_t i = 0; i < graphfile_open.size(); i++)
+        {
+            if (graphfile_open[i] == file)
+            {
+                graphfile_open.erase(graphfile_open.begin() + i);
+                break;
+            }
+        }
+    }
+
+    if (file->mapped)
+        munmap(file->data, file->length);
+    else
+        free(file->data);
+
+    delete file;
+}
+
+const void* movidius_graphFileData(const movidius_graphfile* file)
+{
+    return file->data;
+}
+
+unsigned int movidius_graphFileLength(const movidius_graphfile* file)
+{
+    return file->length;
+}
@@ -0,0 +1,60 @@
+#ifndef MOVIDIUS_GRAPHFILE_H
+#define MOVIDIUS_GRAPHFILE_H
+
+/**
+ * A graph file mapped read only into memory, shared by every device and every upload of
+ * the same file. The data is passed straight to mvncAllocateGraph(), nothing is copied
+ */
+typedef struct movidius_graphfile movidius_graphfile;
+
+/**
+ * Options for movidius_setGraphFileOptions()
+ */
+enum
+{
+    /**
+     * Fault the whole file in when mapping it, so the upload does not stall on page faults
+     */
+    MOVIDIUS_GRAPHFILE_POPULATE = 1,
+
+    /**
+     * Tell the kernel the mapping is about to be read front to back
+     */
+    MOVIDIUS_GRAPHFILE_WILLNEED = 2,
+
+    /**
+     * Read the file into a malloc'd buffer instead of mapping it, like before mmap support
+     */
+    MOVIDIUS_GRAPHFILE_READ = 4
+};
+
+/**
+ * Sets how graph files opened from now on are loaded, a combination of MOVIDIUS_GRAPHFILE_*
+ * Defaults to MOVIDIUS_GRAPHFILE_WILLNEED
+ */
+extern void movidius_setGraphFileOptions(int options);
+
+/**
+ * Returns the graph file at path, mapping it if it is not already
+ * Opening a file that is still held returns the same mapping with its reference count raised,
+ * as long as the file on disk has not been replaced or modified in the meantime
+ * Returns NULL if the file cannot be opened or is empty
+ */
+extern movidius_graphfile* movidius_openGraphFile(const char* path);
+
+/**
+ * Drops one reference, the mapping goes away with the last one
+ */
+extern void movidius_releaseGraphFile(movidius_graphfile* file);
+
+/**
+ * Start of the file contents, valid until the file is released
+ */
+extern const void* movidius_graphFileData(const movidius_graphfile* file);
+
+/**
+ * Size of the file contents in bytes
+ */
+extern unsigned int movidius_graphFileLength(const movidius_graphfile* file);
+
+#endif // MOVIDIUS_GRAPHFILE_H
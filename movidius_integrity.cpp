@@ -0,0 +1,241 @@
+#include "movidius_integrity.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+const char* AgeNetworkHash = "8c67db0340212e05de2ed2c7752df7ba42e54f6aef01b1e6547bc958491eaddf";
+const char* GenderNetworkHash = "ee7b247b0e0366aa8fc10e38261bd7cd75c9884ed8b067a5084ee07052a3c2a2";
+
+struct manifest_entry
+{
+    std::string path;
+    unsigned char hash[32];
+};
+
+struct movidius_integritycheck
+{
+    movidius_network* network;
+    std::string path;
+    unsigned char expected[32];
+    unsigned char actual[32];
+    std::thread hasher;
+};
+
+static std::mutex integrity_mutex;
+static std::vector<manifest_entry> integrity_manifest;
+static bool integrity_defaultsAdded = false;
+static int integrity_mode = MOVIDIUS_INTEGRITY_BACKGROUND;
+
+static bool integrity_parseHash(const char* hex, unsigned char* hash)
+{
+    for (int i = 0; i < 32; i++)
+    {
+        unsigned int byte;
+        if (!isxdigit((unsigned char)hex[2 * i]) || !isxdigit((unsigned char)hex[2 * i + 1]) ||
+            sscanf(hex + 2 * i, "%2x", &byte) != 1)
+            return false;
+        hash[i] = (unsigned char)byte;
+    }
+
+    return true;
+}
+
+static std::string integrity_hex(const unsigned char* hash)
+{
+    char hex[65];
+    for (int i = 0; i < 32; i++)
+        snprintf(hex + 2 * i, 3, "%02x", hash[i]);
+    return hex;
+}
+
+/**
+ * Adds or replaces an entry, integrity_mutex must be held
+ */
+static void integrity_add(const std::string& path, const unsigned char* hash)
+{
+    for (size_t i = 0; i < integrity_manifest.size(); i++)
+    {
+        if (integrity_manifest[i].path == path)
+        {
+            memcpy(integrity_manifest[i].hash, hash, 32);
+            return;
+        }
+    }
+
+    manifest_entry entry;
+    entry.path = path;
+    memcpy(entry.hash, hash, 32);
+    integrity_manifest.push_back(entry);
+}
+
+/**
+ * The networks main.cpp ships with, listed before anything else is added
+ */
+static void integrity_addDefaults()
+{
+    if (integrity_defaultsAdded)
+        return;
+    integrity_defaultsAdded = true;
+
+    unsigned char hash[32];
+    if (integrity_parseHash(AgeNetworkHash, hash))
+        integrity_add("./network/Age", hash);
+    if (integrity_parseHash(GenderNetworkHash, hash))
+        integrity_add("./network/Gender", hash);
+}
+
+/**
+ * Looks up the expected hash of a network folder, bundle or its graph file
+ */
+static bool integrity_expected(const char* network_path, unsigned char* hash)
+{
+    std::lock_guard<std::mutex> lock(integrity_mutex);
+    integrity_addDefaults();
+
+    std::string graph_path = std::string(network_path) + "/graph";
+    for (size_t i = 0; i < integrity_manifest.size(); i++)
+    {
+        if (integrity_manifest[i].path == network_path || integrity_manifest[i].path == graph_path)
+        {
+            memcpy(hash, integrity_manifest[i].hash, 32);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void movidius_setIntegrityMode(int mode)
+{
+    std::lock_guard<std::mutex> lock(integrity_mutex);
+    integrity_mode = mode;
+}
+
+int movidius_addExpectedHash(const char* network_path, const char* hash)
+{
+    unsigned char parsed[32];
+    if (strlen(hash) != 64 || !integrity_parseHash(hash, parsed))
+    {
+        fprintf(stderr, "movidius: invalid sha256 for %s: %s\n", network_path, hash);
+        return INVALID_INPUT_DATA;
+    }
+
+    std::lock_guard<std::mutex> lock(integrity_mutex);
+    integrity_addDefaults();
+    integrity_add(network_path, parsed);
+    return 0;
+}
+
+int movidius_loadManifest(const char* path)
+{
+    char line[2048];
+    int number = 0;
+
+    FILE* fp = fopen(path, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "movidius: Failed opening manifest: %s\n", path);
+        return DATA_LOAD_FAILED;
+    }
+
+    std::lock_guard<std::mutex> lock(integrity_mutex);
+    integrity_addDefaults();
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        number++;
+
+        char* end = line + strlen(line);
+        while (end > line && isspace((unsigned char)end[-1]))
+            *--end = 0;
+
+        if (line[0] == 0 || line[0] == '#')
+            continue;
+
+        // sha256sum puts a * before the name in binary mode
+        unsigned char hash[32];
+        char* name = line + 64;
+        if (strlen(line) < 66 || !isspace((unsigned char)*name) || !integrity_parseHash(line, hash))
+        {
+            fprintf(stderr, "movidius: %s:%d: expected a sha256 and a path\n", path, number);
+            fclose(fp);
+            return DATA_LOAD_FAILED;
+        }
+
+        while (isspace((unsigned char)*name))
+            name++;
+        if (*name == '*')
+            name++;
+
+        integrity_add(name, hash);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+int movidius_beginIntegrityCheck(const char* network_path, movidius_network* network,
+                                 movidius_integritycheck** check)
+{
+    *check = NULL;
+
+    int mode;
+    {
+        std::lock_guard<std::mutex> lock(integrity_mutex);
+        mode = integrity_mode;
+    }
+
+    unsigned char expected[32];
+    if (mode == MOVIDIUS_INTEGRITY_OFF || !integrity_expected(network_path, expected))
+        return 0;
+
+    movidius_integritycheck* started = new movidius_integritycheck;
+    started->network = network;
+    started->path = network_path;
+    memcpy(started->expected, expected, sizeof(expected));
+
+    // a hash kept from an earlier upload costs nothing to compare right away
+    if (mode == MOVIDIUS_INTEGRITY_BLOCKING || network->graphHashed)
+    {
+        movidius_networkGraphHash(network, started->actual);
+        return movidius_finishIntegrityCheck(started);
+    }
+
+    try
+    {
+        started->hasher = std::thread(movidius_networkGraphHash, network, started->actual);
+    }
+    catch (const std::system_error& e)
+    {
+        fprintf(stderr, "movidius: failed starting hashing thread: %s\n", e.what());
+        movidius_networkGraphHash(network, started->actual);
+    }
+
+    *check = started;
+    return 0;
+}
+
+int movidius_finishIntegrityCheck(movidius_integritycheck* check)
+{
+    if (check == NULL)
+        return 0;
+
+    if (check->hasher.joinable())
+        check->hasher.join();
+
+    int rc = 0;
+    if (memcmp(check->actual, check->expected, sizeof(check->expected)) != 0)
+    {
+        fprintf(stderr, "movidius: graph of %s sha256sum in memory differs: %s vs %s\n", check->path.c_str(),
+                integrity_hex(check->actual).c_str(), integrity_hex(check->expected).c_str());
+        rc = MOVIDIUS_INTEGRITY_FAILED;
+    }
+
+    delete check;
+    return rc;
+}
@@ -0,0 +1,79 @@
+#ifndef MOVIDIUS_INTEGRITY_H
+#define MOVIDIUS_INTEGRITY_H
+
+#include "movidius_network.h"
+
+/**
+ * Checks graphs against a manifest of expected SHA-256 hashes before they are used
+ * The Age and Gender networks of the example are listed by default
+ */
+
+/**
+ * When movidius_uploadNetwork() verifies graphs, see movidius_setIntegrityMode()
+ */
+enum
+{
+    /**
+     * Never hash graphs
+     */
+    MOVIDIUS_INTEGRITY_OFF = 0,
+
+    /**
+     * Hash on a separate thread while mvncAllocateGraph() runs, and deallocate the graph
+     * again if the hash turns out wrong. The default
+     */
+    MOVIDIUS_INTEGRITY_BACKGROUND = 1,
+
+    /**
+     * Hash and compare before mvncAllocateGraph(), a bad graph never reaches the device
+     * Graphs hashed by an earlier upload are compared before allocating in every mode
+     */
+    MOVIDIUS_INTEGRITY_BLOCKING = 2
+};
+
+/**
+ * Sets one of the MOVIDIUS_INTEGRITY_* modes
+ * Networks without a manifest entry are never checked. The hash of a graph is kept with the
+ * cached network, so only the first upload of a file pays for hashing it
+ */
+extern void movidius_setIntegrityMode(int mode);
+
+/**
+ * Adds the entries of a manifest in the format sha256sum writes: a hex hash, white space
+ * and a network path on each line. The path can be either the network folder or bundle as
+ * given to the upload functions, or the graph file inside the folder, so
+ * `sha256sum network/Age/graph network/Gender/graph > manifest` works as is. Lines starting with # are skipped
+ * Entries for a path already listed replace the earlier one
+ * Returns 0 on success
+ */
+extern int movidius_loadManifest(const char* path);
+
+/**
+ * Adds a single manifest entry, hash is 64 hex digits
+ * Returns 0 on success
+ */
+extern int movidius_addExpectedHash(const char* network_path, const char* hash);
+
+/**
+ * A verification running alongside a graph upload
+ */
+typedef struct movidius_integritycheck movidius_integritycheck;
+
+/**
+ * Verifies the graph of network, loaded from network_path
+ * In MOVIDIUS_INTEGRITY_BLOCKING mode, or when the hash is kept from an earlier upload, the hash
+ * is compared right away. Otherwise hashing starts on a separate thread and check is set to it,
+ * to be finished with movidius_finishIntegrityCheck() once mvncAllocateGraph() is done
+ * @param check: Set to NULL when there is nothing left to wait for
+ * Returns 0 unless the hash was compared and differs, then MOVIDIUS_INTEGRITY_FAILED
+ */
+extern int movidius_beginIntegrityCheck(const char* network_path, movidius_network* network,
+                                        movidius_integritycheck** check);
+
+/**
+ * Waits for the check and frees it
+ * Returns 0 if the hash matched or check is NULL, MOVIDIUS_INTEGRITY_FAILED otherwise
+ */
+extern int movidius_finishIntegrityCheck(movidius_integritycheck* check);
+
+#endif // MOVIDIUS_INTEGRITY_H
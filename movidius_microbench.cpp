@@ -0,0 +1,594 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "movidiusdevice.h"
+#include "movidius_fp16.h"
+#include "movidius_preprocess.h"
+#include "movidius_simbackend.h"
+
+/**
+ * Microbenchmarks for the half float kernels and the image conversion of movidiusdevice.h
+ * Every case runs for at least --min-time, the fastest of --repetitions runs is reported as
+ * nanoseconds per element or source pixel and GB/s of input read
+ * Next to every convertFrame case, resizeConvert times the unfused way to the same result: scaling
+ * the frame to the network size into an RGB buffer first, then movidius_convertImage()
+ * --save-baseline stores the results, --baseline compares against stored ones and fails
+ * when a case got slower than --tolerance allows
+ * Usage: movidius_microbench [options], see micro_usage()
+ */
+
+struct micro_options
+{
+    double minTimeMs;
+    unsigned int repetitions;
+    std::vector<unsigned int> threads;
+    std::string filter;
+    const char* baseline;
+    const char* saveBaseline;
+    double tolerance;
+};
+
+struct micro_result
+{
+    std::string name;
+    double nsPerItem;
+    double gbPerSecond;
+};
+
+typedef void (*micro_fn)(void* arg);
+
+struct micro_size
+{
+    unsigned int width;
+    unsigned int height;
+};
+
+// network input sizes of common classifiers, and a 4K camera frame
+static const micro_size micro_sizes[] = { { 227, 227 }, { 224, 224 }, { 300, 300 }, { 3840, 2160 } };
+
+static const struct
+{
+    int format;
+    const char* name;
+} micro_formats[] = {
+    { MOVIDIUS_PIXEL_RGB, "rgb" },
+    { MOVIDIUS_PIXEL_BGRA, "bgra" },
+    { MOVIDIUS_PIXEL_NV12, "nv12" },
+    { MOVIDIUS_PIXEL_YUYV, "yuyv" }
+};
+
+static const struct
+{
+    int mode;
+    const char* name;
+} micro_modes[] = {
+    { MOVIDIUS_CONVERT_LUT, "lut" },
+    { MOVIDIUS_CONVERT_FUSED, "fused" },
+    { MOVIDIUS_CONVERT_TWO_PASS, "two_pass" }
+};
+
+static void micro_usage(const char* name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --filter TEXT         only run cases with TEXT in their name\n"
+            "  --min-time MS         minimum time of every repetition (default 200)\n"
+            "  --repetitions N       runs per case, the fastest counts (default 3)\n"
+            "  --threads LIST        preprocessing thread counts, comma separated (default 1,2,4)\n"
+            "  --save-baseline PATH  store the results\n"
+            "  --baseline PATH       compare against stored results, exit 1 on regressions\n"
+            "  --tolerance PERCENT   slowdown allowed before a case counts as regressed (default 10)\n", name);
+}
+
+static double micro_nowNs()
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int micro_parse(int argc, char** argv, micro_options& options)
+{
+    options.minTimeMs = 200;
+    options.repetitions = 3;
+    options.baseline = NULL;
+    options.saveBaseline = NULL;
+    options.tolerance = 0.10;
+
+    const char* threads = "1,2,4";
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool ok = value != NULL;
+
+        if (arg == "--filter" && ok)
+            options.filter = value;
+        else if (arg == "--min-time" && ok)
+            options.minTimeMs = atof(value);
+        else if (arg == "--repetitions" && ok)
+            options.repetitions = atoi(value);
+        else if (arg == "--threads" && ok)
+            threads = value;
+        else if (arg == "--save-baseline" && ok)
+            options.saveBaseline = value;
+        else if (arg == "--baseline" && ok)
+            options.baseline = value;
+        else if (arg == "--tolerance" && ok)
+            options.tolerance = atof(value) / 100.0;
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+            return 1;
+        }
+        i++;
+    }
+
+    for (const char* p = threads; *p != '\0'; )
+    {
+        char* end;
+        unsigned long count = strtoul(p, &end, 10);
+        if (end == p || count == 0)
+        {
+            fprintf(stderr, "Invalid thread counts: %s\n", threads);
+            return 1;
+        }
+        options.threads.push_back((unsigned int)count);
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    if (options.repetitions == 0 || options.threads.empty())
+    {
+        fprintf(stderr, "Repetitions and thread counts must not be 0\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Runs fn until options.minTimeMs has passed, options.repetitions times, and adds the fastest
+ * @param items: Elements or pixels fn handles per call
+ * @param bytes: Bytes of input fn reads per call
+ */
+static void micro_measure(const micro_options& options, const std::string& name, double items, double bytes,
+                          micro_fn fn, void* arg, std::vector<micro_result>& results)
+{
+    // warms the caches and lets the converters size their buffers
+    fn(arg);
+
+    double best = 0;
+    for (unsigned int rep = 0; rep < options.repetitions; rep++)
+    {
+        unsigned long runs = 0;
+        double start = micro_nowNs();
+        double elapsed;
+
+        do
+        {
+            fn(arg);
+            runs++;
+            elapsed = micro_nowNs() - start;
+        } while (elapsed < options.minTimeMs * 1e6);
+
+        double ns = elapsed / runs;
+        if (rep == 0 || ns < best)
+            best = ns;
+    }
+
+    micro_result result = { name, best / items, bytes / best };
+    results.push_back(result);
+    printf("%-40s %10.3f ns %9.3f GB/s\n", name.c_str(), result.nsPerItem, result.gbPerSecond);
+    fflush(stdout);
+}
+
+static bool micro_selected(const micro_options& options, const std::string& name)
+{
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+struct fp16_case
+{
+    std::vector<float> floats;
+    std::vector<uint16_t> halves;
+};
+
+static void micro_floattofp16(void* arg)
+{
+    fp16_case* c = (fp16_case*)arg;
+    floattofp16((unsigned char*)c->halves.data(), c->floats.data(), c->floats.size());
+}
+
+static void micro_fp16tofloat(void* arg)
+{
+    fp16_case* c = (fp16_case*)arg;
+    fp16tofloat(c->floats.data(), (unsigned char*)c->halves.data(), c->halves.size());
+}
+
+static void micro_fp16(const micro_options& options, std::vector<micro_result>& results)
+{
+    for (int kernel = FP16_KERNEL_SCALAR; kernel <= FP16_KERNEL_NEON; kernel++)
+    {
+        if (fp16_selectKernel(kernel) != 0)
+            continue;
+
+        for (size_t s = 0; s < sizeof(micro_sizes) / sizeof(micro_sizes[0]); s++)
+        {
+            char size[32];
+            snprintf(size, sizeof(size), "%ux%u", micro_sizes[s].width, micro_sizes[s].height);
+            std::string to = std::string("floattofp16/") + fp16_kernelName(kernel) + "/" + size;
+            std::string from = std::string("fp16tofloat/") + fp16_kernelName(kernel) + "/" + size;
+            if (!micro_selected(options, to) && !micro_selected(options, from))
+                continue;
+
+            // one value per channel of an RGB image
+            size_t count = 3 * (size_t)micro_sizes[s].width * micro_sizes[s].height;
+            fp16_case c;
+            c.floats.resize(count);
+            c.halves.resize(count);
+            for (size_t i = 0; i < count; i++)
+                c.floats[i] = (float)((i * 7919) % 4096) / 512.0f - 4.0f;
+
+            if (micro_selected(options, to))
+                micro_measure(options, to, count, count * sizeof(float), micro_floattofp16, &c, results);
+            if (micro_selected(options, from))
+                micro_measure(options, from, count, count * sizeof(uint16_t), micro_fp16tofloat, &c, results);
+        }
+    }
+
+    fp16_selectKernel(FP16_KERNEL_AUTO);
+}
+
+struct convert_case
+{
+    movidius_device* dev;
+    std::vector<unsigned char> pixels;
+    int format;
+    unsigned int width;
+    unsigned int height;
+    unsigned int stride;
+};
+
+static void micro_convertFrame(void* arg)
+{
+    convert_case* c = (convert_case*)arg;
+    movidius_convertFrame(c->pixels.data(), c->format, c->width, c->height, c->stride, NULL,
+                          MOVIDIUS_RESIZE_AREA, c->dev);
+}
+
+static void micro_convertImage(void* arg)
+{
+    convert_case* c = (convert_case*)arg;
+    movidius_convertImage((movidius_RGB*)c->pixels.data(), c->width, c->height, c->dev);
+}
+
+/**
+ * Source index and weight of one filter tap
+ */
+struct micro_tap
+{
+    unsigned int index;
+    float weight;
+};
+
+/**
+ * Area filter taps of every output index along one axis, output i uses taps[offsets[i]] up to
+ * taps[offsets[i + 1]]
+ */
+struct micro_axis
+{
+    std::vector<micro_tap> taps;
+    std::vector<unsigned int> offsets;
+};
+
+/**
+ * The unfused pipeline: frame scaled to the network size as RGB888, then converted exactly sized
+ */
+struct resize_case
+{
+    convert_case* convert;
+    micro_axis x;
+    micro_axis y;
+    unsigned int size;
+    std::vector<unsigned char> row;
+    std::vector<float> sums;
+    std::vector<movidius_RGB> rgb;
+};
+
+static void micro_areaAxis(micro_axis& axis, unsigned int src_len, unsigned int dst_len)
+{
+    axis.taps.clear();
+    axis.offsets.assign(1, 0);
+
+    double scale = (double)src_len / dst_len;
+    for (unsigned int i = 0; i < dst_len; i++)
+    {
+        double begin = i * scale;
+        double end = std::min((i + 1) * scale, (double)src_len);
+        for (unsigned int s = (unsigned int)begin; s < end; s++)
+        {
+            double covered = std::min(end, s + 1.0) - std::max(begin, (double)s);
+            micro_tap tap = { s, (float)(covered / scale) };
+            axis.taps.push_back(tap);
+        }
+        axis.offsets.push_back((unsigned int)axis.taps.size());
+    }
+}
+
+static void micro_resizeConvert(void* arg)
+{
+    resize_case* r = (resize_case*)arg;
+    convert_case* c = r->convert;
+    movidius_frame frame = { c->pixels.data(), c->format, c->width, c->height, c->stride };
+    unsigned char* out = (unsigned char*)r->rgb.data();
+
+    for (unsigned int oy = 0; oy < r->size; oy++)
+    {
+        std::fill(r->sums.begin(), r->sums.end(), 0.0f);
+
+        for (unsigned int ty = r->y.offsets[oy]; ty < r->y.offsets[oy + 1]; ty++)
+        {
+            const micro_tap& vertical = r->y.taps[ty];
+            const unsigned char* row = movidius_frameRowRGB(&frame, vertical.index, 0, c->width, r->row.data());
+
+            for (unsigned int ox = 0; ox < r->size; ox++)
+            {
+                float red = 0.0f, green = 0.0f, blue = 0.0f;
+                for (unsigned int tx = r->x.offsets[ox]; tx < r->x.offsets[ox + 1]; tx++)
+                {
+                    const unsigned char* px = row + 3 * r->x.taps[tx].index;
+                    red += px[0] * r->x.taps[tx].weight;
+                    green += px[1] * r->x.taps[tx].weight;
+                    blue += px[2] * r->x.taps[tx].weight;
+                }
+
+                float* sum = &r->sums[3 * ox];
+                sum[0] += red * vertical.weight;
+                sum[1] += green * vertical.weight;
+                sum[2] += blue * vertical.weight;
+            }
+        }
+
+        unsigned char* dst = out + 3 * oy * r->size;
+        for (unsigned int i = 0; i < 3 * r->size; i++)
+            dst[i] = (unsigned char)std::min(r->sums[i] + 0.5f, 255.0f);
+    }
+
+    movidius_convertImage(r->rgb.data(), r->size, r->size, c->dev);
+}
+
+/**
+ * Fills a frame of the given format with noise, returns its stride
+ */
+static unsigned int micro_makeFrame(int format, unsigned int width, unsigned int height, std::vector<unsigned char>& pixels)
+{
+    unsigned int stride = format == MOVIDIUS_PIXEL_BGRA ? 4 * width :
+                          format == MOVIDIUS_PIXEL_RGB ? 3 * width :
+                          format == MOVIDIUS_PIXEL_YUYV ? 2 * width : width;
+    size_t rows = format == MOVIDIUS_PIXEL_NV12 ? height + height / 2 : height;
+
+    pixels.resize(stride * rows);
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        pixels[i] = (unsigned char)(seed >> 16);
+    }
+
+    return stride;
+}
+
+static void micro_convert(const micro_options& options, movidius_device* dev, std::vector<micro_result>& results)
+{
+    convert_case c;
+    c.dev = dev;
+
+    resize_case r;
+    r.convert = &c;
+    r.size = dev->graph->reqsize;
+    r.sums.resize(3 * r.size);
+    r.rgb.resize(r.size * r.size);
+
+    for (size_t f = 0; f < sizeof(micro_formats) / sizeof(micro_formats[0]); f++)
+    {
+        for (size_t s = 0; s < sizeof(micro_sizes) / sizeof(micro_sizes[0]); s++)
+        {
+            c.format = micro_formats[f].format;
+            c.width = micro_sizes[s].width;
+            c.height = micro_sizes[s].height;
+            c.pixels.clear();
+
+            for (size_t t = 0; t < options.threads.size(); t++)
+            {
+                char name[128], unfused[128];
+                snprintf(name, sizeof(name), "convertFrame/%s/%ux%u/t%u", micro_formats[f].name, c.width, c.height,
+                         options.threads[t]);
+                snprintf(unfused, sizeof(unfused), "resizeConvert/%s/%ux%u/t%u", micro_formats[f].name, c.width,
+                         c.height, options.threads[t]);
+                if (!micro_selected(options, name) && !micro_selected(options, unfused))
+                    continue;
+
+                if (c.pixels.empty())
+                    c.stride = micro_makeFrame(c.format, c.width, c.height, c.pixels);
+
+                movidius_setPreprocessThreads(dev, options.threads[t], NULL, 0);
+
+                // chroma subsampled formats need even sizes, a frame the converter rejects has nothing to time
+                if (movidius_convertFrame(c.pixels.data(), c.format, c.width, c.height, c.stride, NULL,
+                                          MOVIDIUS_RESIZE_AREA, dev) != 0)
+                {
+                    fprintf(stderr, "movidius: skipping %s\n", name);
+                    continue;
+                }
+
+                double pixels = (double)c.width * c.height;
+                if (micro_selected(options, name))
+                    micro_measure(options, name, pixels, c.pixels.size(), micro_convertFrame, &c, results);
+
+                // the same frame, size, filter and threads through a separate scaling pass
+                if (!micro_selected(options, unfused))
+                    continue;
+
+                micro_areaAxis(r.x, c.width, r.size);
+                micro_areaAxis(r.y, c.height, r.size);
+                r.row.resize(3 * c.width);
+                micro_measure(options, unfused, pixels, c.pixels.size(), micro_resizeConvert, &r, results);
+            }
+        }
+    }
+
+    // the original exact size entry point with every implementation it can pick
+    movidius_setPreprocessThreads(dev, 1, NULL, 0);
+    c.format = MOVIDIUS_PIXEL_RGB;
+    c.width = dev->graph->reqsize;
+    c.height = dev->graph->reqsize;
+    c.pixels.clear();
+
+    for (size_t m = 0; m < sizeof(micro_modes) / sizeof(micro_modes[0]); m++)
+    {
+        char name[128];
+        snprintf(name, sizeof(name), "convertImage/%s/%ux%u", micro_modes[m].name, c.width, c.height);
+        if (!micro_selected(options, name))
+            continue;
+
+        if (c.pixels.empty())
+            c.stride = micro_makeFrame(c.format, c.width, c.height, c.pixels);
+
+        dev->convertMode = micro_modes[m].mode;
+        micro_measure(options, name, (double)c.width * c.height, c.pixels.size(), micro_convertImage, &c, results);
+    }
+
+    dev->convertMode = MOVIDIUS_CONVERT_DEFAULT;
+}
+
+static int micro_saveBaseline(const char* path, const std::vector<micro_result>& results)
+{
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Cannot write file: %s\n", path);
+        return 1;
+    }
+
+    fprintf(fp, "# movidius_microbench baseline: case ns_per_item\n");
+    for (size_t i = 0; i < results.size(); i++)
+        fprintf(fp, "%s %.6f\n", results[i].name.c_str(), results[i].nsPerItem);
+
+    return fclose(fp) != 0;
+}
+
+/**
+ * Compares against a saved baseline, cases missing from either side are only reported
+ * Returns the number of regressed cases, or -1 if the baseline can't be read
+ */
+static int micro_compare(const micro_options& options, const std::vector<micro_result>& results)
+{
+    FILE* fp = fopen(options.baseline, "r");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Cannot read baseline: %s\n", options.baseline);
+        return -1;
+    }
+
+    std::map<std::string, double> baseline;
+    char line[512];
+    char name[256];
+    double ns;
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (line[0] != '#' && sscanf(line, "%255s %lf", name, &ns) == 2)
+            baseline[name] = ns;
+    }
+    fclose(fp);
+
+    int regressed = 0;
+    printf("\n%-40s %12s %12s %8s\n", "case", "baseline ns", "current ns", "change");
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const micro_result& r = results[i];
+        std::map<std::string, double>::const_iterator it = baseline.find(r.name);
+        if (it == baseline.end())
+        {
+            printf("%-40s %12s %12.3f %8s\n", r.name.c_str(), "-", r.nsPerItem, "new");
+            continue;
+        }
+
+        double change = r.nsPerItem / it->second - 1.0;
+        bool slower = change > options.tolerance;
+        if (slower)
+            regressed++;
+
+        printf("%-40s %12.3f %12.3f %+7.1f%%%s\n", r.name.c_str(), it->second, r.nsPerItem, 100.0 * change,
+               slower ? " REGRESSED" : "");
+    }
+
+    printf("%d of %u cases regressed by more than %.0f%%\n", regressed, (unsigned int)results.size(),
+           100.0 * options.tolerance);
+    return regressed;
+}
+
+int main(int argc, char** argv)
+{
+    micro_options options;
+    if (micro_parse(argc, argv, options) != 0)
+    {
+        micro_usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<micro_result> results;
+    micro_fp16(options, results);
+
+    // conversion needs a network for its input size and normalization, a simulated stick has one
+    movidius_simconfig config;
+    memset(&config, 0, sizeof(config));
+    config.devices = 1;
+    config.outputs = 1;
+    movidius_setBackend(movidius_simBackend(&config));
+
+    char dir[] = "/tmp/movidius_microbench.XXXXXX";
+    if (mkdtemp(dir) == NULL)
+    {
+        fprintf(stderr, "Cannot create a directory for the simulated network\n");
+        return 1;
+    }
+
+    movidius_device dev;
+    memset(&dev, 0, sizeof(dev));
+    int ret = movidius_simWriteNetwork(dir, 1, 227, 1) != 0 || movidius_openDevice(&dev) != 0;
+
+    if (ret == 0)
+    {
+        snprintf(dev.networkPath, sizeof(dev.networkPath), "%s", dir);
+        ret = movidius_uploadNetwork(&dev) != 0;
+    }
+
+    if (ret == 0)
+        micro_convert(options, &dev, results);
+
+    if (dev.dev_handle != NULL)
+        movidius_closeDevice(&dev, true);
+
+    movidius_simRemoveNetwork(dir);
+
+    if (ret != 0)
+        return 1;
+
+    if (options.saveBaseline != NULL && micro_saveBaseline(options.saveBaseline, results) != 0)
+        return 1;
+
+    if (options.baseline != NULL && micro_compare(options, results) != 0)
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,645 @@
+#include "movidius_network.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/sha.h>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include "movidius_preprocess.h"
+
+/**
+ * The files of a network folder, graph first
+ */
+static const char* network_files[] = { "graph", "categories.txt", "stat.txt", "inputsize.txt" };
+static const int network_numFiles = sizeof(network_files) / sizeof(network_files[0]);
+
+struct network_identity
+{
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+};
+
+struct network_entry
+{
+    // first, so a movidius_network* handed out can be cast back to its entry
+    movidius_network network;
+    network_identity files[network_numFiles];
+    int refs;
+    bool cached;
+
+    // guards graphHash, which is computed outside network_mutex
+    std::mutex hashMutex;
+};
+
+static std::mutex network_mutex;
+static std::vector<network_entry*> network_cache;
+static int network_options = 0;
+
+/**
+ * Records the identity of the files of a network, a bundle only fills the first entry
+ */
+static int network_stat(const char* dir, network_identity* files, bool* packed)
+{
+    char path[1024];
+    struct stat st;
+
+    memset(files, 0, sizeof(network_identity) * network_numFiles);
+
+    if (stat(dir, &st) != 0)
+    {
+        fprintf(stderr, "movidius: Network %s not found\n", dir);
+        return -1;
+    }
+
+    *packed = S_ISREG(st.st_mode);
+    int count = *packed ? 1 : network_numFiles;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (!*packed)
+        {
+            snprintf(path, sizeof(path), "%s/%s", dir, network_files[i]);
+            if (stat(path, &st) != 0)
+            {
+                fprintf(stderr, "movidius: Failed opening %s in dir: %s\n", network_files[i], dir);
+                return -1;
+            }
+        }
+
+        files[i].device = st.st_dev;
+        files[i].inode = st.st_ino;
+        files[i].size = st.st_size;
+        files[i].modified = st.st_mtim;
+    }
+
+    return 0;
+}
+
+static bool network_sameFiles(const network_identity* a, const network_identity* b)
+{
+    for (int i = 0; i < network_numFiles; i++)
+    {
+        if (a[i].device != b[i].device || a[i].inode != b[i].inode || a[i].size != b[i].size ||
+            a[i].modified.tv_sec != b[i].modified.tv_sec || a[i].modified.tv_nsec != b[i].modified.tv_nsec)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * SHA-256 of the graph contents followed by the contents of the text files
+ */
+static int network_hash(const char* dir, const movidius_graphfile* graph, unsigned char* hash)
+{
+    char path[1024];
+    char buf[4096];
+    SHA256_CTX sha256;
+
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, movidius_graphFileData(graph), movidius_graphFileLength(graph));
+
+    for (int i = 1; i < network_numFiles; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, network_files[i]);
+        FILE* fp = fopen(path, "rb");
+        if (!fp)
+        {
+            fprintf(stderr, "movidius: Failed opening file: %s\n", path);
+            return -1;
+        }
+
+        size_t got;
+        while ((got = fread(buf, 1, sizeof(buf), fp)) > 0)
+            SHA256_Update(&sha256, buf, got);
+
+        fclose(fp);
+    }
+
+    SHA256_Final(hash, &sha256);
+    return 0;
+}
+
+static int network_loadStats(const char* dir, movidius_network* network)
+{
+    char path[1024];
+    float* mean = network->mean;
+    float* std = network->standard_deviation;
+
+    snprintf(path, sizeof(path), "%s/stat.txt", dir);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "movidius: Failed opening stat.txt in dir: %s\n", dir);
+        return -1;
+    }
+
+    if (fscanf(fp, "%f %f %f\n%f %f %f\n", mean, mean+1, mean+2, std, std+1, std+2) != 6)
+    {
+        fprintf(stderr, "movidius: %s: mean and stddev not found in file\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+
+    for (int i = 0; i < 3; i++)
+    {
+        mean[i] = 255.0 * mean[i];
+        std[i] = 1.0 / (255.0 * std[i]);
+    }
+
+    snprintf(path, sizeof(path), "%s/inputsize.txt", dir);
+    fp = fopen(path, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "movidius: Failed opening inputsize.txt in dir %s\n", dir);
+        return -1;
+    }
+
+    if (fscanf(fp, "%u", &network->reqsize) != 1)
+    {
+        fprintf(stderr, "movidius: %s: inputsize not found in file\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+static int network_loadCategories(const char* dir, movidius_network* network)
+{
+    char path[1024];
+    char line[1024];
+    char* p;
+
+    snprintf(path, sizeof(path), "%s/categories.txt", dir);
+    FILE *fp = fopen(path, "r");
+
+    if (!fp)
+    {
+        fprintf(stderr, "movidius: Failed opening file: %s\n", path);
+        return -1;
+    }
+
+    network->numCategories = 0;
+    network->categories = (char**)malloc(1000 * sizeof(*network->categories));
+    std::stringstream ss;
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        ss << line;
+        p = strchr(line, '\n');
+        if (p)
+            *p = 0;
+
+        if (strcasecmp(line, "classes"))
+        {
+            network->categories[network->numCategories++] = strdup(line);
+            if (network->numCategories == 1000)
+                break;
+        }
+    }
+
+    fclose(fp);
+
+    if (network->numCategories == 0)
+    {
+        fprintf(stderr, "movidius: device numCategories is 0 after loading categories\n");
+        fprintf(stderr, "Full contents of categories file: %s\n", ss.str().c_str());
+        fprintf(stderr, "File was: %s", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void network_free(network_entry* entry)
+{
+    movidius_network* network = &entry->network;
+
+    if (!network->packed)
+    {
+        for (int i = 0; i < network->numCategories; i++)
+            free(network->categories[i]);
+    }
+    if (network->categories != NULL)
+        free(network->categories);
+
+    movidius_releaseGraphFile(network->graphFile);
+    delete entry;
+}
+
+/**
+ * SHA-256 of the header and the string table, the graph blob has a checksum of its own
+ */
+static void network_bundleChecksum(const unsigned char* data, unsigned char* hash)
+{
+    const movidius_bundleheader* header = (const movidius_bundleheader*)data;
+    SHA256_CTX sha256;
+
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, data, offsetof(movidius_bundleheader, checksum));
+    SHA256_Update(&sha256, data + header->headerSize, header->graphOffset - header->headerSize);
+    SHA256_Final(hash, &sha256);
+}
+
+/**
+ * Checks everything in the header of a mapped bundle that can be checked without reading the rest
+ */
+static bool network_validBundleHeader(const char* path, const unsigned char* data, unsigned int length)
+{
+    const movidius_bundleheader* header = (const movidius_bundleheader*)data;
+
+    if (length < sizeof(movidius_bundleheader) || memcmp(header->magic, MOVIDIUS_BUNDLE_MAGIC, 8) != 0)
+    {
+        fprintf(stderr, "movidius: %s is not a network bundle\n", path);
+        return false;
+    }
+
+    if (header->version != MOVIDIUS_BUNDLE_VERSION)
+    {
+        fprintf(stderr, "movidius: %s is a version %u bundle, only version %d is supported\n",
+                path, header->version, MOVIDIUS_BUNDLE_VERSION);
+        return false;
+    }
+
+    if (header->headerSize < sizeof(movidius_bundleheader) || header->headerSize > length ||
+        header->categoriesOffset < header->headerSize ||
+        header->categoriesSize > header->graphOffset - header->categoriesOffset ||
+        header->graphOffset < header->categoriesOffset || header->graphOffset > length ||
+        header->graphOffset % MOVIDIUS_BUNDLE_ALIGN != 0 ||
+        header->graphSize == 0 || header->graphSize > length - header->graphOffset ||
+        header->numCategories == 0 || header->numCategories > header->categoriesSize)
+    {
+        fprintf(stderr, "movidius: %s: bundle header is corrupt\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+static int network_loadBundle(const char* path, movidius_network* network, int options)
+{
+    network->packed = 1;
+    network->graphFile = movidius_openGraphFile(path);
+    if (network->graphFile == NULL)
+        return -1;
+
+    const unsigned char* data = (const unsigned char*)movidius_graphFileData(network->graphFile);
+    unsigned int length = movidius_graphFileLength(network->graphFile);
+    if (!network_validBundleHeader(path, data, length))
+        return -1;
+
+    const movidius_bundleheader* header = (const movidius_bundleheader*)data;
+    network_bundleChecksum(data, network->contentHash);
+    if (memcmp(network->contentHash, header->checksum, sizeof(header->checksum)) != 0)
+    {
+        fprintf(stderr, "movidius: %s: bundle checksum mismatch\n", path);
+        return -1;
+    }
+    network->hashed = 1;
+
+    // the string table holds numCategories NUL terminated strings and nothing after them
+    const char* table = (const char*)data + header->categoriesOffset;
+    const char* end = table + header->categoriesSize;
+    network->categories = (char**)malloc(header->numCategories * sizeof(*network->categories));
+
+    for (const char* p = table; network->numCategories < (int)header->numCategories; p++)
+    {
+        const char* nul = p < end ? (const char*)memchr(p, 0, end - p) : NULL;
+        if (nul == NULL)
+        {
+            fprintf(stderr, "movidius: %s: bundle category table is corrupt\n", path);
+            return -1;
+        }
+
+        network->categories[network->numCategories++] = (char*)p;
+        p = nul;
+    }
+
+    network->graphData = data + header->graphOffset;
+    network->graphLength = header->graphSize;
+
+    // the hash is kept, so the integrity check does not read the graph a second time
+    if (options & MOVIDIUS_NETWORK_VERIFY_BUNDLE)
+    {
+        SHA256_CTX sha256;
+        SHA256_Init(&sha256);
+        SHA256_Update(&sha256, network->graphData, network->graphLength);
+        SHA256_Final(network->graphHash, &sha256);
+
+        if (memcmp(network->graphHash, header->graphChecksum, sizeof(header->graphChecksum)) != 0)
+        {
+            fprintf(stderr, "movidius: %s: bundle graph checksum mismatch\n", path);
+            return -1;
+        }
+        network->graphHashed = 1;
+    }
+
+    network->reqsize = header->reqsize;
+    memcpy(network->mean, header->mean, sizeof(network->mean));
+    memcpy(network->standard_deviation, header->standardDeviation, sizeof(network->standard_deviation));
+    return 0;
+}
+
+/**
+ * The content hash a network at path would get, for bundles the one in the header
+ */
+static int network_currentHash(const char* path, bool packed, unsigned char* hash)
+{
+    char graph_path[1024];
+
+    if (!packed)
+        snprintf(graph_path, sizeof(graph_path), "%s/graph", path);
+
+    movidius_graphfile* file = movidius_openGraphFile(packed ? path : graph_path);
+    if (file == NULL)
+        return -1;
+
+    int rc = 0;
+    const unsigned char* data = (const unsigned char*)movidius_graphFileData(file);
+    if (!packed)
+        rc = network_hash(path, file, hash);
+    else if (network_validBundleHeader(path, data, movidius_graphFileLength(file)))
+        memcpy(hash, ((const movidius_bundleheader*)data)->checksum, 32);
+    else
+        rc = -1;
+
+    movidius_releaseGraphFile(file);
+    return rc;
+}
+
+static network_entry* network_load(const char* dir, const network_identity* files, bool packed, int options)
+{
+    char path[1024];
+
+    network_entry* entry = new network_entry;
+    memset(&entry->network, 0, sizeof(entry->network));
+    memcpy(entry->files, files, sizeof(entry->files));
+    entry->refs = 0;
+    entry->cached = false;
+
+    movidius_network* network = &entry->network;
+    strcpy(network->path, dir);
+
+    if (packed)
+    {
+        if (network_loadBundle(dir, network, options) != 0)
+        {
+            network_free(entry);
+            return NULL;
+        }
+
+        movidius_buildChannelLut(network->mean, network->standard_deviation, network->channelLut);
+        return entry;
+    }
+
+    snprintf(path, sizeof(path), "%s/graph", dir);
+    network->graphFile = movidius_openGraphFile(path);
+    if (network->graphFile == NULL)
+    {
+        fprintf(stderr, "movidius: %s/graph not found\n", dir);
+        network_free(entry);
+        return NULL;
+    }
+
+    network->graphData = movidius_graphFileData(network->graphFile);
+    network->graphLength = movidius_graphFileLength(network->graphFile);
+
+    if (network_loadCategories(dir, network) != 0)
+    {
+        fprintf(stderr, "movidius: Error loading categories\n");
+        network_free(entry);
+        return NULL;
+    }
+
+    if (network_loadStats(dir, network) != 0)
+    {
+        fprintf(stderr, "movidius: Failed loading stat.txt or inputsize.txt\n");
+        network_free(entry);
+        return NULL;
+    }
+
+    movidius_buildChannelLut(network->mean, network->standard_deviation, network->channelLut);
+
+    if (options & MOVIDIUS_NETWORK_HASH)
+    {
+        if (network_hash(dir, network->graphFile, network->contentHash) != 0)
+        {
+            network_free(entry);
+            return NULL;
+        }
+        network->hashed = 1;
+    }
+
+    return entry;
+}
+
+/**
+ * Takes a network out of the lookup, it is freed once nobody holds it anymore
+ */
+static void network_evict(size_t index)
+{
+    network_entry* entry = network_cache[index];
+    network_cache.erase(network_cache.begin() + index);
+
+    entry->cached = false;
+    if (entry->refs == 0)
+        network_free(entry);
+}
+
+void movidius_setNetworkCacheOptions(int options)
+{
+    std::lock_guard<std::mutex> lock(network_mutex);
+    network_options = options;
+}
+
+movidius_network* movidius_acquireNetwork(const char* dir)
+{
+    if (strlen(dir) > 1000)
+    {
+        fprintf(stderr, "Given dir path is too long: %s\n", dir);
+        return NULL;
+    }
+
+    network_identity files[network_numFiles];
+    bool packed;
+    if (network_stat(dir, files, &packed) != 0)
+        return NULL;
+
+    // held while parsing, so devices loading the same network at once parse it only once
+    std::lock_guard<std::mutex> lock(network_mutex);
+
+    for (size_t i = 0; i < network_cache.size(); i++)
+    {
+        network_entry* entry = network_cache[i];
+        if (strcmp(entry->network.path, dir) != 0)
+            continue;
+
+        if (network_sameFiles(entry->files, files))
+        {
+            entry->refs++;
+            return &entry->network;
+        }
+
+        if ((network_options & MOVIDIUS_NETWORK_HASH) && entry->network.hashed &&
+            entry->network.packed == (int)packed)
+        {
+            unsigned char hash[32];
+            if (network_currentHash(dir, packed, hash) == 0 &&
+                memcmp(hash, entry->network.contentHash, sizeof(hash)) == 0)
+            {
+                memcpy(entry->files, files, sizeof(entry->files));
+                entry->refs++;
+                return &entry->network;
+            }
+        }
+
+        network_evict(i);
+        break;
+    }
+
+    network_entry* entry = network_load(dir, files, packed, network_options);
+    if (entry == NULL)
+        return NULL;
+
+    entry->refs = 1;
+    entry->cached = true;
+    network_cache.push_back(entry);
+    return &entry->network;
+}
+
+void movidius_releaseNetwork(movidius_network* network)
+{
+    if (network == NULL)
+        return;
+
+    std::lock_guard<std::mutex> lock(network_mutex);
+
+    network_entry* entry = (network_entry*)network;
+    if (--entry->refs == 0 && !entry->cached)
+        network_free(entry);
+}
+
+void movidius_flushNetworkCache()
+{
+    std::lock_guard<std::mutex> lock(network_mutex);
+
+    for (size_t i = network_cache.size(); i > 0; i--)
+    {
+        if (network_cache[i - 1]->refs == 0)
+            network_evict(i - 1);
+    }
+}
+
+void movidius_networkGraphHash(movidius_network* network, unsigned char* hash)
+{
+    network_entry* entry = (network_entry*)network;
+    std::lock_guard<std::mutex> lock(entry->hashMutex);
+
+    if (!network->graphHashed)
+    {
+        SHA256_CTX sha256;
+        SHA256_Init(&sha256);
+        SHA256_Update(&sha256, network->graphData, network->graphLength);
+        SHA256_Final(network->graphHash, &sha256);
+        network->graphHashed = 1;
+    }
+
+    memcpy(hash, network->graphHash, sizeof(network->graphHash));
+}
+
+int movidius_packNetwork(const char* dir, const char* bundle_path)
+{
+    char tmp_path[1100];
+    network_identity files[network_numFiles];
+    bool packed;
+
+    if (strlen(dir) > 1000 || strlen(bundle_path) > 1000)
+    {
+        fprintf(stderr, "movidius: path too long\n");
+        return INVALID_INPUT_DATA;
+    }
+
+    if (network_stat(dir, files, &packed) != 0)
+        return DATA_LOAD_FAILED;
+
+    if (packed)
+    {
+        fprintf(stderr, "movidius: %s is already a bundle\n", dir);
+        return INVALID_INPUT_DATA;
+    }
+
+    network_entry* entry = network_load(dir, files, false, 0);
+    if (entry == NULL)
+        return DATA_LOAD_FAILED;
+
+    const movidius_network* network = &entry->network;
+    movidius_bundleheader header;
+    memset(&header, 0, sizeof(header));
+
+    // header, then the string table, then the graph at the next aligned offset
+    std::vector<unsigned char> body;
+    for (int i = 0; i < network->numCategories; i++)
+        body.insert(body.end(), network->categories[i], network->categories[i] + strlen(network->categories[i]) + 1);
+
+    header.categoriesOffset = sizeof(header);
+    header.categoriesSize = (uint32_t)body.size();
+
+    size_t graph_offset = sizeof(header) + body.size();
+    graph_offset = (graph_offset + MOVIDIUS_BUNDLE_ALIGN - 1) / MOVIDIUS_BUNDLE_ALIGN * MOVIDIUS_BUNDLE_ALIGN;
+    body.resize(graph_offset - sizeof(header), 0);
+
+    const unsigned char* graph = (const unsigned char*)network->graphData;
+    body.insert(body.end(), graph, graph + network->graphLength);
+
+    SHA256_CTX sha256;
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, graph, network->graphLength);
+    SHA256_Final(header.graphChecksum, &sha256);
+
+    memcpy(header.magic, MOVIDIUS_BUNDLE_MAGIC, sizeof(header.magic));
+    header.version = MOVIDIUS_BUNDLE_VERSION;
+    header.headerSize = sizeof(header);
+    header.reqsize = network->reqsize;
+    header.numCategories = network->numCategories;
+    memcpy(header.mean, network->mean, sizeof(header.mean));
+    memcpy(header.standardDeviation, network->standard_deviation, sizeof(header.standardDeviation));
+    header.graphOffset = (uint32_t)graph_offset;
+    header.graphSize = network->graphLength;
+
+    network_free(entry);
+
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, &header, offsetof(movidius_bundleheader, checksum));
+    SHA256_Update(&sha256, body.data(), graph_offset - sizeof(header));
+    SHA256_Final(header.checksum, &sha256);
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", bundle_path);
+    FILE* fp = fopen(tmp_path, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "movidius: Cannot write file: %s\n", tmp_path);
+        return DATA_LOAD_FAILED;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                   fwrite(body.data(), 1, body.size(), fp) == body.size();
+    if (fclose(fp) != 0 || !written || rename(tmp_path, bundle_path) != 0)
+    {
+        fprintf(stderr, "movidius: Failed writing bundle %s\n", bundle_path);
+        unlink(tmp_path);
+        return DATA_LOAD_FAILED;
+    }
+
+    return 0;
+}
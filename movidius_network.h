@@ -0,0 +1,212 @@
+#ifndef MOVIDIUS_NETWORK_H
+#define MOVIDIUS_NETWORK_H
+
+#include "movidiusdevice.h"
+#include "movidius_graphfile.h"
+
+/**
+ * Everything parsed from a network folder: the graph file, categories.txt, stat.txt and
+ * inputsize.txt, plus the normalization table built from them
+ * A network can also come from a single bundle file written by movidius_packNetwork()
+ * Kept in a process wide cache, so uploading the same network again or to another device
+ * does not touch the parsers. Treat the contents as read only, they are shared
+ */
+typedef struct
+{
+    /**
+     * The network folder or bundle file this was loaded from
+     */
+    char path[1024];
+
+    /**
+     * The mapped graph file, or the whole mapped bundle
+     */
+    movidius_graphfile* graphFile;
+
+    /**
+     * The graph blob to hand to mvncAllocateGraph(), inside the mapping above
+     */
+    const void* graphData;
+
+    /**
+     * Size of graphData in bytes
+     */
+    unsigned int graphLength;
+
+    /**
+     * Non-zero when loaded from a bundle, the category strings then point into the mapping
+     */
+    int packed;
+
+    /**
+     * Lines of categories.txt, without the "classes" header
+     */
+    char** categories;
+
+    /**
+     * Number of categories above
+     */
+    int numCategories;
+
+    /**
+     * Mean from stat.txt, scaled to 0..255 pixel values
+     */
+    float mean[3];
+
+    /**
+     * 1 / (255 * standard deviation) from stat.txt, so normalizing is a multiplication
+     */
+    float standard_deviation[3];
+
+    /**
+     * The resolution from inputsize.txt
+     */
+    unsigned int reqsize;
+
+    /**
+     * Normalization table from movidius_buildChannelLut()
+     */
+    uint16_t channelLut[MOVIDIUS_LUT_ENTRIES];
+
+    /**
+     * SHA-256 over the contents of all the files above, only computed with MOVIDIUS_NETWORK_HASH
+     * For a bundle this is the checksum stored in its header
+     */
+    unsigned char contentHash[32];
+
+    /**
+     * Non-zero when contentHash has been computed
+     */
+    int hashed;
+
+    /**
+     * SHA-256 of the graph blob alone, see movidius_networkGraphHash()
+     */
+    unsigned char graphHash[32];
+
+    /**
+     * Non-zero once graphHash has been computed
+     */
+    int graphHashed;
+} movidius_network;
+
+#define MOVIDIUS_BUNDLE_MAGIC "MVNCBNDL"
+#define MOVIDIUS_BUNDLE_VERSION 2
+
+/**
+ * Offset of the graph blob inside a bundle is a multiple of this
+ */
+#define MOVIDIUS_BUNDLE_ALIGN 64
+
+/**
+ * Start of a network bundle, in host byte order
+ * It is followed by the category string table, numCategories NUL terminated strings, and
+ * after padding up to MOVIDIUS_BUNDLE_ALIGN by the graph blob
+ */
+typedef struct
+{
+    /**
+     * MOVIDIUS_BUNDLE_MAGIC, without terminating NUL
+     */
+    char magic[8];
+
+    /**
+     * MOVIDIUS_BUNDLE_VERSION, bundles of any other version are refused
+     */
+    uint32_t version;
+
+    /**
+     * sizeof(movidius_bundleheader) of the writer, the string table starts here
+     */
+    uint32_t headerSize;
+
+    /**
+     * Input resolution of the network, as in inputsize.txt
+     */
+    uint32_t reqsize;
+
+    uint32_t numCategories;
+
+    /**
+     * Normalization values already scaled the way movidius_network holds them,
+     * so loading does no arithmetic and gives bit identical images to the folder
+     */
+    float mean[3];
+    float standardDeviation[3];
+
+    uint32_t categoriesOffset;
+    uint32_t categoriesSize;
+    uint32_t graphOffset;
+    uint32_t graphSize;
+
+    /**
+     * SHA-256 of the graph blob, only compared on load with MOVIDIUS_NETWORK_VERIFY_BUNDLE
+     */
+    unsigned char graphChecksum[32];
+
+    /**
+     * SHA-256 over the header up to this field followed by the string table, up to graphOffset
+     * The graph blob is left to graphChecksum and the checks of movidius_integrity.h
+     */
+    unsigned char checksum[32];
+} movidius_bundleheader;
+
+/**
+ * Options for movidius_setNetworkCacheOptions()
+ */
+enum
+{
+    /**
+     * Also key the cache by the SHA-256 of the files. A folder whose files were rewritten or
+     * touched without changing their contents is then still served from memory, at the cost of
+     * hashing the files whenever their inode, size or mtime changed
+     */
+    MOVIDIUS_NETWORK_HASH = 1,
+
+    /**
+     * Also hash the graph blob of a bundle when loading it and refuse the bundle unless it
+     * matches graphChecksum. Without it loading reads the header and string table only
+     */
+    MOVIDIUS_NETWORK_VERIFY_BUNDLE = 2
+};
+
+/**
+ * Sets the MOVIDIUS_NETWORK_* options for networks acquired from now on, defaults to 0
+ */
+extern void movidius_setNetworkCacheOptions(int options);
+
+/**
+ * Returns the parsed network in folder dir, or in the bundle file dir points to
+ * A cached copy is used as long as none of the files have been replaced or modified since
+ * they were parsed, which is checked with a stat() of each file
+ * A bundle is only accepted if the checksum of its header and string table matches
+ * Release it with movidius_releaseNetwork(). Returns NULL if the folder could not be loaded
+ */
+extern movidius_network* movidius_acquireNetwork(const char* dir);
+
+/**
+ * Gives up a network returned by movidius_acquireNetwork()
+ * Networks stay cached after the last release, until movidius_flushNetworkCache()
+ */
+extern void movidius_releaseNetwork(movidius_network* network);
+
+/**
+ * Fills hash with the SHA-256 of the graph blob of an acquired network
+ * Computed once and kept with the network, so it is only recomputed when the files change
+ * Safe to call from several threads
+ */
+extern void movidius_networkGraphHash(movidius_network* network, unsigned char* hash);
+
+/**
+ * Writes the network in folder dir into a single bundle file at bundle_path
+ * The bundle is written next to bundle_path first and renamed over it when complete
+ * Returns 0 on success
+ */
+extern int movidius_packNetwork(const char* dir, const char* bundle_path);
+
+/**
+ * Frees every cached network that is not currently acquired
+ */
+extern void movidius_flushNetworkCache();
+
+#endif // MOVIDIUS_NETWORK_H
@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include "movidius_network.h"
+
+/**
+ * Converts network folders into single file bundles that load without parsing text files
+ * Usage: movidius_pack <network folder> <bundle file>
+ */
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <network folder> <bundle file>\n", argv[0]);
+        return 1;
+    }
+
+    int rc = movidius_packNetwork(argv[1], argv[2]);
+    if (rc != 0)
+    {
+        fprintf(stderr, "Packing %s failed: %d\n", argv[1], rc);
+        return 1;
+    }
+
+    // the graph blob is only hashed on load when asked to, the fresh bundle is checked in full
+    movidius_setNetworkCacheOptions(MOVIDIUS_NETWORK_VERIFY_BUNDLE);
+    movidius_network* network = movidius_acquireNetwork(argv[2]);
+    if (network == NULL)
+    {
+        fprintf(stderr, "Written bundle %s does not load back\n", argv[2]);
+        return 1;
+    }
+
+    printf("%s: %d categories, input %ux%u, graph %u bytes\n", argv[2], network->numCategories,
+           network->reqsize, network->reqsize, network->graphLength);
+    movidius_releaseNetwork(network);
+    movidius_flushNetworkCache();
+    return 0;
+}
@@ -0,0 +1,469 @@
+#include "movidius_preprocess.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MOVIDIUS_PIXELFORMAT_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/**
+ * Row converters from the MOVIDIUS_PIXEL_* formats to RGB888
+ * YUV formats use BT.601 limited range coefficients in 8 bit fixed point, which is what
+ * V4L2 cameras deliver by default. Vector kernels use the exact same integer math, so
+ * their output is identical to the scalar code
+ */
+
+static inline unsigned char yuv_clamp(int value)
+{
+    return (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static inline void yuv_toRgb(int y, int u, int v, unsigned char* rgb)
+{
+    int c = 298 * (y - 16) + 128;
+    int d = u - 128;
+    int e = v - 128;
+
+    rgb[0] = yuv_clamp((c + 409 * e) >> 8);
+    rgb[1] = yuv_clamp((c - 100 * d - 208 * e) >> 8);
+    rgb[2] = yuv_clamp((c + 516 * d) >> 8);
+}
+
+static void row_swapRgb(const unsigned char* src, unsigned char* dst, unsigned int n)
+{
+    for (unsigned int i = 0; i < n; i++)
+    {
+        dst[3 * i + 0] = src[3 * i + 2];
+        dst[3 * i + 1] = src[3 * i + 1];
+        dst[3 * i + 2] = src[3 * i + 0];
+    }
+}
+
+static void row_dropAlpha(const unsigned char* src, unsigned char* dst, unsigned int n, bool swap)
+{
+    int r = swap ? 2 : 0;
+    int b = swap ? 0 : 2;
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        dst[3 * i + 0] = src[4 * i + r];
+        dst[3 * i + 1] = src[4 * i + 1];
+        dst[3 * i + 2] = src[4 * i + b];
+    }
+}
+
+/**
+ * Pixel x of an NV12 row uses the chroma pair at byte (x / 2) * 2 of its chroma row
+ */
+static void row_nv12(const unsigned char* luma, const unsigned char* chroma, unsigned int x,
+                     unsigned int n, unsigned char* dst)
+{
+    for (unsigned int i = 0; i < n; i++)
+    {
+        unsigned int px = x + i;
+        const unsigned char* uv = chroma + (px & ~1u);
+        yuv_toRgb(luma[px], uv[0], uv[1], dst + 3 * i);
+    }
+}
+
+/**
+ * YUYV stores two pixels in four bytes: Y0 U Y1 V
+ */
+static void row_yuyv(const unsigned char* row, unsigned int x, unsigned int n, unsigned char* dst)
+{
+    for (unsigned int i = 0; i < n; i++)
+    {
+        unsigned int px = x + i;
+        const unsigned char* pair = row + 2 * (px & ~1u);
+        yuv_toRgb(row[2 * px], pair[1], pair[3], dst + 3 * i);
+    }
+}
+
+#ifdef MOVIDIUS_PIXELFORMAT_X86
+
+/**
+ * pshufb masks, -1 clears the byte. Interleaving takes one mask per output vector and plane,
+ * the BGR swap one per output vector and input vector
+ */
+static const signed char interleave_masks[3][3][16] = {
+    { { 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5 },
+      { -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1 },
+      { -1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1 } },
+    { { -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1 },
+      { 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10 },
+      { -1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1 } },
+    { { -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1 },
+      { -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1 },
+      { 10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15 } }
+};
+
+static const signed char swap_masks[3][3][16] = {
+    { { 2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, -1 },
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1 },
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 } },
+    { { -1, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { 0, -1, 4, 3, 2, 7, 6, 5, 10, 9, 8, 13, 12, 11, -1, 15 },
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, -1 } },
+    { { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { -1, 3, 2, 1, 6, 5, 4, 9, 8, 7, 12, 11, 10, 15, 14, 13 } }
+};
+
+__attribute__((target("ssse3")))
+static inline __m128i mask_load(const signed char* mask)
+{
+    return _mm_loadu_si128((const __m128i*)mask);
+}
+
+__attribute__((target("ssse3")))
+static inline void store_interleaved(unsigned char* dst, __m128i r, __m128i g, __m128i b)
+{
+    for (int k = 0; k < 3; k++)
+    {
+        __m128i out = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(r, mask_load(interleave_masks[k][0])),
+            _mm_shuffle_epi8(g, mask_load(interleave_masks[k][1]))),
+            _mm_shuffle_epi8(b, mask_load(interleave_masks[k][2])));
+        _mm_storeu_si128((__m128i*)(dst + 16 * k), out);
+    }
+}
+
+__attribute__((target("ssse3")))
+static unsigned int row_swapRgb_ssse3(const unsigned char* src, unsigned char* dst, unsigned int n)
+{
+    unsigned int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i in[3];
+        for (int j = 0; j < 3; j++)
+            in[j] = _mm_loadu_si128((const __m128i*)(src + 3 * i + 16 * j));
+
+        for (int k = 0; k < 3; k++)
+        {
+            __m128i out = _mm_setzero_si128();
+            for (int j = 0; j < 3; j++)
+                out = _mm_or_si128(out, _mm_shuffle_epi8(in[j], mask_load(swap_masks[k][j])));
+            _mm_storeu_si128((__m128i*)(dst + 3 * i + 16 * k), out);
+        }
+    }
+
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static unsigned int row_dropAlpha_ssse3(const unsigned char* src, unsigned char* dst, unsigned int n, bool swap)
+{
+    const __m128i mask = swap ?
+        _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1) :
+        _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    unsigned int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        // four vectors of 4 pixels shrink to 12 bytes each, shift them together into three stores
+        __m128i p[4];
+        for (int j = 0; j < 4; j++)
+            p[j] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 4 * i + 16 * j)), mask);
+
+        _mm_storeu_si128((__m128i*)(dst + 3 * i), _mm_or_si128(p[0], _mm_slli_si128(p[1], 12)));
+        _mm_storeu_si128((__m128i*)(dst + 3 * i + 16), _mm_or_si128(_mm_srli_si128(p[1], 4), _mm_slli_si128(p[2], 8)));
+        _mm_storeu_si128((__m128i*)(dst + 3 * i + 32), _mm_or_si128(_mm_srli_si128(p[2], 8), _mm_slli_si128(p[3], 4)));
+    }
+
+    return i;
+}
+
+/**
+ * yuv_toRgb() for 8 pixels of 16 bit y, u and v. pmaddwd computes two of the
+ * products per 32 bit lane, saturating packs do the clamping
+ */
+__attribute__((target("ssse3")))
+static inline void yuv_toRgb8(__m128i y, __m128i u, __m128i v, __m128i* r, __m128i* g, __m128i* b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i coef_r = _mm_setr_epi16(298, 409, 298, 409, 298, 409, 298, 409);
+    const __m128i coef_gu = _mm_setr_epi16(298, -100, 298, -100, 298, -100, 298, -100);
+    const __m128i coef_gv = _mm_setr_epi16(-208, 0, -208, 0, -208, 0, -208, 0);
+    const __m128i coef_b = _mm_setr_epi16(298, 516, 298, 516, 298, 516, 298, 516);
+
+    y = _mm_sub_epi16(y, _mm_set1_epi16(16));
+    u = _mm_sub_epi16(u, _mm_set1_epi16(128));
+    v = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+    __m128i out[3][2];
+    for (int half = 0; half < 2; half++)
+    {
+        __m128i yv = half ? _mm_unpackhi_epi16(y, v) : _mm_unpacklo_epi16(y, v);
+        __m128i yu = half ? _mm_unpackhi_epi16(y, u) : _mm_unpacklo_epi16(y, u);
+        __m128i v0 = half ? _mm_unpackhi_epi16(v, zero) : _mm_unpacklo_epi16(v, zero);
+
+        __m128i red = _mm_add_epi32(_mm_madd_epi16(yv, coef_r), round);
+        __m128i green = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(yu, coef_gu), _mm_madd_epi16(v0, coef_gv)), round);
+        __m128i blue = _mm_add_epi32(_mm_madd_epi16(yu, coef_b), round);
+
+        out[0][half] = _mm_srai_epi32(red, 8);
+        out[1][half] = _mm_srai_epi32(green, 8);
+        out[2][half] = _mm_srai_epi32(blue, 8);
+    }
+
+    *r = _mm_packs_epi32(out[0][0], out[0][1]);
+    *g = _mm_packs_epi32(out[1][0], out[1][1]);
+    *b = _mm_packs_epi32(out[2][0], out[2][1]);
+}
+
+/**
+ * x must be even so every vector starts at a chroma pair
+ */
+__attribute__((target("ssse3")))
+static unsigned int row_nv12_ssse3(const unsigned char* luma, const unsigned char* chroma, unsigned int x,
+                                   unsigned int n, unsigned char* dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lowbytes = _mm_set1_epi16(0x00ff);
+    unsigned int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i y = _mm_loadu_si128((const __m128i*)(luma + x + i));
+        __m128i uv = _mm_loadu_si128((const __m128i*)(chroma + x + i));
+        __m128i u = _mm_and_si128(uv, lowbytes);
+        __m128i v = _mm_srli_epi16(uv, 8);
+
+        __m128i r[2], g[2], b[2];
+        yuv_toRgb8(_mm_unpacklo_epi8(y, zero), _mm_unpacklo_epi16(u, u), _mm_unpacklo_epi16(v, v), &r[0], &g[0], &b[0]);
+        yuv_toRgb8(_mm_unpackhi_epi8(y, zero), _mm_unpackhi_epi16(u, u), _mm_unpackhi_epi16(v, v), &r[1], &g[1], &b[1]);
+
+        store_interleaved(dst + 3 * i, _mm_packus_epi16(r[0], r[1]), _mm_packus_epi16(g[0], g[1]),
+                          _mm_packus_epi16(b[0], b[1]));
+    }
+
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static unsigned int row_yuyv_ssse3(const unsigned char* row, unsigned int x, unsigned int n, unsigned char* dst)
+{
+    const __m128i lowbytes = _mm_set1_epi16(0x00ff);
+    unsigned int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i r[2], g[2], b[2];
+
+        for (int half = 0; half < 2; half++)
+        {
+            __m128i pixels = _mm_loadu_si128((const __m128i*)(row + 2 * (x + i) + 16 * half));
+            __m128i y = _mm_and_si128(pixels, lowbytes);
+            __m128i chroma = _mm_srli_epi16(pixels, 8);
+            __m128i u = _mm_shufflehi_epi16(_mm_shufflelo_epi16(chroma, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+            __m128i v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(chroma, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+            yuv_toRgb8(y, u, v, &r[half], &g[half], &b[half]);
+        }
+
+        store_interleaved(dst + 3 * i, _mm_packus_epi16(r[0], r[1]), _mm_packus_epi16(g[0], g[1]),
+                          _mm_packus_epi16(b[0], b[1]));
+    }
+
+    return i;
+}
+
+static bool pixelformat_haveSsse3()
+{
+    static bool have = (__builtin_cpu_init(), __builtin_cpu_supports("ssse3") != 0);
+    return have;
+}
+
+#endif // MOVIDIUS_PIXELFORMAT_X86
+
+#if defined(__aarch64__)
+
+static unsigned int row_swapRgb_neon(const unsigned char* src, unsigned char* dst, unsigned int n)
+{
+    unsigned int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16x3_t px = vld3q_u8(src + 3 * i);
+        uint8x16_t red = px.val[2];
+        px.val[2] = px.val[0];
+        px.val[0] = red;
+        vst3q_u8(dst + 3 * i, px);
+    }
+
+    return i;
+}
+
+static unsigned int row_dropAlpha_neon(const unsigned char* src, unsigned char* dst, unsigned int n, bool swap)
+{
+    unsigned int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16x4_t px = vld4q_u8(src + 4 * i);
+        uint8x16x3_t out;
+        out.val[0] = px.val[swap ? 2 : 0];
+        out.val[1] = px.val[1];
+        out.val[2] = px.val[swap ? 0 : 2];
+        vst3q_u8(dst + 3 * i, out);
+    }
+
+    return i;
+}
+
+static inline uint8x8_t yuv_narrow(int32x4_t lo, int32x4_t hi)
+{
+    return vqmovun_s16(vcombine_s16(vqmovn_s32(vshrq_n_s32(lo, 8)), vqmovn_s32(vshrq_n_s32(hi, 8))));
+}
+
+/**
+ * yuv_toRgb() for 8 pixels, stored interleaved to dst
+ */
+static inline void yuv_toRgb8_neon(uint8x8_t y8, uint8x8_t u8, uint8x8_t v8, unsigned char* dst)
+{
+    int16x8_t y = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(y8)), vdupq_n_s16(16));
+    int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), vdupq_n_s16(128));
+    int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), vdupq_n_s16(128));
+    const int32x4_t round = vdupq_n_s32(128);
+
+    int32x4_t c[2] = {
+        vmlal_n_s16(round, vget_low_s16(y), 298),
+        vmlal_n_s16(round, vget_high_s16(y), 298)
+    };
+    int16x4_t us[2] = { vget_low_s16(u), vget_high_s16(u) };
+    int16x4_t vs[2] = { vget_low_s16(v), vget_high_s16(v) };
+
+    int32x4_t red[2], green[2], blue[2];
+    for (int half = 0; half < 2; half++)
+    {
+        red[half] = vmlal_n_s16(c[half], vs[half], 409);
+        green[half] = vmlal_n_s16(vmlal_n_s16(c[half], us[half], -100), vs[half], -208);
+        blue[half] = vmlal_n_s16(c[half], us[half], 516);
+    }
+
+    uint8x8x3_t out;
+    out.val[0] = yuv_narrow(red[0], red[1]);
+    out.val[1] = yuv_narrow(green[0], green[1]);
+    out.val[2] = yuv_narrow(blue[0], blue[1]);
+    vst3_u8(dst, out);
+}
+
+static unsigned int row_nv12_neon(const unsigned char* luma, const unsigned char* chroma, unsigned int x,
+                                  unsigned int n, unsigned char* dst)
+{
+    unsigned int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t y = vld1q_u8(luma + x + i);
+        uint8x8x2_t uv = vld2_u8(chroma + x + i);
+        uint8x8x2_t u = vzip_u8(uv.val[0], uv.val[0]);
+        uint8x8x2_t v = vzip_u8(uv.val[1], uv.val[1]);
+
+        yuv_toRgb8_neon(vget_low_u8(y), u.val[0], v.val[0], dst + 3 * i);
+        yuv_toRgb8_neon(vget_high_u8(y), u.val[1], v.val[1], dst + 3 * i + 24);
+    }
+
+    return i;
+}
+
+static unsigned int row_yuyv_neon(const unsigned char* row, unsigned int x, unsigned int n, unsigned char* dst)
+{
+    unsigned int i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x8x4_t px = vld4_u8(row + 2 * (x + i));
+        uint8x8x2_t y = vzip_u8(px.val[0], px.val[2]);
+        uint8x8x2_t u = vzip_u8(px.val[1], px.val[1]);
+        uint8x8x2_t v = vzip_u8(px.val[3], px.val[3]);
+
+        yuv_toRgb8_neon(y.val[0], u.val[0], v.val[0], dst + 3 * i);
+        yuv_toRgb8_neon(y.val[1], u.val[1], v.val[1], dst + 3 * i + 24);
+    }
+
+    return i;
+}
+
+#endif // __aarch64__
+
+const unsigned char* movidius_frameRowRGB(const movidius_frame* frame, unsigned int y, unsigned int x,
+                                          unsigned int n, unsigned char* scratch)
+{
+    const unsigned char* row = frame->data + (size_t)y * frame->stride;
+    unsigned int done = 0;
+
+    switch (frame->format)
+    {
+    case MOVIDIUS_PIXEL_RGB:
+        return row + 3 * x;
+
+    case MOVIDIUS_PIXEL_BGR:
+        row += 3 * x;
+#if defined(MOVIDIUS_PIXELFORMAT_X86)
+        if (pixelformat_haveSsse3())
+            done = row_swapRgb_ssse3(row, scratch, n);
+#elif defined(__aarch64__)
+        done = row_swapRgb_neon(row, scratch, n);
+#endif
+        row_swapRgb(row + 3 * done, scratch + 3 * done, n - done);
+        return scratch;
+
+    case MOVIDIUS_PIXEL_RGBA:
+    case MOVIDIUS_PIXEL_BGRA:
+    {
+        bool swap = frame->format == MOVIDIUS_PIXEL_BGRA;
+        row += 4 * x;
+#if defined(MOVIDIUS_PIXELFORMAT_X86)
+        if (pixelformat_haveSsse3())
+            done = row_dropAlpha_ssse3(row, scratch, n, swap);
+#elif defined(__aarch64__)
+        done = row_dropAlpha_neon(row, scratch, n, swap);
+#endif
+        row_dropAlpha(row + 4 * done, scratch + 3 * done, n - done, swap);
+        return scratch;
+    }
+
+    case MOVIDIUS_PIXEL_NV12:
+    {
+        // the interleaved chroma plane follows the luma plane, one chroma row for every two luma rows
+        const unsigned char* chroma = frame->data + (size_t)(frame->height + y / 2) * frame->stride;
+
+        if (x & 1)
+        {
+            row_nv12(row, chroma, x, 1, scratch);
+            done = 1;
+        }
+#if defined(MOVIDIUS_PIXELFORMAT_X86)
+        if (pixelformat_haveSsse3())
+            done += row_nv12_ssse3(row, chroma, x + done, n - done, scratch + 3 * done);
+#elif defined(__aarch64__)
+        done += row_nv12_neon(row, chroma, x + done, n - done, scratch + 3 * done);
+#endif
+        row_nv12(row, chroma, x + done, n - done, scratch + 3 * done);
+        return scratch;
+    }
+
+    case MOVIDIUS_PIXEL_YUYV:
+        if (x & 1)
+        {
+            row_yuyv(row, x, 1, scratch);
+            done = 1;
+        }
+#if defined(MOVIDIUS_PIXELFORMAT_X86)
+        if (pixelformat_haveSsse3())
+            done += row_yuyv_ssse3(row, x + done, n - done, scratch + 3 * done);
+#elif defined(__aarch64__)
+        done += row_yuyv_neon(row, x + done, n - done, scratch + 3 * done);
+#endif
+        row_yuyv(row, x + done, n - done, scratch + 3 * done);
+        return scratch;
+
+    default:
+        return NULL;
+    }
+}
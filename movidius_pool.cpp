@@ -0,0 +1,487 @@
+#include "movidius_pool.h"
+#include "movidius_backend.h"
+#include "movidius_telemetry.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+int movidius_openPool(movidius_pool* pool, unsigned int max_devices)
+{
+    // list the names before opening anything, opened sticks boot their firmware and show up again
+    std::vector<std::string> names;
+    char name[MVNC_MAX_NAME_SIZE];
+
+    while (max_devices == 0 || names.size() < max_devices)
+    {
+        if (movidius_getBackend()->getDeviceName((int)names.size(), name, sizeof(name)) != MVNC_OK)
+            break;
+        names.push_back(name);
+    }
+
+    if (names.empty())
+    {
+        fprintf(stderr, "movidius: No devices found\n");
+        return MOVIDIUS_NODEVICE_FOUND;
+    }
+
+    pool->devices = (movidius_device*)calloc(names.size(), sizeof(movidius_device));
+    pool->order = (unsigned int*)calloc(names.size() * MOVIDIUS_MAX_INFLIGHT, sizeof(unsigned int));
+    pool->retry = (unsigned int*)calloc(names.size() * (MOVIDIUS_MAX_INFLIGHT + 1), sizeof(unsigned int));
+    pool->numDevices = 0;
+    pool->numOrder = 0;
+    pool->numRetry = 0;
+    pool->nextDevice = 0;
+
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        if (movidius_openDeviceName(&pool->devices[pool->numDevices], names[i].c_str()) == 0)
+            pool->numDevices++;
+    }
+
+    if (pool->numDevices == 0)
+    {
+        movidius_closePool(pool);
+        return MOVIDIUS_NODEVICE_FOUND;
+    }
+
+    fprintf(stderr, "movidius: opened %d of %d devices\n", pool->numDevices, (int)names.size());
+    return 0;
+}
+
+int movidius_closePool(movidius_pool* pool)
+{
+    int ret = 0;
+
+    for (unsigned int i = 0; i < pool->numDevices; i++)
+    {
+        if (movidius_closeDevice(&pool->devices[i], true) != 0)
+            ret = MOVIDIUS_CLOSEDEVICE_FAILED;
+    }
+
+    free(pool->devices);
+    free(pool->order);
+    free(pool->retry);
+    memset(pool, 0, sizeof(*pool));
+    return ret;
+}
+
+int movidius_poolUploadNetwork(movidius_pool* pool, const char* network_path)
+{
+    unsigned int loaded = 0;
+    int ret = MOVIDIUS_NODEVICE_FOUND;
+
+    for (unsigned int i = 0; i < pool->numDevices; i++)
+    {
+        movidius_device* dev = &pool->devices[i];
+        if (dev->gone)
+            continue;
+
+        strncpy(dev->networkPath, network_path, sizeof(dev->networkPath) - 1);
+        dev->networkPath[sizeof(dev->networkPath) - 1] = '\0';
+
+        int rc = movidius_uploadNetwork(dev);
+        if (rc == 0)
+            loaded++;
+        else if (!dev->gone)
+            return rc;
+        else
+            ret = rc;
+    }
+
+    return loaded > 0 ? 0 : ret;
+}
+
+static void pool_removeOrder(movidius_pool* pool, unsigned int position)
+{
+    memmove(pool->order + position, pool->order + position + 1,
+            (pool->numOrder - position - 1) * sizeof(*pool->order));
+    pool->numOrder--;
+}
+
+/**
+ * Gives up on everything in flight on the device at index and deallocates its current network,
+ * so results that still arrive go away with it. The stick gets no more work until a network is uploaded again
+ */
+static int pool_abandon(movidius_pool* pool, unsigned int index)
+{
+    movidius_device* dev = &pool->devices[index];
+
+    for (unsigned int position = pool->numOrder; position > 0; position--)
+    {
+        if (pool->order[position - 1] == index)
+            pool_removeOrder(pool, position - 1);
+    }
+
+    if (dev->graph == NULL)
+        return 0;
+
+    movidius_abandonInferences(dev);
+    return movidius_deallocateGraph(dev);
+}
+
+int movidius_poolDeallocateGraph(movidius_pool* pool)
+{
+    int ret = 0;
+
+    // collect what is in flight, so no result arrives after its graph is gone
+    while (pool->numOrder > 0)
+    {
+        unsigned int inflight = pool->numOrder;
+        unsigned int index = pool->order[0];
+        movidius_poolWait(pool, NULL, 0, NULL, NULL);
+
+        // the stick failed without giving up the request, waiting again would not get any further
+        if (pool->numOrder == inflight)
+            pool_abandon(pool, index);
+    }
+
+    for (unsigned int i = 0; i < pool->numDevices; i++)
+    {
+        movidius_device* dev = &pool->devices[i];
+        if (dev->graph == NULL)
+            continue;
+
+        // a stick that is gone can't deallocate anything, its host side state is freed all the same
+        int rc = movidius_deallocateGraph(dev);
+        if (rc != 0 && !dev->gone)
+            ret = rc;
+    }
+
+    return ret;
+}
+
+/**
+ * How many inferences a stick at the given throttling level may have in flight
+ */
+static unsigned int pool_depth(int level, bool all_critical)
+{
+    if (level <= 0)
+        return MOVIDIUS_MAX_INFLIGHT;
+    if (level == 1 || all_critical)
+        return 1;
+    return 0;
+}
+
+/**
+ * Throttling level the pool schedules a stick by, 0 when unknown or ignored
+ */
+static int pool_level(const movidius_pool* pool, movidius_device* dev)
+{
+    if (pool->ignoreThermal)
+        return 0;
+
+    int level = movidius_throttlingLevel(dev);
+    return level < 0 ? 0 : level;
+}
+
+int movidius_poolAcquire(movidius_pool* pool, movidius_device** dev)
+{
+    int best = -1;
+    int best_level = 0;
+    unsigned int healthy = 0;
+    unsigned int critical = 0;
+
+    for (unsigned int i = 0; i < pool->numDevices; i++)
+    {
+        movidius_device* d = &pool->devices[i];
+        if (d->gone || d->graph == NULL)
+            continue;
+
+        // an idle stick gets no results to sample telemetry from, so ask it directly
+        if (!pool->ignoreThermal && d->graph->numInflight == 0)
+        {
+            movidius_refreshThrottlingLevel(d);
+            if (d->gone)
+                continue;
+        }
+
+        healthy++;
+        if (pool_level(pool, d) >= 2)
+            critical++;
+    }
+
+    if (healthy == 0)
+        return MOVIDIUS_NODEVICE_FOUND;
+
+    for (unsigned int k = 0; k < pool->numDevices; k++)
+    {
+        unsigned int i = (pool->nextDevice + k) % pool->numDevices;
+        movidius_device* d = &pool->devices[i];
+
+        if (d->gone || d->graph == NULL)
+            continue;
+
+        int level = pool_level(pool, d);
+        unsigned int inflight = d->graph->numInflight;
+        if (inflight >= pool_depth(level, critical == healthy))
+        {
+            if (inflight < MOVIDIUS_MAX_INFLIGHT)
+                pool->thermalDeferrals++;
+            continue;
+        }
+
+        unsigned int best_inflight = best < 0 ? 0 : pool->devices[best].graph->numInflight;
+        if (best < 0 || inflight < best_inflight || (inflight == best_inflight && level < best_level))
+        {
+            best = i;
+            best_level = level;
+        }
+    }
+
+    if (best < 0)
+        return MOVIDIUS_QUEUE_FULL;
+
+    pool->nextDevice = (best + 1) % pool->numDevices;
+    *dev = &pool->devices[best];
+    return 0;
+}
+
+int movidius_poolSubmit(movidius_pool* pool, movidius_device* dev, void* tag)
+{
+    int rc = movidius_submitInference(dev, tag);
+    if (rc != 0)
+        return rc;
+
+    pool->order[pool->numOrder++] = (unsigned int)(dev - pool->devices);
+    return 0;
+}
+
+/**
+ * Collects from the device at the given position of the order list
+ * The entry is removed when its request is finished with, successfully or not
+ */
+static int pool_collect(movidius_pool* pool, unsigned int position, float* results, unsigned int num_results,
+                        void** tag, movidius_device** dev, int dont_block)
+{
+    movidius_device* d = &pool->devices[pool->order[position]];
+
+    unsigned int inflight = d->graph != NULL ? d->graph->numInflight : 0;
+
+    int rc = dont_block ? movidius_pollInference(d, results, num_results, tag)
+                        : movidius_waitInference(d, results, num_results, tag);
+    if (rc == MOVIDIUS_RESULT_PENDING)
+        return rc;
+
+    if (d->graph == NULL || d->graph->numInflight < inflight)
+        pool_removeOrder(pool, position);
+
+    if (dev != NULL)
+        *dev = d;
+    return rc;
+}
+
+int movidius_poolWait(movidius_pool* pool, float* results, unsigned int num_results, void** tag,
+                      movidius_device** dev)
+{
+    if (pool->numOrder == 0)
+    {
+        fprintf(stderr, "movidius: no submitted inferences to collect\n");
+        return NOT_ALLOWED_THIS_TIME;
+    }
+
+    return pool_collect(pool, 0, results, num_results, tag, dev, 0);
+}
+
+int movidius_poolPoll(movidius_pool* pool, float* results, unsigned int num_results, void** tag,
+                      movidius_device** dev)
+{
+    if (pool->numOrder == 0)
+    {
+        fprintf(stderr, "movidius: no submitted inferences to collect\n");
+        return NOT_ALLOWED_THIS_TIME;
+    }
+
+    for (unsigned int position = 0; position < pool->numOrder; position++)
+    {
+        // only the oldest request of each device can be finished, skip the device's later ones
+        bool seen = false;
+        for (unsigned int earlier = 0; earlier < position && !seen; earlier++)
+            seen = pool->order[earlier] == pool->order[position];
+        if (seen)
+            continue;
+
+        int rc = pool_collect(pool, position, results, num_results, tag, dev, 1);
+        if (rc != MOVIDIUS_RESULT_PENDING)
+            return rc;
+    }
+
+    return MOVIDIUS_RESULT_PENDING;
+}
+
+/**
+ * Tag of the request a graph finishes next, mvnc returns results in the order tensors were loaded
+ */
+static void* pool_oldestTag(const movidius_graph* graph)
+{
+    const movidius_request* oldest = NULL;
+    for (int i = 0; i < MOVIDIUS_MAX_INFLIGHT; i++)
+    {
+        const movidius_request* request = &graph->requests[i];
+        if (request->busy && (oldest == NULL || (int)(request->sequence - oldest->sequence) < 0))
+            oldest = request;
+    }
+
+    return oldest != NULL ? oldest->tag : NULL;
+}
+
+/**
+ * Gives error to every item in flight on the stick at index, then drops the stick with pool_abandon()
+ */
+static void pool_failItems(movidius_pool* pool, unsigned int index, int error, int* status)
+{
+    movidius_graph* graph = pool->devices[index].graph;
+    for (int i = 0; graph != NULL && status != NULL && i < MOVIDIUS_MAX_INFLIGHT; i++)
+    {
+        if (graph->requests[i].busy)
+            status[(uintptr_t)graph->requests[i].tag] = error;
+    }
+
+    pool_abandon(pool, index);
+}
+
+/**
+ * Ends a batch after the stick at index failed without giving up its item
+ * Its items in flight, the ones waiting to be retried and the ones not started yet get error,
+ * what the other sticks have in flight is still collected
+ */
+static void pool_failBatch(movidius_pool* pool, unsigned int index, int error, unsigned int next, unsigned int count,
+                          float* results, unsigned int results_stride, int* status)
+{
+    for (unsigned int i = 0; i < pool->numRetry && status != NULL; i++)
+        status[pool->retry[i]] = error;
+    pool->numRetry = 0;
+    for (unsigned int i = next; i < count && status != NULL; i++)
+        status[i] = error;
+
+    pool_failItems(pool, index, error, status);
+
+    while (pool->numOrder > 0)
+    {
+        unsigned int device = pool->order[0];
+        unsigned int oldest = (unsigned int)(uintptr_t)pool_oldestTag(pool->devices[device].graph);
+
+        void* tag = NULL;
+        unsigned int inflight = pool->numOrder;
+        int rc = movidius_poolWait(pool, results + (size_t)oldest * results_stride, results_stride, &tag, NULL);
+
+        if (rc != 0 && pool->numOrder == inflight)
+            pool_failItems(pool, device, rc, status);
+        else if (status != NULL)
+            status[(uintptr_t)tag] = rc;
+    }
+}
+
+int movidius_poolRunBatch(movidius_pool* pool, const movidius_batchitem* items, unsigned int count,
+                          int filter, float* results, unsigned int results_stride, int* status)
+{
+    if (pool->numOrder > 0)
+    {
+        fprintf(stderr, "movidius: cannot run a batch with %d inferences in flight\n", pool->numOrder);
+        return NOT_ALLOWED_THIS_TIME;
+    }
+
+    for (unsigned int i = 0; i < pool->numDevices; i++)
+    {
+        movidius_device* d = &pool->devices[i];
+        if (!d->gone && d->graph != NULL && (unsigned int)d->graph->numCategories > results_stride)
+        {
+            fprintf(stderr, "movidius: %d results per item do not fit a stride of %u\n",
+                    d->graph->numCategories, results_stride);
+            return INVALID_INPUT_DATA;
+        }
+    }
+
+    int ret = 0;
+    unsigned int next = 0;
+
+    // items lost with an unplugged stick run again before the ones not started yet
+    pool->numRetry = 0;
+
+    while (next < count || pool->numRetry > 0 || pool->numOrder > 0)
+    {
+        movidius_device* dev = NULL;
+        int rc = next < count || pool->numRetry > 0 ? movidius_poolAcquire(pool, &dev) : MOVIDIUS_QUEUE_FULL;
+
+        if (rc == 0)
+        {
+            unsigned int item;
+            if (pool->numRetry > 0)
+                item = pool->retry[--pool->numRetry];
+            else
+                item = next++;
+
+            const movidius_batchitem& in = items[item];
+            rc = movidius_convertFrame(in.pixels, in.format, in.width, in.height, in.stride, in.roi, filter,
+                                       dev);
+            if (rc == 0)
+                rc = movidius_poolSubmit(pool, dev, (void*)(uintptr_t)item);
+
+            if (rc == MOVIDIUS_DEVICE_GONE)
+                pool->retry[pool->numRetry++] = item;
+            else if (rc != 0)
+            {
+                if (status != NULL)
+                    status[item] = rc;
+                if (ret == 0)
+                    ret = rc;
+            }
+            continue;
+        }
+
+        // sticks that went away still hold their submitted items, collecting hands them back for retrying
+        if (rc != MOVIDIUS_QUEUE_FULL && pool->numOrder == 0)
+        {
+            // no stick left, everything not done yet fails with the same error
+            for (unsigned int i = next; i < count && status != NULL; i++)
+                status[i] = rc;
+            for (unsigned int i = 0; i < pool->numRetry && status != NULL; i++)
+                status[pool->retry[i]] = rc;
+            pool->numRetry = 0;
+            return ret != 0 ? ret : rc;
+        }
+
+        // every stick is busy, collect the oldest item straight into its place
+        movidius_graph* graph = pool->devices[pool->order[0]].graph;
+        unsigned int oldest = (unsigned int)(uintptr_t)pool_oldestTag(graph);
+
+        void* tag = NULL;
+        unsigned int inflight = pool->numOrder;
+        rc = movidius_poolWait(pool, results + (size_t)oldest * results_stride, results_stride, &tag, NULL);
+
+        // the stick failed without giving up the item, waiting again would not get any further
+        if (rc != 0 && pool->numOrder == inflight)
+        {
+            pool_failBatch(pool, pool->order[0], rc, next, count, results, results_stride, status);
+            return ret != 0 ? ret : rc;
+        }
+
+        unsigned int done = (unsigned int)(uintptr_t)tag;
+        if (rc == MOVIDIUS_DEVICE_GONE)
+            pool->retry[pool->numRetry++] = done;
+        else
+        {
+            if (status != NULL)
+                status[done] = rc;
+            if (rc != 0 && ret == 0)
+                ret = rc;
+        }
+    }
+
+    return ret;
+}
+
+unsigned int movidius_poolHealthyDevices(const movidius_pool* pool)
+{
+    unsigned int healthy = 0;
+
+    for (unsigned int i = 0; i < pool->numDevices; i++)
+    {
+        if (!pool->devices[i].gone)
+            healthy++;
+    }
+
+    return healthy;
+}
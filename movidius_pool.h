@@ -0,0 +1,165 @@
+#ifndef MOVIDIUS_POOL_H
+#define MOVIDIUS_POOL_H
+
+#include "movidiusdevice.h"
+
+/**
+ * All the sticks plugged in to the computer, used together
+ * Each inference goes to the healthy stick with the fewest inferences in flight, and sticks
+ * that report MVNC_GONE are drained and left out from then on
+ * Sticks that report thermal throttling get less work: a throttling stick only one inference
+ * at a time, and a critically hot one none at all while a cooler stick is available. They get
+ * their full share again once telemetry shows them cooled down, see movidius_telemetry.h
+ *
+ * Memset this struct to 0 before calling movidius_openPool(). Typical use:
+ *
+ *   movidius_poolAcquire() to pick a stick, movidius_convertFrame() into it,
+ *   movidius_poolSubmit(), and movidius_poolWait() whenever acquiring returns MOVIDIUS_QUEUE_FULL
+ *
+ * or movidius_poolRunBatch() to do all of that for an array of images
+ */
+typedef struct
+{
+    /**
+     * The opened sticks, numDevices of them
+     */
+    movidius_device* devices;
+    unsigned int numDevices;
+
+    /**
+     * Index into devices for every submitted inference not collected yet, oldest first
+     * Room for MOVIDIUS_MAX_INFLIGHT per device
+     */
+    unsigned int* order;
+    unsigned int numOrder;
+
+    /**
+     * Items of movidius_poolRunBatch() lost with an unplugged stick, waiting to run again
+     * Every stick loses at most its inferences in flight and the item it was being given,
+     * room for MOVIDIUS_MAX_INFLIGHT + 1 per device
+     */
+    unsigned int* retry;
+    unsigned int numRetry;
+
+    /**
+     * Where movidius_poolAcquire() starts looking, so equally busy sticks take turns
+     */
+    unsigned int nextDevice;
+
+    /**
+     * Non-zero schedules without looking at the throttling levels of the sticks
+     */
+    int ignoreThermal;
+
+    /**
+     * Times movidius_poolAcquire() passed over a stick with room because it was throttling
+     */
+    unsigned long thermalDeferrals;
+} movidius_pool;
+
+/**
+ * One input of movidius_poolRunBatch(), the arguments of movidius_convertFrame()
+ * Several items can share pixels, for example every face crop of one camera frame
+ */
+typedef struct
+{
+    const unsigned char* pixels;
+
+    /**
+     * One of the MOVIDIUS_PIXEL_* values
+     */
+    int format;
+    unsigned int width;
+    unsigned int height;
+    unsigned int stride;
+
+    /**
+     * The part of the frame to infer on, or NULL for the whole frame
+     */
+    const movidius_rect* roi;
+} movidius_batchitem;
+
+/**
+ * Lists every stick mvnc knows about and opens them
+ * @param max_devices: Stop after opening this many, 0 opens all of them
+ * Sticks that fail to open are skipped
+ * Returns 0 if at least one stick was opened, MOVIDIUS_NODEVICE_FOUND otherwise
+ */
+extern int movidius_openPool(movidius_pool* pool, unsigned int max_devices);
+
+/**
+ * Deallocates the graphs and closes every stick of the pool
+ */
+extern int movidius_closePool(movidius_pool* pool);
+
+/**
+ * Uploads the network at network_path to every healthy stick and makes it their current one
+ * Sticks that already have it resident just switch to it, see movidius_uploadNetwork()
+ * Sticks that turn out to be gone are skipped
+ * Returns 0 if at least one stick has the network, an error of movidius_uploadNetwork() otherwise
+ */
+extern int movidius_poolUploadNetwork(movidius_pool* pool, const char* network_path);
+
+/**
+ * Deallocates the current network from every stick that has one
+ * Inferences still in flight are collected first and their results thrown away
+ * Other resident networks stay, movidius_closePool() deallocates all of them
+ */
+extern int movidius_poolDeallocateGraph(movidius_pool* pool);
+
+/**
+ * Picks the healthy stick with the fewest inferences in flight and room for one more,
+ * preferring cooler sticks when equally busy
+ * Convert the next image into that device, then pass it to movidius_poolSubmit()
+ * Returns 0 on success, MOVIDIUS_QUEUE_FULL if every stick is busy and an inference has to
+ * be collected first, MOVIDIUS_NODEVICE_FOUND if no healthy stick is left
+ */
+extern int movidius_poolAcquire(movidius_pool* pool, movidius_device** dev);
+
+/**
+ * Starts the inference on a device from movidius_poolAcquire(), see movidius_submitInference()
+ */
+extern int movidius_poolSubmit(movidius_pool* pool, movidius_device* dev, void* tag);
+
+/**
+ * Collects the oldest inference of the pool, blocking until it is done
+ * @param results, num_results: Filled like in movidius_runInference()
+ * @param dev: If not NULL, set to the device that ran it, for its categories
+ * Returns like movidius_waitInference(). On errors the tag is set to the inference that was
+ * lost, so that image can be submitted again
+ */
+extern int movidius_poolWait(movidius_pool* pool, float* results, unsigned int num_results, void** tag,
+                             movidius_device** dev);
+
+/**
+ * Collects whichever inference of the pool has finished first without blocking
+ * Returns MOVIDIUS_RESULT_PENDING if none has, otherwise like movidius_poolWait()
+ */
+extern int movidius_poolPoll(movidius_pool* pool, float* results, unsigned int num_results, void** tag,
+                             movidius_device** dev);
+
+/**
+ * Runs the current network on every item, spread over all healthy sticks
+ * Each item is converted while the sticks work on the ones submitted before it, and results
+ * are written straight into the caller's array. Items lost to a stick that is unplugged
+ * are run again on another one
+ * Nothing may be in flight on the pool when calling this
+ * @param filter: One of the MOVIDIUS_RESIZE_* values
+ * @param results: Room for count * results_stride floats, item i gets the results from
+ * results + i * results_stride on. Items that fail are left untouched
+ * @param results_stride: At least the numCategories of the network
+ * @param status: If not NULL, gets 0 or the error of every item
+ * Returns 0 if every item got its results, otherwise the first error
+ * A stick that fails without giving up an item ends the batch, the items not done yet get that error
+ * The stick's network is deallocated so the pool runs the next batch without it, uploading the
+ * network again brings the stick back
+ */
+extern int movidius_poolRunBatch(movidius_pool* pool, const movidius_batchitem* items, unsigned int count,
+                                 int filter, float* results, unsigned int results_stride, int* status);
+
+/**
+ * Number of sticks that have not reported MVNC_GONE
+ */
+extern unsigned int movidius_poolHealthyDevices(const movidius_pool* pool);
+
+#endif // MOVIDIUS_POOL_H
@@ -0,0 +1,271 @@
+#include "movidius_postprocess.h"
+#include "movidius_fp16.h"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/**
+ * Outputs converted to floats at a time while summing up the softmax denominator
+ */
+static const unsigned int softmax_chunk = 64;
+
+/**
+ * Maps a half float to a signed 16 bit key that orders like the values do
+ * The magnitude bits of negative values are flipped, so larger magnitudes sort lower
+ */
+static inline int16_t post_key(uint16_t h)
+{
+    return (int16_t)(h ^ ((uint16_t)((int16_t)h >> 15) & 0x7fffu));
+}
+
+static inline float post_float(uint16_t h)
+{
+    union { unsigned u; float f; } value;
+    value.u = half2float(h);
+    return value.f;
+}
+
+#if defined(__SSE2__)
+static inline __m128i post_keys(const uint16_t* values)
+{
+    __m128i h = _mm_loadu_si128((const __m128i*)values);
+    return _mm_xor_si128(h, _mm_and_si128(_mm_srai_epi16(h, 15), _mm_set1_epi16(0x7fff)));
+}
+#elif defined(__aarch64__)
+static inline int16x8_t post_keys(const uint16_t* values)
+{
+    int16x8_t h = vreinterpretq_s16_u16(vld1q_u16(values));
+    return veorq_s16(h, vandq_s16(vshrq_n_s16(h, 15), vdupq_n_s16(0x7fff)));
+}
+#endif
+
+/**
+ * Largest key of count half floats, count must not be 0
+ */
+static int16_t post_maxKey(const uint16_t* values, unsigned int count)
+{
+    int16_t best = post_key(values[0]);
+    unsigned int i = 1;
+
+#if defined(__SSE2__)
+    if (count >= 8)
+    {
+        __m128i m = post_keys(values);
+        for (i = 8; i + 8 <= count; i += 8)
+            m = _mm_max_epi16(m, post_keys(values + i));
+
+        m = _mm_max_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+        m = _mm_max_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+        m = _mm_max_epi16(m, _mm_shufflelo_epi16(m, _MM_SHUFFLE(2, 3, 0, 1)));
+        best = (int16_t)_mm_extract_epi16(m, 0);
+    }
+#elif defined(__aarch64__)
+    if (count >= 8)
+    {
+        int16x8_t m = post_keys(values);
+        for (i = 8; i + 8 <= count; i += 8)
+            m = vmaxq_s16(m, post_keys(values + i));
+        best = vmaxvq_s16(m);
+    }
+#endif
+
+    for (; i < count; i++)
+        best = std::max(best, post_key(values[i]));
+    return best;
+}
+
+unsigned int movidius_argmaxFp16(const uint16_t* values, unsigned int count)
+{
+    if (count == 0)
+        return 0;
+
+    int16_t best = post_maxKey(values, count);
+    unsigned int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i target = _mm_set1_epi16(best);
+    for (; i + 8 <= count; i += 8)
+    {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(post_keys(values + i), target));
+        if (mask != 0)
+            return i + __builtin_ctz(mask) / 2;
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        if (post_key(values[i]) == best)
+            return i;
+    }
+
+    return 0;
+}
+
+/**
+ * Inserts index into the filled entries of predictions, which are ordered largest first
+ * It goes after the entries with an equal value. When k entries are filled already, the
+ * smallest one falls off
+ */
+static void post_insert(const uint16_t* values, movidius_prediction* predictions, unsigned int& filled,
+                        unsigned int k, unsigned int index)
+{
+    int16_t key = post_key(values[index]);
+
+    unsigned int position = filled < k ? filled++ : k - 1;
+    while (position > 0 && post_key(values[predictions[position - 1].index]) < key)
+    {
+        predictions[position] = predictions[position - 1];
+        position--;
+    }
+
+    predictions[position].index = index;
+}
+
+/**
+ * Sum of exp(value - max) over all values, converting a chunk of them to floats at a time
+ */
+static float post_expSum(const uint16_t* values, unsigned int count, float max)
+{
+    float chunk[softmax_chunk];
+    float sum = 0;
+
+    for (unsigned int i = 0; i < count; i += softmax_chunk)
+    {
+        unsigned int n = std::min(softmax_chunk, count - i);
+        fp16tofloat(chunk, (unsigned char*)(values + i), n);
+
+        for (unsigned int j = 0; j < n; j++)
+            sum += expf(chunk[j] - max);
+    }
+
+    return sum;
+}
+
+unsigned int movidius_topKFp16(const uint16_t* values, unsigned int count, unsigned int k, int flags,
+                               movidius_prediction* predictions)
+{
+    k = std::min(k, count);
+    if (k == 0)
+        return 0;
+
+    unsigned int filled = 0;
+    unsigned int i = 0;
+    for (; i < k; i++)
+        post_insert(values, predictions, filled, k, i);
+
+    // only values above the smallest kept one change anything, whole vectors of them are skipped
+    int16_t threshold = post_key(values[predictions[k - 1].index]);
+
+#if defined(__SSE2__)
+    for (; i + 8 <= count; i += 8)
+    {
+        // one bit per 16 bit lane
+        __m128i above = _mm_cmpgt_epi16(post_keys(values + i), _mm_set1_epi16(threshold));
+        int mask = _mm_movemask_epi8(above) & 0x5555;
+        for (; mask != 0; mask &= mask - 1)
+        {
+            unsigned int index = i + __builtin_ctz(mask) / 2;
+
+            // an earlier lane may have raised the threshold already
+            if (post_key(values[index]) > threshold)
+            {
+                post_insert(values, predictions, filled, k, index);
+                threshold = post_key(values[predictions[k - 1].index]);
+            }
+        }
+    }
+#elif defined(__aarch64__)
+    for (; i + 8 <= count; i += 8)
+    {
+        uint16x8_t above = vcgtq_s16(post_keys(values + i), vdupq_n_s16(threshold));
+        if (vmaxvq_u16(above) == 0)
+            continue;
+
+        for (unsigned int index = i; index < i + 8; index++)
+        {
+            if (post_key(values[index]) > threshold)
+            {
+                post_insert(values, predictions, filled, k, index);
+                threshold = post_key(values[predictions[k - 1].index]);
+            }
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        if (post_key(values[i]) > threshold)
+        {
+            post_insert(values, predictions, filled, k, i);
+            threshold = post_key(values[predictions[k - 1].index]);
+        }
+    }
+
+    float max = post_float(values[predictions[0].index]);
+    float sum = (flags & MOVIDIUS_TOPK_SOFTMAX) ? post_expSum(values, count, max) : 0;
+
+    for (unsigned int j = 0; j < k; j++)
+    {
+        float score = post_float(values[predictions[j].index]);
+        predictions[j].score = (flags & MOVIDIUS_TOPK_SOFTMAX) ? expf(score - max) / sum : score;
+        predictions[j].category = NULL;
+    }
+
+    return k;
+}
+
+/**
+ * The last collected output of the current graph, NULL after printing why there is none
+ */
+static const movidius_graph* post_lastResult(movidius_device* dev)
+{
+    const movidius_graph* graph = dev->graph;
+    if (graph == NULL || graph->lastResult == NULL || graph->lastResultCount == 0)
+    {
+        fprintf(stderr, "movidius: no collected result to pick categories from\n");
+        return NULL;
+    }
+
+    return graph;
+}
+
+static const char* post_category(const movidius_graph* graph, unsigned int index)
+{
+    return index < (unsigned int)graph->numCategories ? graph->categories[index] : NULL;
+}
+
+int movidius_topK(movidius_device* dev, unsigned int k, int flags, movidius_prediction* predictions,
+                  unsigned int* found)
+{
+    const movidius_graph* graph = post_lastResult(dev);
+    if (graph == NULL)
+        return NOT_ALLOWED_THIS_TIME;
+
+    unsigned int n = movidius_topKFp16(graph->lastResult, graph->lastResultCount, k, flags, predictions);
+    for (unsigned int i = 0; i < n; i++)
+        predictions[i].category = post_category(graph, predictions[i].index);
+
+    if (found != NULL)
+        *found = n;
+    return 0;
+}
+
+int movidius_argmax(movidius_device* dev, movidius_prediction* prediction)
+{
+    const movidius_graph* graph = post_lastResult(dev);
+    if (graph == NULL)
+        return NOT_ALLOWED_THIS_TIME;
+
+    prediction->index = movidius_argmaxFp16(graph->lastResult, graph->lastResultCount);
+    prediction->score = post_float(graph->lastResult[prediction->index]);
+    prediction->category = post_category(graph, prediction->index);
+    return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef MOVIDIUS_POSTPROCESS_H
+#define MOVIDIUS_POSTPROCESS_H
+
+#include "movidiusdevice.h"
+
+/**
+ * Picks the best categories straight from the half float output of a network
+ * Half floats are ranked by their bits, so only the values that make it into the result are
+ * converted to floats. Networks with 1000 categories need no float array at all
+ */
+
+/**
+ * One category picked by movidius_topK()
+ */
+typedef struct
+{
+    /**
+     * Index into the network outputs and its categories
+     */
+    unsigned int index;
+
+    /**
+     * The network output, or its softmax probability with MOVIDIUS_TOPK_SOFTMAX
+     */
+    float score;
+
+    /**
+     * Name from categories.txt, NULL if the network has more outputs than categories
+     */
+    const char* category;
+} movidius_prediction;
+
+/**
+ * Flags for movidius_topK()
+ */
+enum
+{
+    /**
+     * Scores are the softmax probabilities over all outputs, for networks that end without a softmax layer
+     */
+    MOVIDIUS_TOPK_SOFTMAX = 1
+};
+
+/**
+ * Index of the largest of count half floats, the first one if several are equally large
+ * NaN outputs rank beyond the infinity of their sign. Returns 0 if count is 0
+ */
+extern unsigned int movidius_argmaxFp16(const uint16_t* values, unsigned int count);
+
+/**
+ * Writes the k largest of count half floats to predictions, largest first
+ * Equal values keep their order. category is left NULL
+ * @param flags: MOVIDIUS_TOPK_* values
+ * Returns the number of predictions written, the smaller of k and count
+ */
+extern unsigned int movidius_topKFp16(const uint16_t* values, unsigned int count, unsigned int k, int flags,
+                                      movidius_prediction* predictions);
+
+/**
+ * movidius_topKFp16() on the last inference collected from the current graph of dev,
+ * with the category names filled in
+ * Call this before collecting the next result from the graph, which replaces the output
+ * @param found: Set to the number of predictions written
+ * Returns 0 on success, NOT_ALLOWED_THIS_TIME if no result has been collected
+ */
+extern int movidius_topK(movidius_device* dev, unsigned int k, int flags, movidius_prediction* predictions,
+                         unsigned int* found);
+
+/**
+ * movidius_topK() for only the best category
+ */
+extern int movidius_argmax(movidius_device* dev, movidius_prediction* prediction);
+
+#endif // MOVIDIUS_POSTPROCESS_H
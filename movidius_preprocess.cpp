@@ -0,0 +1,634 @@
+#include "movidius_preprocess.h"
+#include "movidius_fp16.h"
+#include <math.h>
+#include <atomic>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// lives with the converters rather than the device, so movidius_pack links without mvnc
+static std::atomic<unsigned long> movidius_allocations(0);
+
+unsigned long movidius_allocationCount()
+{
+    return movidius_allocations.load();
+}
+
+void movidius_countAllocation()
+{
+    movidius_allocations++;
+}
+
+/**
+ * Amount of pixels normalized into floats before converting them to half floats
+ * 3 * 256 floats is 3 kB, which stays in L1 together with the source and destination
+ */
+static const unsigned int normalize_tile_pixels = 256;
+
+/**
+ * Vector kernels handle 16 interleaved pixels per iteration, which is 48 channel values or
+ * twelve 4 wide float vectors. Element e of the tile belongs to channel e % 3, so vector k
+ * starts at channel k % 3 and the per channel constants repeat every three vectors
+ */
+static void normalize_pattern(const float* values, float* pattern)
+{
+    for (int k = 0; k < 3; k++)
+    {
+        for (int lane = 0; lane < 4; lane++)
+            pattern[4 * k + lane] = values[(k + lane) % 3];
+    }
+}
+
+static unsigned int normalize_tile_vector(const unsigned char* src, float* dst, unsigned int nvalues,
+                                          const float* mean, const float* std)
+{
+    unsigned int i = 0;
+
+#if defined(__SSE2__) || defined(__aarch64__)
+    float mean_pattern[12];
+    float std_pattern[12];
+    normalize_pattern(mean, mean_pattern);
+    normalize_pattern(std, std_pattern);
+#endif
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128 m[3], s[3];
+    for (int k = 0; k < 3; k++)
+    {
+        m[k] = _mm_loadu_ps(mean_pattern + 4 * k);
+        s[k] = _mm_loadu_ps(std_pattern + 4 * k);
+    }
+
+    for (; i + 48 <= nvalues; i += 48)
+    {
+        for (int chunk = 0; chunk < 3; chunk++)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)(src + i + 16 * chunk));
+            __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+            __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+            __m128i words[4] = {
+                _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)
+            };
+
+            for (int w = 0; w < 4; w++)
+            {
+                int k = (4 * chunk + w) % 3;
+                __m128 f = _mm_cvtepi32_ps(words[w]);
+                f = _mm_mul_ps(_mm_sub_ps(f, m[k]), s[k]);
+                _mm_storeu_ps(dst + i + 16 * chunk + 4 * w, f);
+            }
+        }
+    }
+#elif defined(__aarch64__)
+    float32x4_t m[3], s[3];
+    for (int k = 0; k < 3; k++)
+    {
+        m[k] = vld1q_f32(mean_pattern + 4 * k);
+        s[k] = vld1q_f32(std_pattern + 4 * k);
+    }
+
+    for (; i + 48 <= nvalues; i += 48)
+    {
+        for (int chunk = 0; chunk < 3; chunk++)
+        {
+            uint8x16_t bytes = vld1q_u8(src + i + 16 * chunk);
+            uint16x8_t lo = vmovl_u8(vget_low_u8(bytes));
+            uint16x8_t hi = vmovl_u8(vget_high_u8(bytes));
+            uint32x4_t words[4] = {
+                vmovl_u16(vget_low_u16(lo)), vmovl_u16(vget_high_u16(lo)),
+                vmovl_u16(vget_low_u16(hi)), vmovl_u16(vget_high_u16(hi))
+            };
+
+            for (int w = 0; w < 4; w++)
+            {
+                int k = (4 * chunk + w) % 3;
+                float32x4_t f = vcvtq_f32_u32(words[w]);
+                // separate subtract and multiply, a fused multiply-add would round differently
+                f = vmulq_f32(vsubq_f32(f, m[k]), s[k]);
+                vst1q_f32(dst + i + 16 * chunk + 4 * w, f);
+            }
+        }
+    }
+#else
+    (void)src; (void)dst; (void)nvalues; (void)mean; (void)std;
+#endif
+
+    return i;
+}
+
+void movidius_normalizeRGB(const movidius_RGB* src, movidius_RGB_f16* dst, unsigned int npixels,
+                           const float* mean, const float* std)
+{
+    float tile[3 * normalize_tile_pixels];
+    const unsigned char* in = (const unsigned char*)src;
+    unsigned char* out = (unsigned char*)dst;
+
+    for (unsigned int first = 0; first < npixels; first += normalize_tile_pixels)
+    {
+        unsigned int count = std::min(normalize_tile_pixels, npixels - first);
+        unsigned int nvalues = 3 * count;
+        const unsigned char* tile_src = in + 3 * first;
+
+        // vectorized part always ends on a pixel boundary, so the channel of i is i % 3
+        unsigned int i = normalize_tile_vector(tile_src, tile, nvalues, mean, std);
+        for (; i < nvalues; i++)
+        {
+            unsigned int c = i % 3;
+            tile[i] = (((float)tile_src[i]) - mean[c]) * std[c];
+        }
+
+        floattofp16(out + sizeof(uint16_t) * 3 * first, tile, nvalues);
+    }
+}
+
+void movidius_buildChannelLut(const float* mean, const float* std, uint16_t* lut)
+{
+    float values[3 * 256];
+
+    for (int c = 0; c < 3; c++)
+    {
+        for (int v = 0; v < 256; v++)
+            values[c * 256 + v] = (((float)v) - mean[c]) * std[c];
+    }
+
+    floattofp16((unsigned char*)lut, values, 3 * 256);
+}
+
+static void lookup_scalar(const unsigned char* src, uint16_t* dst, unsigned int npixels, const uint16_t* lut)
+{
+    const uint16_t* r = lut;
+    const uint16_t* g = lut + 256;
+    const uint16_t* b = lut + 512;
+
+    for (unsigned int i = 0; i < npixels; i++)
+    {
+        dst[3 * i + 0] = r[src[3 * i + 0]];
+        dst[3 * i + 1] = g[src[3 * i + 1]];
+        dst[3 * i + 2] = b[src[3 * i + 2]];
+    }
+}
+
+#if defined(__aarch64__)
+
+/**
+ * 16 pixels per iteration. tbl instructions index at most 64 bytes, so every 256 entry table is
+ * split into four 64 byte parts and into separate tables for the low and high bytes of the halfs
+ */
+static unsigned int lookup_neon(const unsigned char* src, uint16_t* dst, unsigned int npixels, const uint16_t* lut)
+{
+    unsigned char split[3][2][256];
+
+    for (int c = 0; c < 3; c++)
+    {
+        for (int v = 0; v < 256; v++)
+        {
+            split[c][0][v] = (unsigned char)(lut[c * 256 + v] & 0xff);
+            split[c][1][v] = (unsigned char)(lut[c * 256 + v] >> 8);
+        }
+    }
+
+    uint8x16x4_t tables[3][2][4];
+    for (int c = 0; c < 3; c++)
+    {
+        for (int b = 0; b < 2; b++)
+        {
+            for (int part = 0; part < 4; part++)
+                tables[c][b][part] = vld1q_u8_x4(&split[c][b][64 * part]);
+        }
+    }
+
+    const uint8x16_t step = vdupq_n_u8(64);
+    unsigned int i = 0;
+
+    for (; i + 16 <= npixels; i += 16)
+    {
+        uint8x16x3_t px = vld3q_u8(src + 3 * i);
+        uint16x8x3_t lo, hi;
+
+        for (int c = 0; c < 3; c++)
+        {
+            uint8x16_t bytes[2];
+            for (int b = 0; b < 2; b++)
+            {
+                uint8x16_t idx = px.val[c];
+                uint8x16_t v = vqtbl4q_u8(tables[c][b][0], idx);
+                idx = vsubq_u8(idx, step);
+                v = vqtbx4q_u8(v, tables[c][b][1], idx);
+                idx = vsubq_u8(idx, step);
+                v = vqtbx4q_u8(v, tables[c][b][2], idx);
+                idx = vsubq_u8(idx, step);
+                bytes[b] = vqtbx4q_u8(v, tables[c][b][3], idx);
+            }
+
+            lo.val[c] = vreinterpretq_u16_u8(vzip1q_u8(bytes[0], bytes[1]));
+            hi.val[c] = vreinterpretq_u16_u8(vzip2q_u8(bytes[0], bytes[1]));
+        }
+
+        vst3q_u16(dst + 3 * i, lo);
+        vst3q_u16(dst + 3 * i + 24, hi);
+    }
+
+    return i;
+}
+
+#endif // __aarch64__
+
+void movidius_lookupRGB(const movidius_RGB* src, movidius_RGB_f16* dst, unsigned int npixels,
+                        const uint16_t* lut)
+{
+    const unsigned char* in = (const unsigned char*)src;
+    uint16_t* out = (uint16_t*)dst;
+    unsigned int done = 0;
+
+    // x86 has no byte shuffle with 256 entries, and gathers measured no faster than the plain loop
+#if defined(__aarch64__)
+    done = lookup_neon(in, out, npixels, lut);
+#endif
+
+    lookup_scalar(in + 3 * done, out + 3 * done, npixels - done, lut);
+}
+
+/**
+ * Source taps for every output coordinate along one axis
+ * Output i is the sum of weights[offset[i] + t] * source[start[i] + t] for t < count[i]
+ */
+struct resize_axis
+{
+    std::vector<unsigned int> start;
+    std::vector<unsigned int> count;
+    std::vector<unsigned int> offset;
+    std::vector<float> weights;
+};
+
+/**
+ * Buffers one thread needs while converting a band of output rows
+ */
+struct convert_scratch
+{
+    /**
+     * The source rows of one output row blended together, roi width pixels of floats
+     */
+    std::vector<float> column;
+
+    /**
+     * Source rows converted to RGB888 for formats that are not RGB already
+     */
+    std::vector<unsigned char> rgb;
+
+    /**
+     * One output row of floats, normalized in place before converting it to half floats
+     */
+    std::vector<float> row;
+};
+
+struct movidius_converter
+{
+    unsigned int srcWidth;
+    unsigned int srcHeight;
+    unsigned int dstSize;
+    int filter;
+
+    resize_axis x;
+    resize_axis y;
+
+    /**
+     * One set of buffers per movidius_parallelFor() chunk
+     */
+    std::vector<convert_scratch> scratch;
+};
+
+static void resize_addTap(resize_axis& axis, unsigned int index, float weight)
+{
+    if (axis.count.back() == 0)
+        axis.start.back() = index;
+    axis.weights.push_back(weight);
+    axis.count.back()++;
+}
+
+/**
+ * Bilinear with pixel centers at +0.5, the same mapping OpenCV uses
+ * Upscaling with the area filter also ends up here, as every output pixel would
+ * only cover a part of one source pixel
+ */
+static void resize_bilinearAxis(resize_axis& axis, unsigned int src_len, unsigned int dst_len)
+{
+    double scale = (double)src_len / dst_len;
+
+    for (unsigned int i = 0; i < dst_len; i++)
+    {
+        axis.start.push_back(0);
+        axis.count.push_back(0);
+        axis.offset.push_back(axis.weights.size());
+
+        double f = (i + 0.5) * scale - 0.5;
+        if (f < 0)
+            f = 0;
+
+        unsigned int i0 = (unsigned int)f;
+        float w = (float)(f - i0);
+
+        if (i0 >= src_len - 1 || w == 0)
+        {
+            resize_addTap(axis, std::min(i0, src_len - 1), 1.0f);
+        }
+        else
+        {
+            resize_addTap(axis, i0, 1.0f - w);
+            resize_addTap(axis, i0 + 1, w);
+        }
+    }
+}
+
+/**
+ * Every output pixel is the average of the source area it covers,
+ * partially covered source pixels are weighted by the covered fraction
+ */
+static void resize_areaAxis(resize_axis& axis, unsigned int src_len, unsigned int dst_len)
+{
+    double scale = (double)src_len / dst_len;
+
+    for (unsigned int i = 0; i < dst_len; i++)
+    {
+        axis.start.push_back(0);
+        axis.count.push_back(0);
+        axis.offset.push_back(axis.weights.size());
+
+        double begin = i * scale;
+        double end = std::min((i + 1) * scale, (double)src_len);
+
+        for (unsigned int j = (unsigned int)begin; j < end; j++)
+        {
+            double covered = std::min(end, j + 1.0) - std::max(begin, (double)j);
+            if (covered > 1e-9)
+                resize_addTap(axis, j, (float)(covered / scale));
+        }
+    }
+}
+
+/**
+ * Elements the tables of an axis have room for
+ */
+static size_t resize_capacity(const resize_axis& axis)
+{
+    return axis.start.capacity() + axis.count.capacity() + axis.offset.capacity() + axis.weights.capacity();
+}
+
+static void resize_buildAxis(resize_axis& axis, unsigned int src_len, unsigned int dst_len, int filter)
+{
+    axis.start.clear();
+    axis.count.clear();
+    axis.offset.clear();
+    axis.weights.clear();
+
+    if (filter == MOVIDIUS_RESIZE_AREA && src_len > dst_len)
+        resize_areaAxis(axis, src_len, dst_len);
+    else
+        resize_bilinearAxis(axis, src_len, dst_len);
+}
+
+movidius_converter* movidius_createConverter()
+{
+    movidius_converter* converter = new movidius_converter;
+    converter->srcWidth = 0;
+    converter->srcHeight = 0;
+    converter->dstSize = 0;
+    converter->filter = -1;
+    return converter;
+}
+
+void movidius_destroyConverter(movidius_converter* converter)
+{
+    delete converter;
+}
+
+/**
+ * Adds weight times one source row of width 8 bit values to acc
+ */
+static void resize_accumulate(float* acc, const unsigned char* src, unsigned int width, float weight)
+{
+    unsigned int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 w = _mm_set1_ps(weight);
+
+    for (; i + 16 <= width; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+        __m128i words[4] = {
+            _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+            _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)
+        };
+
+        for (int k = 0; k < 4; k++)
+        {
+            __m128 sum = _mm_loadu_ps(acc + i + 4 * k);
+            sum = _mm_add_ps(sum, _mm_mul_ps(w, _mm_cvtepi32_ps(words[k])));
+            _mm_storeu_ps(acc + i + 4 * k, sum);
+        }
+    }
+#elif defined(__aarch64__)
+    const float32x4_t w = vdupq_n_f32(weight);
+
+    for (; i + 16 <= width; i += 16)
+    {
+        uint8x16_t bytes = vld1q_u8(src + i);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(bytes));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(bytes));
+        uint32x4_t words[4] = {
+            vmovl_u16(vget_low_u16(lo)), vmovl_u16(vget_high_u16(lo)),
+            vmovl_u16(vget_low_u16(hi)), vmovl_u16(vget_high_u16(hi))
+        };
+
+        for (int k = 0; k < 4; k++)
+        {
+            float32x4_t sum = vld1q_f32(acc + i + 4 * k);
+            sum = vaddq_f32(sum, vmulq_f32(w, vcvtq_f32_u32(words[k])));
+            vst1q_f32(acc + i + 4 * k, sum);
+        }
+    }
+#endif
+
+    for (; i < width; i++)
+        acc[i] += weight * src[i];
+}
+
+/**
+ * Everything the row band functions need, passed through movidius_parallelFor()
+ */
+struct convert_job
+{
+    movidius_converter* converter;
+    const movidius_frame* frame;
+    const movidius_rect* roi;
+    unsigned int dstSize;
+    movidius_RGB_f16* dst;
+    const float* mean;
+    const float* std;
+    const uint16_t* lut;
+
+    /**
+     * Pixels converted per item, the whole image for tightly packed RGB
+     */
+    unsigned int rowPixels;
+};
+
+static void convert_scaledRows(unsigned int begin, unsigned int end, unsigned int chunk, void* arg)
+{
+    const convert_job* job = (const convert_job*)arg;
+    const movidius_converter* r = job->converter;
+    const movidius_rect* roi = job->roi;
+    convert_scratch& scratch = job->converter->scratch[chunk];
+    const resize_axis& x = r->x;
+    const resize_axis& y = r->y;
+    const float* mean = job->mean;
+    const float* std = job->std;
+
+    for (unsigned int oy = begin; oy < end; oy++)
+    {
+        // blend the source rows first, these are long contiguous runs that vectorize well,
+        // then filter the single blended row horizontally
+        float* column = &scratch.column[0];
+        std::fill(scratch.column.begin(), scratch.column.end(), 0.0f);
+
+        for (unsigned int t = 0; t < y.count[oy]; t++)
+        {
+            const unsigned char* line = movidius_frameRowRGB(job->frame, roi->y + y.start[oy] + t, roi->x,
+                                                             roi->width, &scratch.rgb[0]);
+            resize_accumulate(column, line, 3 * roi->width, y.weights[y.offset[oy] + t]);
+        }
+
+        float* out = &scratch.row[0];
+
+        for (unsigned int ox = 0; ox < job->dstSize; ox++)
+        {
+            const float* p = column + 3 * x.start[ox];
+            const float* w = &x.weights[x.offset[ox]];
+            float red = 0, green = 0, blue = 0;
+
+            for (unsigned int t = 0; t < x.count[ox]; t++)
+            {
+                red += w[t] * p[3 * t + 0];
+                green += w[t] * p[3 * t + 1];
+                blue += w[t] * p[3 * t + 2];
+            }
+
+            out[3 * ox + 0] = (red - mean[0]) * std[0];
+            out[3 * ox + 1] = (green - mean[1]) * std[1];
+            out[3 * ox + 2] = (blue - mean[2]) * std[2];
+        }
+
+        floattofp16((unsigned char*)(job->dst + oy * job->dstSize), out, 3 * job->dstSize);
+    }
+}
+
+/**
+ * Items are rows, or pixels of a tightly packed RGB image which is converted as one long row
+ */
+static void convert_unscaledRows(unsigned int begin, unsigned int end, unsigned int chunk, void* arg)
+{
+    const convert_job* job = (const convert_job*)arg;
+    convert_scratch& scratch = job->converter->scratch[chunk];
+    unsigned int pixels = job->rowPixels;
+
+    if (pixels != job->roi->width)
+    {
+        const movidius_RGB* src = (const movidius_RGB*)movidius_frameRowRGB(job->frame, job->roi->y, job->roi->x,
+                                                                            pixels, &scratch.rgb[0]);
+        if (job->lut != NULL)
+            movidius_lookupRGB(src + begin, job->dst + begin, end - begin, job->lut);
+        else
+            movidius_normalizeRGB(src + begin, job->dst + begin, end - begin, job->mean, job->std);
+        return;
+    }
+
+    for (unsigned int y = begin; y < end; y++)
+    {
+        const movidius_RGB* src = (const movidius_RGB*)movidius_frameRowRGB(job->frame, job->roi->y + y, job->roi->x,
+                                                                            pixels, &scratch.rgb[0]);
+        if (job->lut != NULL)
+            movidius_lookupRGB(src, job->dst + y * pixels, pixels, job->lut);
+        else
+            movidius_normalizeRGB(src, job->dst + y * pixels, pixels, job->mean, job->std);
+    }
+}
+
+/**
+ * Enlarges a scratch buffer to at least size elements, it never shrinks
+ */
+template <typename T>
+static void convert_grow(std::vector<T>& buffer, size_t size)
+{
+    if (buffer.size() >= size)
+        return;
+
+    buffer.resize(size);
+    movidius_countAllocation();
+}
+
+void movidius_convertRegion(movidius_converter* converter, movidius_threadpool* pool,
+                            const movidius_frame* frame, const movidius_rect* roi, int filter,
+                            unsigned int dst_size, movidius_RGB_f16* dst, const float* mean,
+                            const float* std, const uint16_t* lut)
+{
+    bool scaled = roi->width != dst_size || roi->height != dst_size;
+
+    if (scaled && (converter->srcWidth != roi->width || converter->srcHeight != roi->height ||
+                   converter->dstSize != dst_size || converter->filter != filter))
+    {
+        // rebuilding keeps the capacity of the tables, they only grow for a larger region than before
+        size_t capacity = resize_capacity(converter->x) + resize_capacity(converter->y);
+        resize_buildAxis(converter->x, roi->width, dst_size, filter);
+        resize_buildAxis(converter->y, roi->height, dst_size, filter);
+        if (resize_capacity(converter->x) + resize_capacity(converter->y) != capacity)
+            movidius_countAllocation();
+        converter->srcWidth = roi->width;
+        converter->srcHeight = roi->height;
+        converter->dstSize = dst_size;
+        converter->filter = filter;
+    }
+
+    unsigned int chunks = movidius_threadPoolChunks(pool);
+    convert_grow(converter->scratch, chunks);
+
+    for (unsigned int i = 0; i < chunks; i++)
+    {
+        convert_scratch& scratch = converter->scratch[i];
+        convert_grow(scratch.rgb, 3 * roi->width);
+        if (scaled)
+        {
+            convert_grow(scratch.column, 3 * roi->width);
+            convert_grow(scratch.row, 3 * dst_size);
+        }
+    }
+
+    convert_job job = { converter, frame, roi, dst_size, dst, mean, std, lut, roi->width };
+
+    if (scaled)
+    {
+        movidius_parallelFor(pool, dst_size, convert_scaledRows, &job);
+        return;
+    }
+
+    // tightly packed RGB rows follow each other in memory, convert them as one long row
+    bool contiguous = frame->format == MOVIDIUS_PIXEL_RGB && roi->x == 0 &&
+                      roi->width == frame->width && frame->stride == 3 * frame->width;
+    if (contiguous)
+    {
+        job.rowPixels = dst_size * dst_size;
+        movidius_parallelFor(pool, dst_size * dst_size, convert_unscaledRows, &job);
+        return;
+    }
+
+    movidius_parallelFor(pool, dst_size, convert_unscaledRows, &job);
+}
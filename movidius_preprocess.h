@@ -0,0 +1,80 @@
+#ifndef MOVIDIUS_PREPROCESS_H
+#define MOVIDIUS_PREPROCESS_H
+
+#include "movidiusdevice.h"
+#include "movidius_threadpool.h"
+
+/**
+ * Host side image preprocessing kernels used by movidius_convertImage()
+ * These only deal with pixel data, the device struct is handled by the callers
+ */
+
+/**
+ * Applies (pixel - mean) * standard_deviation to npixels RGB888 pixels and writes the results
+ * as half floats. The pixels are processed in tiles small enough to stay in the L1 cache,
+ * so no full size float buffer is needed. Output is bit identical to normalizing into a
+ * float buffer and running floattofp16() on it
+ */
+extern void movidius_normalizeRGB(const movidius_RGB* src, movidius_RGB_f16* dst, unsigned int npixels,
+                                  const float* mean, const float* std);
+
+/**
+ * Fills lut with the half float of (value - mean[c]) * std[c] for every channel c and 8 bit value,
+ * stored at lut[c * 256 + value]. lut must hold MOVIDIUS_LUT_ENTRIES values
+ */
+extern void movidius_buildChannelLut(const float* mean, const float* std, uint16_t* lut);
+
+/**
+ * Converts npixels RGB888 pixels to half floats by looking every channel value up from a table
+ * built with movidius_buildChannelLut(). Gives the same output as movidius_normalizeRGB()
+ */
+extern void movidius_lookupRGB(const movidius_RGB* src, movidius_RGB_f16* dst, unsigned int npixels,
+                               const uint16_t* lut);
+
+/**
+ * An input image in one of the MOVIDIUS_PIXEL_* formats
+ * NV12 frames store the interleaved chroma plane right after the height rows of luma,
+ * using the same stride
+ */
+typedef struct
+{
+    const unsigned char* data;
+    int format;
+    unsigned int width;
+    unsigned int height;
+    unsigned int stride;
+} movidius_frame;
+
+/**
+ * Returns n pixels of row y of the frame starting at column x as RGB888
+ * RGB frames are returned in place, other formats are converted into scratch, which must
+ * hold 3 * n bytes. Returns NULL for unknown formats
+ */
+extern const unsigned char* movidius_frameRowRGB(const movidius_frame* frame, unsigned int y, unsigned int x,
+                                                 unsigned int n, unsigned char* scratch);
+
+/**
+ * Coefficient tables and row buffers used by movidius_convertRegion()
+ * Kept between calls so converting frames of the same size does not allocate
+ */
+struct movidius_converter;
+
+extern movidius_converter* movidius_createConverter();
+extern void movidius_destroyConverter(movidius_converter* converter);
+
+/**
+ * Crops roi from the frame, scales it to dst_size * dst_size if it is not that size already,
+ * normalizes it and writes the result as half floats to dst, one output row at a time
+ * Only the source rows needed for the current output row are touched, and the intermediate
+ * results never grow past a single row
+ * @param pool: Splits the output rows into bands converted in parallel, NULL converts on this thread
+ * @param filter: One of the MOVIDIUS_RESIZE_* values
+ * @param lut: Table from movidius_buildChannelLut() used for regions that need no scaling,
+ * or NULL to use movidius_normalizeRGB() for those
+ */
+extern void movidius_convertRegion(movidius_converter* converter, movidius_threadpool* pool,
+                                   const movidius_frame* frame, const movidius_rect* roi, int filter,
+                                   unsigned int dst_size, movidius_RGB_f16* dst, const float* mean,
+                                   const float* std, const uint16_t* lut);
+
+#endif // MOVIDIUS_PREPROCESS_H
@@ -0,0 +1,484 @@
+#include "movidius_profile.h"
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+// log linear buckets: exact below 32 us, then 16 buckets per power of two up to 2^26 us
+#define PROFILE_SUB_BITS 4
+#define PROFILE_SUB_BUCKETS (1 << PROFILE_SUB_BITS)
+#define PROFILE_LINEAR (2 * PROFILE_SUB_BUCKETS)
+#define PROFILE_MAX_BIT 26
+#define PROFILE_BUCKETS (PROFILE_LINEAR + (PROFILE_MAX_BIT - PROFILE_SUB_BITS) * PROFILE_SUB_BUCKETS)
+
+/**
+ * Most recent inferences kept for movidius_writeChromeTrace()
+ */
+#define PROFILE_TRACE_ENTRIES 64
+
+/**
+ * Sets of histograms per graph, every recording thread sticks to one of them
+ * Threads only share a set when there are more of them than sets
+ */
+#define PROFILE_SHARDS 4
+
+struct profile_histogram
+{
+    std::atomic<uint32_t> counts[PROFILE_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint32_t> maxUs;
+};
+
+/**
+ * One traced inference. seq is odd while a recorder writes the entry, readers copy it
+ * and throw the copy away if seq changed meanwhile
+ */
+struct profile_trace
+{
+    std::atomic<unsigned int> seq;
+
+    // the value of movidius_profile::traced this inference got
+    std::atomic<unsigned long> index;
+    std::atomic<unsigned long long> endUs;
+    std::atomic<int> level;
+    std::atomic<unsigned int> layers;
+
+    // numLayers entries of movidius_profile::traceLayerMs
+    std::atomic<float>* layerMs;
+};
+
+struct movidius_profile
+{
+    unsigned int numLayers;
+
+    // [level * (numLayers + 2) + 2 + layer], with the device total and end to end first
+    profile_histogram* histograms[PROFILE_SHARDS];
+
+    profile_trace trace[PROFILE_TRACE_ENTRIES];
+    std::atomic<float>* traceLayerMs;
+    std::atomic<unsigned long> traced;
+
+    // traced at the last movidius_resetProfile(), older entries are not written out
+    std::atomic<unsigned long> firstTraced;
+};
+
+static unsigned int profile_bucket(uint32_t us)
+{
+    if (us >= (1u << PROFILE_MAX_BIT))
+        us = (1u << PROFILE_MAX_BIT) - 1;
+
+    if (us < PROFILE_LINEAR)
+        return us;
+
+    int bit = 31 - __builtin_clz(us);
+    return PROFILE_LINEAR + (bit - PROFILE_SUB_BITS - 1) * PROFILE_SUB_BUCKETS +
+           ((us >> (bit - PROFILE_SUB_BITS)) & (PROFILE_SUB_BUCKETS - 1));
+}
+
+/**
+ * Middle of the values that land in a bucket
+ */
+static double profile_bucketUs(unsigned int bucket)
+{
+    if (bucket < PROFILE_LINEAR)
+        return bucket;
+
+    int bit = (bucket - PROFILE_LINEAR) / PROFILE_SUB_BUCKETS + PROFILE_SUB_BITS + 1;
+    unsigned int sub = (bucket - PROFILE_LINEAR) % PROFILE_SUB_BUCKETS;
+    double width = (double)(1u << (bit - PROFILE_SUB_BITS));
+    return (PROFILE_SUB_BUCKETS + sub) * width + (width - 1) / 2;
+}
+
+static void profile_record(profile_histogram* histogram, double ms)
+{
+    double us = ms * 1000 + 0.5;
+    uint32_t value = us <= 0 ? 0 : us >= 4e9 ? 0xffffffffu : (uint32_t)us;
+
+    histogram->counts[profile_bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    histogram->count.fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t max = histogram->maxUs.load(std::memory_order_relaxed);
+    while (value > max && !histogram->maxUs.compare_exchange_weak(max, value, std::memory_order_relaxed))
+        ;
+}
+
+static profile_histogram* profile_histograms(movidius_profile* profile, unsigned int shard, int level, int layer)
+{
+    return &profile->histograms[shard][level * (profile->numLayers + 2) + 2 + layer];
+}
+
+/**
+ * The set of histograms the calling thread records into
+ */
+static unsigned int profile_shard()
+{
+    static std::atomic<unsigned int> next(0);
+    static thread_local unsigned int shard = next.fetch_add(1, std::memory_order_relaxed) % PROFILE_SHARDS;
+    return shard;
+}
+
+/**
+ * The profile of graph, once published by the first profiled result
+ */
+static movidius_profile* profile_get(movidius_graph* graph)
+{
+    return (movidius_profile*)__atomic_load_n(&graph->profile, __ATOMIC_ACQUIRE);
+}
+
+static movidius_profile* profile_create(unsigned int layers)
+{
+    movidius_profile* profile = new movidius_profile;
+    profile->numLayers = layers;
+    for (unsigned int shard = 0; shard < PROFILE_SHARDS; shard++)
+        profile->histograms[shard] = new profile_histogram[MOVIDIUS_PROFILE_LEVELS * (layers + 2)]();
+
+    profile->traceLayerMs = new std::atomic<float>[PROFILE_TRACE_ENTRIES * layers];
+    for (unsigned int i = 0; i < PROFILE_TRACE_ENTRIES; i++)
+    {
+        profile->trace[i].seq.store(0, std::memory_order_relaxed);
+        profile->trace[i].index.store(0, std::memory_order_relaxed);
+        profile->trace[i].layers.store(0, std::memory_order_relaxed);
+        profile->trace[i].layerMs = profile->traceLayerMs + i * layers;
+    }
+    profile->traced.store(0, std::memory_order_relaxed);
+    profile->firstTraced.store(0, std::memory_order_relaxed);
+    return profile;
+}
+
+static void profile_free(movidius_profile* profile)
+{
+    for (unsigned int shard = 0; shard < PROFILE_SHARDS; shard++)
+        delete[] profile->histograms[shard];
+    delete[] profile->traceLayerMs;
+    delete profile;
+}
+
+/**
+ * Stores an inference into the trace ring without waiting on anyone
+ * A recorder that fell a whole ring behind may still be writing the entry, then this inference is left out
+ */
+static void profile_writeTrace(movidius_profile* profile, const float* layer_ms, unsigned int layers, int level,
+                               unsigned long long end_us)
+{
+    unsigned long index = profile->traced.fetch_add(1, std::memory_order_relaxed);
+    profile_trace& entry = profile->trace[index % PROFILE_TRACE_ENTRIES];
+
+    unsigned int seq = entry.seq.load(std::memory_order_relaxed);
+    if ((seq & 1) != 0 || !entry.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire))
+        return;
+
+    entry.index.store(index, std::memory_order_relaxed);
+    entry.endUs.store(end_us, std::memory_order_relaxed);
+    entry.level.store(level, std::memory_order_relaxed);
+    entry.layers.store(layers, std::memory_order_relaxed);
+    for (unsigned int i = 0; i < layers; i++)
+        entry.layerMs[i].store(layer_ms[i], std::memory_order_relaxed);
+
+    entry.seq.store(seq + 2, std::memory_order_release);
+}
+
+/**
+ * Copies the trace entry of the inference with the given index into end_us, level and layer_ms
+ * Returns the number of layers, 0 if the entry is being written or holds another inference by now
+ */
+static unsigned int profile_readTrace(movidius_profile* profile, unsigned long index, unsigned long long* end_us,
+                                      int* level, float* layer_ms)
+{
+    const profile_trace& entry = profile->trace[index % PROFILE_TRACE_ENTRIES];
+
+    unsigned int seq = entry.seq.load(std::memory_order_acquire);
+    if ((seq & 1) != 0)
+        return 0;
+
+    unsigned long held = entry.index.load(std::memory_order_relaxed);
+    *end_us = entry.endUs.load(std::memory_order_relaxed);
+    *level = entry.level.load(std::memory_order_relaxed);
+    unsigned int layers = std::min(entry.layers.load(std::memory_order_relaxed), profile->numLayers);
+    for (unsigned int i = 0; i < layers; i++)
+        layer_ms[i] = entry.layerMs[i].load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (entry.seq.load(std::memory_order_relaxed) != seq || held != index)
+        return 0;
+    return layers;
+}
+
+/**
+ * Percentiles of the sum of the histograms of the given levels
+ */
+static int profile_latency(movidius_profile* profile, int layer, int level, movidius_latency* latency)
+{
+    int first = level == MOVIDIUS_PROFILE_ALL_LEVELS ? 0 : level;
+    int last = level == MOVIDIUS_PROFILE_ALL_LEVELS ? MOVIDIUS_PROFILE_LEVELS - 1 : level;
+    if (first < 0 || last >= MOVIDIUS_PROFILE_LEVELS || layer < MOVIDIUS_PROFILE_END_TO_END ||
+        layer >= (int)profile->numLayers)
+        return INVALID_INPUT_DATA;
+
+    std::vector<uint64_t> counts(PROFILE_BUCKETS, 0);
+    uint64_t total = 0;
+    uint32_t max = 0;
+
+    for (unsigned int shard = 0; shard < PROFILE_SHARDS; shard++)
+    {
+        for (int l = first; l <= last; l++)
+        {
+            profile_histogram* histogram = profile_histograms(profile, shard, l, layer);
+            for (int b = 0; b < PROFILE_BUCKETS; b++)
+            {
+                uint64_t count = histogram->counts[b].load(std::memory_order_relaxed);
+                counts[b] += count;
+                total += count;
+            }
+            max = std::max(max, histogram->maxUs.load(std::memory_order_relaxed));
+        }
+    }
+
+    if (total == 0)
+        return INVALID_INPUT_DATA;
+
+    latency->count = (unsigned long)total;
+    latency->maxMs = max / 1000.0;
+
+    uint64_t p50 = (total + 1) / 2;
+    uint64_t p99 = total - total / 100;
+    uint64_t seen = 0;
+    latency->p50Ms = -1;
+
+    for (int b = 0; b < PROFILE_BUCKETS; b++)
+    {
+        seen += counts[b];
+        if (latency->p50Ms < 0 && seen >= p50)
+            latency->p50Ms = std::min(profile_bucketUs(b), (double)max) / 1000.0;
+        if (seen >= p99)
+        {
+            latency->p99Ms = std::min(profile_bucketUs(b), (double)max) / 1000.0;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+unsigned long long movidius_profileClockUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void movidius_profileResult(movidius_graph* graph, const float* layer_ms, unsigned int layers,
+                            int level, unsigned long long submitted_us)
+{
+    movidius_profile* profile = profile_get(graph);
+    if (profile == NULL)
+    {
+        // the layer count of a graph never changes, so it sizes the tables once
+        profile = profile_create(layers);
+
+        void* expected = NULL;
+        if (__atomic_compare_exchange_n(&graph->profile, &expected, (void*)profile, false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE))
+            movidius_countAllocation();
+        else
+        {
+            // another thread collecting results of this graph published its profile first
+            profile_free(profile);
+            profile = (movidius_profile*)expected;
+        }
+    }
+
+    level = std::min(std::max(level, 0), MOVIDIUS_PROFILE_LEVELS - 1);
+    layers = std::min(layers, profile->numLayers);
+    unsigned int shard = profile_shard();
+
+    float sum = 0;
+    for (unsigned int i = 0; i < layers; i++)
+    {
+        profile_record(profile_histograms(profile, shard, level, i), layer_ms[i]);
+        sum += layer_ms[i];
+    }
+    profile_record(profile_histograms(profile, shard, level, MOVIDIUS_PROFILE_DEVICE), sum);
+
+    unsigned long long now = movidius_profileClockUs();
+    if (submitted_us != 0)
+        profile_record(profile_histograms(profile, shard, level, MOVIDIUS_PROFILE_END_TO_END),
+                       (now - submitted_us) / 1000.0);
+
+    profile_writeTrace(profile, layer_ms, layers, level, now);
+}
+
+void movidius_destroyProfile(movidius_graph* graph)
+{
+    movidius_profile* profile = profile_get(graph);
+    if (profile == NULL)
+        return;
+
+    __atomic_store_n(&graph->profile, (void*)NULL, __ATOMIC_RELEASE);
+    profile_free(profile);
+}
+
+void movidius_resetProfile(movidius_device* dev)
+{
+    // recorders may be writing into the tables right now, so they are cleared rather than freed
+    for (int slot = 0; slot < MOVIDIUS_MAX_GRAPHS; slot++)
+    {
+        movidius_profile* profile = profile_get(&dev->graphs[slot]);
+        if (profile == NULL)
+            continue;
+
+        unsigned int histograms = MOVIDIUS_PROFILE_LEVELS * (profile->numLayers + 2);
+        for (unsigned int shard = 0; shard < PROFILE_SHARDS; shard++)
+        {
+            for (unsigned int h = 0; h < histograms; h++)
+            {
+                profile_histogram& histogram = profile->histograms[shard][h];
+                for (int b = 0; b < PROFILE_BUCKETS; b++)
+                    histogram.counts[b].store(0, std::memory_order_relaxed);
+                histogram.count.store(0, std::memory_order_relaxed);
+                histogram.maxUs.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        profile->firstTraced.store(profile->traced.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
+
+int movidius_getLatency(movidius_device* dev, int layer, int level, movidius_latency* latency)
+{
+    movidius_profile* profile = dev->graph != NULL ? profile_get(dev->graph) : NULL;
+    if (profile == NULL)
+        return INVALID_INPUT_DATA;
+
+    return profile_latency(profile, layer, level, latency);
+}
+
+static void profile_writeRow(FILE* out, const char* name, const movidius_latency& latency)
+{
+    fprintf(out, "  %-12s %10lu %10.3f %10.3f %10.3f\n", name, latency.count, latency.p50Ms,
+            latency.p99Ms, latency.maxMs);
+}
+
+void movidius_writeProfileReport(movidius_device* dev, FILE* out)
+{
+    for (int slot = 0; slot < MOVIDIUS_MAX_GRAPHS; slot++)
+    {
+        movidius_graph* graph = &dev->graphs[slot];
+        movidius_profile* profile = profile_get(graph);
+        if (graph->handle == NULL || profile == NULL)
+            continue;
+
+        fprintf(out, "%s %s: %u layers\n", dev->dev_name, graph->networkPath, profile->numLayers);
+
+        for (int level = MOVIDIUS_PROFILE_ALL_LEVELS; level < MOVIDIUS_PROFILE_LEVELS; level++)
+        {
+            movidius_latency latency;
+            if (profile_latency(profile, MOVIDIUS_PROFILE_DEVICE, level, &latency) != 0)
+                continue;
+
+            if (level == MOVIDIUS_PROFILE_ALL_LEVELS)
+                fprintf(out, " all throttling levels\n");
+            else
+                fprintf(out, " throttling level %d\n", level);
+            fprintf(out, "  %-12s %10s %10s %10s %10s\n", "layer", "count", "p50 ms", "p99 ms", "max ms");
+
+            for (unsigned int layer = 0; layer < profile->numLayers; layer++)
+            {
+                char name[32];
+                snprintf(name, sizeof(name), "%u", layer);
+                if (profile_latency(profile, layer, level, &latency) == 0)
+                    profile_writeRow(out, name, latency);
+            }
+
+            if (profile_latency(profile, MOVIDIUS_PROFILE_DEVICE, level, &latency) == 0)
+                profile_writeRow(out, "device", latency);
+            if (profile_latency(profile, MOVIDIUS_PROFILE_END_TO_END, level, &latency) == 0)
+                profile_writeRow(out, "end to end", latency);
+        }
+    }
+}
+
+/**
+ * Writes s as a JSON string
+ */
+static void profile_writeJsonString(FILE* out, const char* s)
+{
+    fputc('"', out);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(out, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(out, "\\u%04x", *s);
+        else
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+int movidius_writeChromeTrace(movidius_device* dev, const char* path)
+{
+    FILE* out = fopen(path, "w");
+    if (!out)
+    {
+        fprintf(stderr, "movidius: Cannot write file: %s\n", path);
+        return DATA_LOAD_FAILED;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":");
+    profile_writeJsonString(out, dev->dev_name);
+    fprintf(out, "}}");
+
+    for (int slot = 0; slot < MOVIDIUS_MAX_GRAPHS; slot++)
+    {
+        movidius_graph* graph = &dev->graphs[slot];
+        movidius_profile* profile = profile_get(graph);
+        if (graph->handle == NULL || profile == NULL)
+            continue;
+
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", slot + 1);
+        profile_writeJsonString(out, graph->networkPath);
+        fprintf(out, "}}");
+
+        unsigned long traced = profile->traced.load(std::memory_order_relaxed);
+        unsigned long first = std::max(profile->firstTraced.load(std::memory_order_relaxed),
+                                       traced > PROFILE_TRACE_ENTRIES ? traced - PROFILE_TRACE_ENTRIES : 0);
+        std::vector<float> layerMs(profile->numLayers);
+
+        for (unsigned long i = first; i < traced; i++)
+        {
+            unsigned long long endUs;
+            int level;
+            unsigned int layers = profile_readTrace(profile, i, &endUs, &level, layerMs.data());
+            if (layers == 0)
+                continue;
+
+            // the layers ran back to back and finished just before the result was collected
+            double sum = 0;
+            for (unsigned int layer = 0; layer < layers; layer++)
+                sum += layerMs[layer] * 1000.0;
+            double ts = endUs - sum;
+
+            fprintf(out, ",\n{\"name\":\"inference\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f,"
+                         "\"args\":{\"throttling\":%d}}", slot + 1, ts, sum, level);
+
+            for (unsigned int layer = 0; layer < layers; layer++)
+            {
+                double dur = layerMs[layer] * 1000.0;
+                fprintf(out, ",\n{\"name\":\"layer %u\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f}",
+                        layer, slot + 1, ts, dur);
+                ts += dur;
+            }
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+
+    if (fclose(out) != 0)
+    {
+        fprintf(stderr, "movidius: Failed writing %s\n", path);
+        return DATA_LOAD_FAILED;
+    }
+
+    return 0;
+}
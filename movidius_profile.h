@@ -0,0 +1,97 @@
+#ifndef MOVIDIUS_PROFILE_H
+#define MOVIDIUS_PROFILE_H
+
+#include <stdio.h>
+#include "movidiusdevice.h"
+
+/**
+ * Per layer latency histograms of the graphs on a device, filled from MVNC_TIME_TAKEN after
+ * every result while movidius_device::profiling is set. Costs one extra USB round trip per result
+ * Histograms are kept separately for each thermal throttling level, so layers that slow down
+ * when the stick gets hot stand out. Recording takes no locks: every thread counts into its
+ * own set of histograms with relaxed atomic increments, and the sets are added up when read,
+ * so several threads collecting results from the same device don't wait on each other
+ */
+
+/**
+ * Throttling levels histograms are kept for, MVNC_THERMAL_THROTTLING_LEVEL 0 to 2
+ */
+#define MOVIDIUS_PROFILE_LEVELS 3
+
+/**
+ * Pass as level to merge the histograms of all throttling levels
+ */
+#define MOVIDIUS_PROFILE_ALL_LEVELS -1
+
+/**
+ * Percentiles of one histogram, in milliseconds. Values are exact to about 3%
+ */
+typedef struct
+{
+    unsigned long count;
+    double p50Ms;
+    double p99Ms;
+    double maxMs;
+} movidius_latency;
+
+/**
+ * What movidius_getLatency() reports on besides layers
+ */
+enum
+{
+    /**
+     * Sum of the layer times, the time the stick spent on the inference
+     */
+    MOVIDIUS_PROFILE_DEVICE = -1,
+
+    /**
+     * From submitting the tensor to collecting the result on the host, including transfers
+     * and waiting behind the other inference in flight
+     */
+    MOVIDIUS_PROFILE_END_TO_END = -2
+};
+
+/**
+ * Percentiles of the current graph of dev
+ * @param layer: A layer index, or MOVIDIUS_PROFILE_DEVICE or MOVIDIUS_PROFILE_END_TO_END
+ * @param level: A throttling level or MOVIDIUS_PROFILE_ALL_LEVELS
+ * Returns 0 on success, INVALID_INPUT_DATA if nothing has been recorded for that layer
+ */
+extern int movidius_getLatency(movidius_device* dev, int layer, int level, movidius_latency* latency);
+
+/**
+ * Writes a table of the percentiles of every layer of every graph on dev
+ */
+extern void movidius_writeProfileReport(movidius_device* dev, FILE* out);
+
+/**
+ * Writes the most recent profiled inferences of every graph on dev as Chrome trace event
+ * JSON, one track per network, for chrome://tracing or Perfetto
+ * Returns 0 on success
+ */
+extern int movidius_writeChromeTrace(movidius_device* dev, const char* path);
+
+/**
+ * Clears the histograms and the trace of every graph on dev
+ * Safe while other threads are recording, the tables are zeroed rather than freed
+ */
+extern void movidius_resetProfile(movidius_device* dev);
+
+/**
+ * Microseconds on a monotonic clock, used to time requests end to end
+ */
+extern unsigned long long movidius_profileClockUs();
+
+/**
+ * Records one result of graph, called by the device after fetching MVNC_TIME_TAKEN
+ * @param submitted_us: movidius_profileClockUs() when the tensor was loaded, 0 if unknown
+ */
+extern void movidius_profileResult(movidius_graph* graph, const float* layer_ms, unsigned int layers,
+                                   int level, unsigned long long submitted_us);
+
+/**
+ * Frees the histograms of a graph, nothing may be recording into them anymore
+ */
+extern void movidius_destroyProfile(movidius_graph* graph);
+
+#endif // MOVIDIUS_PROFILE_H
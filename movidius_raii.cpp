@@ -0,0 +1,299 @@
+#include "movidius_raii.h"
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+
+namespace movidius
+{
+
+Tensor::Tensor()
+    : count(0)
+{
+}
+
+Tensor::Tensor(unsigned int size)
+    : values(new float[size]()), count(size)
+{
+}
+
+Tensor::Tensor(Tensor&& other)
+    : values(std::move(other.values)), count(other.count)
+{
+    other.count = 0;
+}
+
+Tensor& Tensor::operator=(Tensor&& other)
+{
+    if (this != &other)
+    {
+        values = std::move(other.values);
+        count = other.count;
+        other.count = 0;
+    }
+    return *this;
+}
+
+/**
+ * Deleter of the shared device, runs once the Device and every Graph on it are gone
+ */
+static void raii_closeDevice(movidius_device* dev)
+{
+    if (dev->dev_handle != NULL)
+        movidius_closeDevice(dev, true);
+    delete dev;
+}
+
+Device::Device()
+{
+}
+
+Device::~Device()
+{
+    close();
+}
+
+Device::Device(Device&& other)
+    : dev(std::move(other.dev))
+{
+}
+
+Device& Device::operator=(Device&& other)
+{
+    if (this != &other)
+    {
+        close();
+        dev = std::move(other.dev);
+    }
+    return *this;
+}
+
+int Device::open()
+{
+    // a stick that is open already is not listed by mvnc for opening again
+    close();
+
+    movidius_device* opened = new movidius_device();
+    return adopt(opened, movidius_openDevice(opened));
+}
+
+int Device::open(const char* name)
+{
+    close();
+
+    movidius_device* opened = new movidius_device();
+    return adopt(opened, movidius_openDeviceName(opened, name));
+}
+
+int Device::adopt(movidius_device* opened, int rc)
+{
+    if (rc != 0)
+    {
+        delete opened;
+        return rc;
+    }
+
+    dev.reset(opened, raii_closeDevice);
+    return 0;
+}
+
+int Device::close()
+{
+    if (dev.get() == NULL)
+        return 0;
+
+    // with graphs still alive the deleter closes the stick after the last of them
+    int rc = 0;
+    if (dev.use_count() == 1 && dev->dev_handle != NULL)
+        rc = movidius_closeDevice(dev.get(), true);
+
+    dev.reset();
+    return rc;
+}
+
+int Device::upload(const char* network_path, Graph& graph)
+{
+    if (dev.get() == NULL)
+    {
+        fprintf(stderr, "movidius: cannot upload %s to a closed device\n", network_path);
+        return INVALID_DEV_HANDLE;
+    }
+
+    int rc = graph.release();
+    if (rc != 0)
+        return rc;
+
+    for (int slot = 0; slot < MOVIDIUS_MAX_GRAPHS; slot++)
+    {
+        const movidius_graph* resident = &dev->graphs[slot];
+        if (resident->handle != NULL && strcmp(resident->networkPath, network_path) == 0)
+        {
+            fprintf(stderr, "movidius: network %s is already owned by another graph\n", network_path);
+            return NOT_ALLOWED_THIS_TIME;
+        }
+    }
+
+    snprintf(dev->networkPath, sizeof(dev->networkPath), "%s", network_path);
+    rc = movidius_uploadNetwork(dev.get());
+    if (rc != 0)
+        return rc;
+
+    graph.dev = dev;
+    graph.graph = dev->graph;
+    graph.handle = dev->graph->handle;
+    return 0;
+}
+
+int Device::setPreprocessThreads(unsigned int threads, const int* cpus, unsigned int ncpus)
+{
+    if (dev.get() == NULL)
+        return INVALID_DEV_HANDLE;
+
+    return movidius_setPreprocessThreads(dev.get(), threads, cpus, ncpus);
+}
+
+Graph::Graph()
+    : graph(NULL), handle(NULL)
+{
+}
+
+Graph::~Graph()
+{
+    discard();
+}
+
+Graph::Graph(Graph&& other)
+    : dev(std::move(other.dev)), graph(other.graph), handle(other.handle)
+{
+    other.graph = NULL;
+    other.handle = NULL;
+}
+
+Graph& Graph::operator=(Graph&& other)
+{
+    if (this != &other)
+    {
+        discard();
+        dev = std::move(other.dev);
+        graph = other.graph;
+        handle = other.handle;
+        other.graph = NULL;
+        other.handle = NULL;
+    }
+    return *this;
+}
+
+bool Graph::isLoaded() const
+{
+    // the slot may have been deallocated behind our back, or reused by another network since
+    return graph != NULL && handle != NULL && dev->dev_handle != NULL && graph->handle == handle;
+}
+
+int Graph::release()
+{
+    if (isLoaded())
+    {
+        int rc = movidius_deallocateNetwork(dev.get(), graph->networkPath);
+        if (rc == NOT_ALLOWED_THIS_TIME)
+            return rc;
+    }
+
+    dev.reset();
+    graph = NULL;
+    handle = NULL;
+    return 0;
+}
+
+void Graph::discard()
+{
+    // nobody collects these results any more, but the graph can't go with them on the stick
+    while (isLoaded() && graph->numInflight > 0 && select() == 0)
+    {
+        unsigned int inflight = graph->numInflight;
+        movidius_waitInference(dev.get(), NULL, 0, NULL);
+        if (graph->numInflight >= inflight)
+            break;
+    }
+
+    release();
+}
+
+int Graph::select()
+{
+    if (!isLoaded())
+    {
+        fprintf(stderr, "movidius: graph is not loaded\n");
+        return INVALID_INPUT_DATA;
+    }
+
+    if (dev->graph == graph)
+        return 0;
+    return movidius_selectNetwork(dev.get(), graph->networkPath);
+}
+
+unsigned int Graph::numCategories() const
+{
+    return isLoaded() ? (unsigned int)graph->numCategories : 0;
+}
+
+const char* Graph::category(unsigned int index) const
+{
+    return index < numCategories() ? graph->categories[index] : NULL;
+}
+
+unsigned int Graph::reqsize() const
+{
+    return isLoaded() ? graph->reqsize : 0;
+}
+
+Tensor Graph::makeTensor() const
+{
+    return Tensor(numCategories());
+}
+
+int Graph::convert(const unsigned char* pixels, int format, unsigned int width, unsigned int height,
+                   unsigned int stride, const movidius_rect* roi, int filter)
+{
+    int rc = select();
+    if (rc != 0)
+        return rc;
+
+    return movidius_convertFrame(pixels, format, width, height, stride, roi, filter, dev.get());
+}
+
+int Graph::run(Tensor& output)
+{
+    int rc = select();
+    if (rc != 0)
+        return rc;
+
+    return movidius_runInference(dev.get(), output.data(), output.size());
+}
+
+int Graph::submit(void* tag)
+{
+    int rc = select();
+    if (rc != 0)
+        return rc;
+
+    return movidius_submitInference(dev.get(), tag);
+}
+
+int Graph::wait(Tensor& output, void** tag)
+{
+    int rc = select();
+    if (rc != 0)
+        return rc;
+
+    return movidius_waitInference(dev.get(), output.data(), output.size(), tag);
+}
+
+int Graph::poll(Tensor& output, void** tag)
+{
+    int rc = select();
+    if (rc != 0)
+        return rc;
+
+    return movidius_pollInference(dev.get(), output.data(), output.size(), tag);
+}
+
+} // namespace movidius
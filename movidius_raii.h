@@ -0,0 +1,169 @@
+#ifndef MOVIDIUS_RAII_H
+#define MOVIDIUS_RAII_H
+
+#include "movidiusdevice.h"
+#include <memory>
+
+/**
+ * C++ owners for a stick, the graphs uploaded to it and their output buffers
+ * Each object releases what it owns in its destructor, and can be moved but not copied
+ * Failing calls return the same codes as the movidius_* functions they wrap
+ *
+ *   movidius::Device device;
+ *   movidius::Graph graph;
+ *   device.open();
+ *   device.upload("network/Age", graph);
+ *   movidius::Tensor output = graph.makeTensor();
+ *
+ *   graph.convert(pixels, MOVIDIUS_PIXEL_RGB, width, height, 3 * width, NULL, MOVIDIUS_RESIZE_AREA);
+ *   graph.run(output);
+ *
+ * get() returns the wrapped struct for everything else, e.g. the telemetry and profiling functions
+ */
+namespace movidius
+{
+
+/**
+ * Output of a graph, one float per category
+ * Allocated once by Graph::makeTensor() and then filled in place by every inference
+ */
+class Tensor
+{
+public:
+    Tensor();
+    explicit Tensor(unsigned int size);
+    Tensor(Tensor&& other);
+    Tensor& operator=(Tensor&& other);
+
+    float* data() { return values.get(); }
+    const float* data() const { return values.get(); }
+    unsigned int size() const { return count; }
+    float operator[](unsigned int index) const { return values[index]; }
+
+private:
+    std::unique_ptr<float[]> values;
+    unsigned int count;
+};
+
+class Graph;
+
+/**
+ * An opened stick
+ * The stick stays open while a Graph uploaded to it is alive, even after the Device itself
+ * was closed or destroyed, so the two can go away in any order
+ */
+class Device
+{
+public:
+    Device();
+    ~Device();
+    Device(Device&& other);
+    Device& operator=(Device&& other);
+
+    /**
+     * Opens the first stick, or the one with the given mvnc device name
+     * A stick this object had open before is released first
+     */
+    int open();
+    int open(const char* name);
+
+    /**
+     * Lets go of the stick, it is closed right away unless a Graph still uses it
+     * Returns 0, or the error of closing the stick
+     */
+    int close();
+
+    bool isOpen() const { return dev.get() != NULL; }
+    movidius_device* get() const { return dev.get(); }
+
+    /**
+     * Uploads the network folder or bundle at network_path, graph becomes its owner
+     * Whatever graph held before is released first
+     * Returns NOT_ALLOWED_THIS_TIME if the network is on the stick already, only one Graph owns it
+     */
+    int upload(const char* network_path, Graph& graph);
+
+    /**
+     * movidius_setPreprocessThreads() for the conversions of every graph on this stick
+     */
+    int setPreprocessThreads(unsigned int threads, const int* cpus = NULL, unsigned int ncpus = 0);
+
+private:
+    int adopt(movidius_device* opened, int rc);
+
+    std::shared_ptr<movidius_device> dev;
+};
+
+/**
+ * A network resident on a stick, deallocated from it when this object goes away
+ * Calls make this graph the current one of its stick first, which fails with
+ * NOT_ALLOWED_THIS_TIME while another graph of the same stick has inferences in flight
+ */
+class Graph
+{
+public:
+    Graph();
+    ~Graph();
+    Graph(Graph&& other);
+    Graph& operator=(Graph&& other);
+
+    /**
+     * Deallocates the graph from its stick, after this the object is empty
+     * Returns 0 on success, NOT_ALLOWED_THIS_TIME with inferences still in flight
+     */
+    int release();
+
+    /**
+     * True while the graph is on a stick
+     */
+    bool isLoaded() const;
+
+    movidius_graph* get() const { return graph; }
+    movidius_device* device() const { return dev.get(); }
+
+    unsigned int numCategories() const;
+    const char* category(unsigned int index) const;
+    unsigned int reqsize() const;
+
+    /**
+     * A Tensor sized for the outputs of this graph
+     */
+    Tensor makeTensor() const;
+
+    /**
+     * movidius_convertFrame() into this graph's input
+     */
+    int convert(const unsigned char* pixels, int format, unsigned int width, unsigned int height,
+                unsigned int stride, const movidius_rect* roi, int filter);
+
+    /**
+     * movidius_runInference(), movidius_submitInference(), movidius_waitInference() and
+     * movidius_pollInference() on this graph
+     */
+    int run(Tensor& output);
+    int submit(void* tag = NULL);
+    int wait(Tensor& output, void** tag = NULL);
+    int poll(Tensor& output, void** tag = NULL);
+
+private:
+    friend class Device;
+
+    int select();
+
+    /**
+     * Waits out the inferences in flight and releases, for when the object goes away
+     */
+    void discard();
+
+    std::shared_ptr<movidius_device> dev;
+    movidius_graph* graph;
+
+    /**
+     * mvnc handle of the graph when it was handed over, tells whether the slot still holds it
+     */
+    void* handle;
+};
+
+} // namespace movidius
+
+#endif // MOVIDIUS_RAII_H
@@ -0,0 +1,573 @@
+#include "movidius_simbackend.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define SIM_MAX_INFLIGHT 2
+
+/**
+ * Graph file layout checked by the NCSDK 1.x mvncAllocateGraph(): a fixed size header with
+ * the file version in it, followed by a 16 bit stage count and fixed size stage descriptors
+ */
+#define SIM_GRAPH_HEADER_LENGTH 264
+#define SIM_GRAPH_VERSION_OFFSET 36
+#define SIM_GRAPH_VERSION 2
+#define SIM_GRAPH_STAGE_LENGTH 227
+
+typedef std::chrono::steady_clock sim_clock;
+
+struct sim_device;
+
+struct sim_tensor
+{
+    std::vector<uint16_t> output;
+    void* userParam;
+
+    /**
+     * When the stick is done with this tensor, and how long it spent on it
+     */
+    sim_clock::time_point ready;
+    float inferenceMs;
+};
+
+struct sim_graph
+{
+    sim_device* device;
+
+    /**
+     * The tensors loaded and not fetched yet, oldest at queueStart
+     * The outputs are sized when the graph is allocated and swapped with result on fetching,
+     * so inferring allocates nothing
+     */
+    sim_tensor queue[SIM_MAX_INFLIGHT];
+    unsigned int queueStart;
+    unsigned int queueLength;
+
+    /**
+     * The last result handed out, stays valid until the next mvncGetResult() like on the real sticks
+     */
+    std::vector<uint16_t> result;
+
+    /**
+     * MVNC_TIME_TAKEN of the last result, one entry per stage
+     */
+    std::vector<float> timeTaken;
+
+    int dontBlock;
+};
+
+struct sim_device
+{
+    bool open;
+    bool gone;
+    unsigned int inferences;
+    std::vector<sim_graph*> graphs;
+
+    /**
+     * When the inference running on the stick finishes, the next one starts after that
+     */
+    sim_clock::time_point busyUntil;
+
+    /**
+     * Level from movidius_simSetThermalLevel(), or -1
+     */
+    int forcedThermalLevel;
+
+    /**
+     * Pending movidius_simInjectError() failures for each MOVIDIUS_SIM_* call
+     */
+    mvncStatus injectedStatus[MOVIDIUS_SIM_CALLS];
+    unsigned int injectedCount[MOVIDIUS_SIM_CALLS];
+};
+
+static std::mutex sim_mutex;
+static movidius_simconfig sim_config;
+static std::vector<sim_device*> sim_devices;
+static char sim_debugInfo[] = "simulated device";
+
+static void sim_freeDevices()
+{
+    for (size_t i = 0; i < sim_devices.size(); i++)
+    {
+        for (size_t g = 0; g < sim_devices[i]->graphs.size(); g++)
+            delete sim_devices[i]->graphs[g];
+        delete sim_devices[i];
+    }
+    sim_devices.clear();
+}
+
+/**
+ * Returns the injected failure for the call, or MVNC_OK. Call with sim_mutex held
+ */
+static mvncStatus sim_injected(sim_device* device, int call)
+{
+    if (device->injectedCount[call] == 0)
+        return MVNC_OK;
+
+    device->injectedCount[call]--;
+    if (device->injectedStatus[call] == MVNC_GONE)
+        device->gone = true;
+
+    return device->injectedStatus[call];
+}
+
+static int sim_thermalLevel(const sim_device* device)
+{
+    if (device->forcedThermalLevel >= 0)
+        return device->forcedThermalLevel;
+
+    if (sim_config.criticalAfter > 0 && device->inferences >= sim_config.criticalAfter)
+        return 2;
+
+    if (sim_config.throttleAfter > 0 && device->inferences >= sim_config.throttleAfter)
+        return 1;
+
+    return 0;
+}
+
+static float sim_inferenceMs(const sim_device* device)
+{
+    float slowdown = 1.0f;
+
+    switch (sim_thermalLevel(device))
+    {
+    case 1: slowdown = std::max(1.0f, sim_config.throttleSlowdown); break;
+    case 2: slowdown = std::max(1.0f, sim_config.criticalSlowdown); break;
+    default: break;
+    }
+
+    return sim_config.inferenceMs * slowdown;
+}
+
+/**
+ * Splits the inference time over the stages so that later stages take longer
+ */
+static void sim_fillTimeTaken(std::vector<float>& time_taken, float inference_ms)
+{
+    unsigned int stages = std::max(1u, sim_config.stages);
+    float total = stages * (stages + 1) / 2.0f;
+
+    time_taken.resize(stages);
+    for (unsigned int i = 0; i < stages; i++)
+        time_taken[i] = inference_ms * (i + 1) / total;
+}
+
+static bool sim_validGraph(const unsigned char* graph, unsigned int length)
+{
+    if (length < movidius_simGraphFileSize(1) || graph[SIM_GRAPH_VERSION_OFFSET] != SIM_GRAPH_VERSION)
+        return false;
+
+    unsigned int stages = graph[SIM_GRAPH_HEADER_LENGTH] | (graph[SIM_GRAPH_HEADER_LENGTH + 1] << 8);
+    return stages > 0 && length >= movidius_simGraphFileSize(stages);
+}
+
+static mvncStatus sim_getDeviceName(int index, char* name, unsigned int nameSize)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    if (index < 0 || (unsigned int)index >= sim_devices.size())
+        return MVNC_DEVICE_NOT_FOUND;
+
+    snprintf(name, nameSize, "sim-%d", index);
+    return MVNC_OK;
+}
+
+static mvncStatus sim_openDevice(const char* name, void** deviceHandle)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    unsigned int index;
+    if (sscanf(name, "sim-%u", &index) != 1 || index >= sim_devices.size())
+        return MVNC_DEVICE_NOT_FOUND;
+
+    sim_device* device = sim_devices[index];
+    if (device->gone)
+        return MVNC_GONE;
+    if (device->open)
+        return MVNC_BUSY;
+
+    device->open = true;
+    *deviceHandle = device;
+    return MVNC_OK;
+}
+
+static mvncStatus sim_closeDevice(void* deviceHandle)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_device* device = (sim_device*)deviceHandle;
+    for (size_t g = 0; g < device->graphs.size(); g++)
+        delete device->graphs[g];
+    device->graphs.clear();
+    device->open = false;
+    return MVNC_OK;
+}
+
+static mvncStatus sim_allocateGraph(void* deviceHandle, void** graphHandle, const void* graphFile,
+                                    unsigned int graphFileLength)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_device* device = (sim_device*)deviceHandle;
+    if (device->gone)
+        return MVNC_GONE;
+
+    mvncStatus status = sim_injected(device, MOVIDIUS_SIM_ALLOCATEGRAPH);
+    if (status != MVNC_OK)
+        return status;
+
+    if (graphFile == NULL || graphFileLength == 0)
+        return MVNC_INVALID_PARAMETERS;
+
+    if (sim_config.validateGraphs && !sim_validGraph((const unsigned char*)graphFile, graphFileLength))
+        return MVNC_UNSUPPORTED_GRAPH_FILE;
+
+    sim_graph* graph = new sim_graph;
+    graph->device = device;
+    graph->queueStart = 0;
+    graph->queueLength = 0;
+    for (unsigned int i = 0; i < SIM_MAX_INFLIGHT; i++)
+        graph->queue[i].output.resize(sim_config.outputs);
+    graph->result.resize(sim_config.outputs);
+    graph->dontBlock = 0;
+    sim_fillTimeTaken(graph->timeTaken, 0.0f);
+    device->graphs.push_back(graph);
+
+    *graphHandle = graph;
+    return MVNC_OK;
+}
+
+static mvncStatus sim_deallocateGraph(void* graphHandle)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_graph* graph = (sim_graph*)graphHandle;
+    sim_device* device = graph->device;
+    bool gone = device->gone;
+
+    device->graphs.erase(std::find(device->graphs.begin(), device->graphs.end(), graph));
+    delete graph;
+
+    return gone ? MVNC_GONE : MVNC_OK;
+}
+
+// the log level is the only global option, the simulated sticks have nothing to log
+static mvncStatus sim_setGlobalOption(int, const void*, unsigned int)
+{
+    return MVNC_OK;
+}
+
+static mvncStatus sim_setGraphOption(void* graphHandle, int option, const void* data, unsigned int dataLength)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_graph* graph = (sim_graph*)graphHandle;
+    if (graph->device->gone)
+        return MVNC_GONE;
+
+    if (option != MVNC_DONT_BLOCK || dataLength != sizeof(int))
+        return MVNC_INVALID_PARAMETERS;
+
+    graph->dontBlock = *(const int*)data;
+    return MVNC_OK;
+}
+
+static mvncStatus sim_getGraphOption(void* graphHandle, int option, void* data, unsigned int* dataLength)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_graph* graph = (sim_graph*)graphHandle;
+    if (graph->device->gone)
+        return MVNC_GONE;
+
+    switch (option)
+    {
+    case MVNC_TIME_TAKEN:
+        *(float**)data = &graph->timeTaken[0];
+        *dataLength = graph->timeTaken.size() * sizeof(float);
+        return MVNC_OK;
+    case MVNC_DEBUG_INFO:
+        *(char**)data = sim_debugInfo;
+        *dataLength = sizeof(sim_debugInfo);
+        return MVNC_OK;
+    default:
+        return MVNC_INVALID_PARAMETERS;
+    }
+}
+
+static mvncStatus sim_getDeviceOption(void* deviceHandle, int option, void* data, unsigned int* dataLength)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_device* device = (sim_device*)deviceHandle;
+    if (device->gone)
+        return MVNC_GONE;
+
+    if (option != MVNC_THERMAL_THROTTLING_LEVEL)
+        return MVNC_INVALID_PARAMETERS;
+
+    *(int*)data = sim_thermalLevel(device);
+    *dataLength = sizeof(int);
+    return MVNC_OK;
+}
+
+static mvncStatus sim_loadTensor(void* graphHandle, const void* inputTensor, unsigned int inputTensorLength,
+                                 void* userParam)
+{
+    sim_graph* graph = (sim_graph*)graphHandle;
+
+    {
+        std::lock_guard<std::mutex> lock(sim_mutex);
+
+        if (graph->device->gone)
+            return MVNC_GONE;
+
+        mvncStatus status = sim_injected(graph->device, MOVIDIUS_SIM_LOADTENSOR);
+        if (status != MVNC_OK)
+            return status;
+
+        // the real sticks refuse a third tensor until a result has been fetched
+        if (graph->queueLength >= SIM_MAX_INFLIGHT)
+            return MVNC_BUSY;
+    }
+
+    // sending the tensor over USB
+    if (sim_config.transferMs > 0)
+        std::this_thread::sleep_for(std::chrono::duration<float, std::milli>(sim_config.transferMs));
+
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_device* device = graph->device;
+    if (device->gone)
+        return MVNC_GONE;
+
+    // another thread may have loaded a tensor while this one was sending
+    if (graph->queueLength >= SIM_MAX_INFLIGHT)
+        return MVNC_BUSY;
+
+    const uint16_t* input = (const uint16_t*)inputTensor;
+    unsigned int count = inputTensorLength / sizeof(uint16_t);
+
+    sim_tensor& tensor = graph->queue[(graph->queueStart + graph->queueLength) % SIM_MAX_INFLIGHT];
+    std::fill(tensor.output.begin(), tensor.output.end(), 0);
+    std::copy(input, input + std::min(count, sim_config.outputs), tensor.output.begin());
+    tensor.userParam = userParam;
+    tensor.inferenceMs = sim_inferenceMs(device);
+
+    sim_clock::time_point start = std::max(sim_clock::now(), device->busyUntil);
+    tensor.ready = start + std::chrono::duration_cast<sim_clock::duration>(
+        std::chrono::duration<float, std::milli>(tensor.inferenceMs));
+    device->busyUntil = tensor.ready;
+
+    graph->queueLength++;
+    device->inferences++;
+    return MVNC_OK;
+}
+
+static mvncStatus sim_getResult(void* graphHandle, void** outputData, unsigned int* outputDataLength,
+                                void** userParam)
+{
+    sim_graph* graph = (sim_graph*)graphHandle;
+    std::unique_lock<std::mutex> lock(sim_mutex);
+
+    for (;;)
+    {
+        if (graph->device->gone)
+            return MVNC_GONE;
+
+        if (graph->queueLength == 0)
+            return MVNC_NO_DATA;
+
+        sim_clock::time_point ready = graph->queue[graph->queueStart].ready;
+        if (sim_clock::now() >= ready)
+            break;
+
+        if (graph->dontBlock)
+            return MVNC_BUSY;
+
+        lock.unlock();
+        std::this_thread::sleep_until(ready);
+        lock.lock();
+    }
+
+    mvncStatus status = sim_injected(graph->device, MOVIDIUS_SIM_GETRESULT);
+    if (status == MVNC_BUSY || status == MVNC_NO_DATA)
+        return status;
+
+    sim_tensor& tensor = graph->queue[graph->queueStart];
+    graph->result.swap(tensor.output);
+    *userParam = tensor.userParam;
+    sim_fillTimeTaken(graph->timeTaken, tensor.inferenceMs);
+    graph->queueStart = (graph->queueStart + 1) % SIM_MAX_INFLIGHT;
+    graph->queueLength--;
+
+    if (status != MVNC_OK)
+        return status;
+
+    *outputData = graph->result.empty() ? NULL : &graph->result[0];
+    *outputDataLength = graph->result.size() * sizeof(uint16_t);
+    return MVNC_OK;
+}
+
+static const movidius_backend sim_backend =
+{
+    "simulated",
+    sim_getDeviceName,
+    sim_openDevice,
+    sim_closeDevice,
+    sim_allocateGraph,
+    sim_deallocateGraph,
+    sim_setGlobalOption,
+    sim_setGraphOption,
+    sim_getGraphOption,
+    sim_getDeviceOption,
+    sim_loadTensor,
+    sim_getResult
+};
+
+const movidius_backend* movidius_simBackend(const movidius_simconfig* config)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    sim_freeDevices();
+    sim_config = *config;
+
+    for (unsigned int i = 0; i < config->devices; i++)
+    {
+        sim_device* device = new sim_device;
+        device->open = false;
+        device->gone = false;
+        device->inferences = 0;
+        device->forcedThermalLevel = -1;
+        for (int call = 0; call < MOVIDIUS_SIM_CALLS; call++)
+        {
+            device->injectedStatus[call] = MVNC_OK;
+            device->injectedCount[call] = 0;
+        }
+        sim_devices.push_back(device);
+    }
+
+    return &sim_backend;
+}
+
+void movidius_simUnplug(unsigned int index)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    if (index < sim_devices.size())
+        sim_devices[index]->gone = true;
+}
+
+void movidius_simInjectError(unsigned int index, int call, mvncStatus status, unsigned int count)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    if (index >= sim_devices.size() || call < 0 || call >= MOVIDIUS_SIM_CALLS)
+        return;
+
+    sim_devices[index]->injectedStatus[call] = status;
+    sim_devices[index]->injectedCount[call] = count;
+}
+
+void movidius_simSetThermalLevel(unsigned int index, int level)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    if (index < sim_devices.size())
+        sim_devices[index]->forcedThermalLevel = level;
+}
+
+unsigned int movidius_simInferences(unsigned int index)
+{
+    std::lock_guard<std::mutex> lock(sim_mutex);
+
+    return index < sim_devices.size() ? sim_devices[index]->inferences : 0;
+}
+
+unsigned int movidius_simGraphFileSize(unsigned int stages)
+{
+    return SIM_GRAPH_HEADER_LENGTH + 2 + stages * SIM_GRAPH_STAGE_LENGTH;
+}
+
+int movidius_simGraphFile(unsigned char* graph, unsigned int length, unsigned int stages)
+{
+    if (stages == 0 || stages > 0xffff || length < movidius_simGraphFileSize(stages))
+        return -1;
+
+    memset(graph, 0, length);
+    graph[SIM_GRAPH_VERSION_OFFSET] = SIM_GRAPH_VERSION;
+    graph[SIM_GRAPH_HEADER_LENGTH] = stages & 0xff;
+    graph[SIM_GRAPH_HEADER_LENGTH + 1] = stages >> 8;
+    return 0;
+}
+
+static const char* sim_networkFiles[] = { "graph", "categories.txt", "stat.txt", "inputsize.txt" };
+
+/**
+ * Opens dir/name for writing, printing why if that fails
+ */
+static FILE* sim_createFile(const char* dir, const char* name)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL)
+        fprintf(stderr, "movidius: Cannot write file: %s\n", path);
+    return fp;
+}
+
+int movidius_simWriteNetwork(const char* dir, unsigned int categories, unsigned int input_size, unsigned int stages)
+{
+    std::vector<unsigned char> graph(movidius_simGraphFileSize(stages));
+    if (categories == 0 || input_size == 0 || movidius_simGraphFile(graph.data(), graph.size(), stages) != 0)
+        return -1;
+
+    FILE* fp = sim_createFile(dir, "graph");
+    if (fp == NULL)
+        return -1;
+    size_t written = fwrite(graph.data(), 1, graph.size(), fp);
+    if (fclose(fp) != 0 || written != graph.size())
+        return -1;
+
+    fp = sim_createFile(dir, "categories.txt");
+    if (fp == NULL)
+        return -1;
+    fprintf(fp, "classes\n");
+    for (unsigned int i = 0; i < categories; i++)
+        fprintf(fp, "class %u\n", i);
+    if (fclose(fp) != 0)
+        return -1;
+
+    fp = sim_createFile(dir, "stat.txt");
+    if (fp == NULL)
+        return -1;
+    fprintf(fp, "0.5 0.5 0.5\n0.25 0.25 0.25\n");
+    if (fclose(fp) != 0)
+        return -1;
+
+    fp = sim_createFile(dir, "inputsize.txt");
+    if (fp == NULL)
+        return -1;
+    fprintf(fp, "%u\n", input_size);
+    return fclose(fp) != 0 ? -1 : 0;
+}
+
+void movidius_simRemoveNetwork(const char* dir)
+{
+    char path[1024];
+    for (size_t i = 0; i < sizeof(sim_networkFiles) / sizeof(sim_networkFiles[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, sim_networkFiles[i]);
+        unlink(path);
+    }
+
+    rmdir(dir);
+}
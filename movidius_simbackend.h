@@ -0,0 +1,129 @@
+#ifndef MOVIDIUS_SIMBACKEND_H
+#define MOVIDIUS_SIMBACKEND_H
+
+#include "movidius_backend.h"
+
+/**
+ * Fake neural compute sticks for running and benchmarking the movidius_* functions without hardware
+ * Every stick queues up to two tensors per graph like the real ones do and runs one inference at
+ * a time, each taking a configurable amount of time. Everything is driven by the configuration
+ * and the calls made, so runs are repeatable
+ */
+typedef struct
+{
+    /**
+     * Number of sticks mvncGetDeviceName() lists
+     */
+    unsigned int devices;
+
+    /**
+     * Half floats in every result. The result is a copy of the start of the input tensor,
+     * so tests can tell which image a result belongs to
+     */
+    unsigned int outputs;
+
+    /**
+     * Milliseconds every inference takes on the stick, 0 finishes them right away
+     */
+    float inferenceMs;
+
+    /**
+     * Milliseconds mvncLoadTensor() blocks for while sending the tensor over
+     */
+    float transferMs;
+
+    /**
+     * Entries in the MVNC_TIME_TAKEN array, 0 is the same as 1
+     * Later stages take longer, together they add up to the inference time
+     */
+    unsigned int stages;
+
+    /**
+     * After this many inferences the stick reports thermal throttling level 1, 0 never does
+     */
+    unsigned int throttleAfter;
+
+    /**
+     * After this many inferences the stick reports level 2, 0 never does
+     */
+    unsigned int criticalAfter;
+
+    /**
+     * Inference time multipliers at throttling levels 1 and 2, values below 1 are taken as 1
+     */
+    float throttleSlowdown;
+    float criticalSlowdown;
+
+    /**
+     * Non-zero makes mvncAllocateGraph() check the graph header like the NCSDK does,
+     * see movidius_simGraphFile() for making graph files that pass
+     */
+    int validateGraphs;
+} movidius_simconfig;
+
+/**
+ * mvnc calls movidius_simInjectError() can make fail
+ */
+enum
+{
+    MOVIDIUS_SIM_ALLOCATEGRAPH = 0,
+    MOVIDIUS_SIM_LOADTENSOR = 1,
+    MOVIDIUS_SIM_GETRESULT = 2,
+    MOVIDIUS_SIM_CALLS = 3
+};
+
+/**
+ * Forgets all previous simulated sticks, creates new ones as configured and returns the
+ * table to hand to movidius_setBackend()
+ */
+extern const movidius_backend* movidius_simBackend(const movidius_simconfig* config);
+
+/**
+ * Makes the stick at index behave like it was pulled out: every call on it, and on its
+ * graphs, fails with MVNC_GONE from now on
+ */
+extern void movidius_simUnplug(unsigned int index);
+
+/**
+ * Makes the next count calls of the given MOVIDIUS_SIM_* kind on the stick at index fail with status
+ * A failing mvncGetResult() loses the tensor it would have returned, except for MVNC_BUSY and
+ * MVNC_NO_DATA. MVNC_GONE unplugs the stick
+ */
+extern void movidius_simInjectError(unsigned int index, int call, mvncStatus status, unsigned int count);
+
+/**
+ * Pins the thermal throttling level the stick at index reports, -1 goes back to counting inferences
+ */
+extern void movidius_simSetThermalLevel(unsigned int index, int level);
+
+/**
+ * Number of tensors the stick at index has accepted so far
+ */
+extern unsigned int movidius_simInferences(unsigned int index);
+
+/**
+ * Size of the smallest graph file movidius_simGraphFile() can make
+ */
+extern unsigned int movidius_simGraphFileSize(unsigned int stages);
+
+/**
+ * Writes a graph file with the given amount of stages that passes the header checks, the
+ * rest of the contents mean nothing. length must be at least movidius_simGraphFileSize()
+ * Returns 0 on success
+ */
+extern int movidius_simGraphFile(unsigned char* graph, unsigned int length, unsigned int stages);
+
+/**
+ * Writes a network folder the simulated sticks run into the existing directory dir: a graph
+ * with the given amount of stages, categories.txt with that many categories, stat.txt and inputsize.txt
+ * Returns 0 on success
+ */
+extern int movidius_simWriteNetwork(const char* dir, unsigned int categories, unsigned int input_size,
+                                    unsigned int stages);
+
+/**
+ * Deletes the files movidius_simWriteNetwork() wrote to dir, and dir itself if it is empty then
+ */
+extern void movidius_simRemoveNetwork(const char* dir);
+
+#endif // MOVIDIUS_SIMBACKEND_H
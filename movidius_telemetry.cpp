@@ -0,0 +1,332 @@
+#include "movidius_telemetry.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include "movidius_backend.h"
+#include "movidius_profile.h"
+
+struct telemetry_state
+{
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread monitor;
+    bool stopping;
+
+    int mode;
+    unsigned int every;
+    unsigned int intervalMs;
+
+    // only touched by the thread collecting results
+    unsigned int resultsSinceSample;
+    bool sampled;
+    std::chrono::steady_clock::time_point lastSample;
+
+    // when the level was last queried, and since when it has had its current value
+    std::chrono::steady_clock::time_point lastLevelQuery;
+    std::chrono::steady_clock::time_point levelSince;
+
+    movidius_telemetry latest;
+};
+
+static telemetry_state* telemetry_get(movidius_device* dev)
+{
+    if (dev->telemetry == NULL)
+    {
+        telemetry_state* state = new telemetry_state;
+        state->stopping = false;
+        state->mode = MOVIDIUS_TELEMETRY_INTERVAL;
+        state->every = 1;
+        state->intervalMs = 1000;
+        state->resultsSinceSample = 0;
+        state->sampled = false;
+        memset(&state->latest, 0, sizeof(state->latest));
+        state->latest.throttlingLevel = -1;
+        dev->telemetry = state;
+        movidius_countAllocation();
+    }
+
+    return (telemetry_state*)dev->telemetry;
+}
+
+/**
+ * Adds the time since the level last changed to its total in telemetry
+ */
+static void telemetry_addLevelTime(const telemetry_state* state, std::chrono::steady_clock::time_point now,
+                                   movidius_telemetry* telemetry)
+{
+    int level = state->latest.throttlingLevel;
+    if (level >= 0 && level < 3)
+        telemetry->levelMs[level] += std::chrono::duration<double, std::milli>(now - state->levelSince).count();
+}
+
+/**
+ * Stores a new throttling level, warning when it changes. state->mutex must be held
+ */
+static void telemetry_setLevel(telemetry_state* state, int level)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    state->lastLevelQuery = now;
+
+    if (level != state->latest.throttlingLevel)
+    {
+        telemetry_addLevelTime(state, now, &state->latest);
+        state->levelSince = now;
+
+        if (level == 1)
+            fprintf(stderr, "movidius: ** NCS temperature high - thermal throttling initiated **\n");
+        else if (level == 2)
+        {
+            fprintf(stderr, "movidius: *********************** WARNING *************************\n");
+            fprintf(stderr, "movidius: * NCS temperature critical                              *\n");
+            fprintf(stderr, "movidius: * Aggressive thermal throttling initiated               *\n");
+            fprintf(stderr, "movidius: * Continued use may result in device damage             *\n");
+            fprintf(stderr, "movidius: *********************************************************\n");
+        }
+    }
+
+    state->latest.throttlingLevel = level;
+}
+
+static int telemetry_queryLevel(telemetry_state* state, void* device_handle)
+{
+    int throttling = 0;
+    unsigned int throttlinglen = sizeof(throttling);
+
+    int rc = movidius_getBackend()->getDeviceOption(device_handle, MVNC_THERMAL_THROTTLING_LEVEL,
+                                                    &throttling, &throttlinglen);
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (rc != MVNC_OK)
+    {
+        fprintf(stderr, "movidius: GetDeviceOption failed for MVNC_THERMAL_THROTTLING_LEVEL, rc=%d\n", rc);
+        state->latest.failures++;
+        return rc;
+    }
+
+    telemetry_setLevel(state, throttling);
+    return 0;
+}
+
+static void telemetry_monitor(telemetry_state* state, void* device_handle)
+{
+    std::unique_lock<std::mutex> lock(state->mutex);
+
+    while (!state->stopping)
+    {
+        lock.unlock();
+        int rc = telemetry_queryLevel(state, device_handle);
+        lock.lock();
+
+        if (rc == MVNC_GONE)
+            return;
+
+        state->wake.wait_for(lock, std::chrono::milliseconds(state->intervalMs), [&] { return state->stopping; });
+    }
+}
+
+static void telemetry_stopMonitor(telemetry_state* state)
+{
+    if (!state->monitor.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->stopping = true;
+    }
+    state->wake.notify_all();
+    state->monitor.join();
+    state->stopping = false;
+}
+
+int movidius_setTelemetry(movidius_device* dev, int mode, unsigned int every, unsigned int interval_ms)
+{
+    if (mode < MOVIDIUS_TELEMETRY_OFF || mode > MOVIDIUS_TELEMETRY_BACKGROUND ||
+        (mode == MOVIDIUS_TELEMETRY_EVERY && every == 0) || (mode == MOVIDIUS_TELEMETRY_BACKGROUND && interval_ms == 0))
+    {
+        fprintf(stderr, "movidius: invalid telemetry policy %d, every %u, interval %u ms\n", mode, every, interval_ms);
+        return INVALID_INPUT_DATA;
+    }
+
+    telemetry_state* state = telemetry_get(dev);
+    telemetry_stopMonitor(state);
+
+    state->mode = mode;
+    state->every = every;
+    state->intervalMs = interval_ms;
+    state->resultsSinceSample = 0;
+
+    if (mode != MOVIDIUS_TELEMETRY_BACKGROUND)
+        return 0;
+
+    if (dev->dev_handle == NULL)
+    {
+        fprintf(stderr, "movidius: cannot monitor null device\n");
+        return INVALID_DEV_HANDLE;
+    }
+
+    try
+    {
+        state->monitor = std::thread(telemetry_monitor, state, dev->dev_handle);
+    }
+    catch (const std::system_error& e)
+    {
+        fprintf(stderr, "movidius: failed starting telemetry thread: %s, sampling after results\n", e.what());
+        state->mode = MOVIDIUS_TELEMETRY_INTERVAL;
+    }
+
+    return 0;
+}
+
+void movidius_getTelemetry(movidius_device* dev, movidius_telemetry* telemetry)
+{
+    telemetry_state* state = telemetry_get(dev);
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    *telemetry = state->latest;
+    telemetry_addLevelTime(state, std::chrono::steady_clock::now(), telemetry);
+}
+
+int movidius_throttlingLevel(movidius_device* dev)
+{
+    telemetry_state* state = telemetry_get(dev);
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->latest.throttlingLevel;
+}
+
+int movidius_refreshThrottlingLevel(movidius_device* dev)
+{
+    telemetry_state* state = telemetry_get(dev);
+    int mode;
+    bool stale;
+
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        unsigned int interval_ms = state->mode == MOVIDIUS_TELEMETRY_EVERY ? 1000 : state->intervalMs;
+        mode = state->mode;
+        stale = state->latest.throttlingLevel < 0 ||
+                std::chrono::steady_clock::now() - state->lastLevelQuery >= std::chrono::milliseconds(interval_ms);
+    }
+
+    if (stale && mode != MOVIDIUS_TELEMETRY_OFF && mode != MOVIDIUS_TELEMETRY_BACKGROUND && dev->dev_handle != NULL)
+    {
+        int rc = telemetry_queryLevel(state, dev->dev_handle);
+        if (rc == MVNC_GONE && !dev->gone)
+        {
+            fprintf(stderr, "movidius: device %s is gone, excluding it\n", dev->dev_name);
+            dev->gone = 1;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->latest.throttlingLevel;
+}
+
+/**
+ * The queries of movidius_sampleTelemetry() once it has decided to make them
+ */
+static int telemetry_sample(telemetry_state* state, movidius_device* dev, movidius_graph* graph,
+                            unsigned long long submitted_us, bool due)
+{
+    float* timetaken = NULL;
+    unsigned int timetakenlen = 0;
+
+    int rc = movidius_getBackend()->getGraphOption(graph->handle, MVNC_TIME_TAKEN, (void**)&timetaken, &timetakenlen);
+    if (rc != MVNC_OK)
+    {
+        fprintf(stderr, "movidius: GetGraphOption failed for getting MVNC_TIMETAKEN, rc=%d\n", rc);
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->latest.failures++;
+        return rc;
+    }
+
+    unsigned int layers = std::min<unsigned int>(timetakenlen / sizeof(*timetaken), MOVIDIUS_MAX_LAYERS);
+
+    if (dev->profiling)
+    {
+        int level;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            level = state->latest.throttlingLevel;
+        }
+        movidius_profileResult(graph, timetaken, layers, level, submitted_us);
+    }
+
+    if (!due)
+        return 0;
+
+    float sum = 0;
+    for (unsigned int i = 0; i < layers; i++)
+        sum += timetaken[i];
+
+    if (sum > 100)
+        fprintf(stderr, "movidius: Inference time was long: %f ms\n", sum);
+
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        memcpy(state->latest.layerMs, timetaken, layers * sizeof(*timetaken));
+        state->latest.numLayers = layers;
+        state->latest.inferenceMs = sum;
+        state->latest.samples++;
+    }
+
+    if (state->mode == MOVIDIUS_TELEMETRY_BACKGROUND)
+        return 0;
+
+    return telemetry_queryLevel(state, dev->dev_handle);
+}
+
+int movidius_sampleTelemetry(movidius_device* dev, movidius_graph* graph, unsigned long long submitted_us)
+{
+    telemetry_state* state = telemetry_get(dev);
+    std::chrono::steady_clock::time_point now;
+    bool due = false;
+
+    switch (state->mode)
+    {
+    case MOVIDIUS_TELEMETRY_EVERY:
+        if (++state->resultsSinceSample >= state->every)
+        {
+            state->resultsSinceSample = 0;
+            due = true;
+        }
+        break;
+
+    case MOVIDIUS_TELEMETRY_INTERVAL:
+    case MOVIDIUS_TELEMETRY_BACKGROUND:
+        now = std::chrono::steady_clock::now();
+        if (!state->sampled || now - state->lastSample >= std::chrono::milliseconds(state->intervalMs))
+        {
+            state->lastSample = now;
+            state->sampled = true;
+            due = true;
+        }
+        break;
+    }
+
+    if (!due && !dev->profiling)
+        return 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int rc = telemetry_sample(state, dev, graph, submitted_us, due);
+    std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->latest.queryMs += took.count();
+    return rc;
+}
+
+void movidius_destroyTelemetry(movidius_device* dev)
+{
+    telemetry_state* state = (telemetry_state*)dev->telemetry;
+    if (state == NULL)
+        return;
+
+    telemetry_stopMonitor(state);
+    delete state;
+    dev->telemetry = NULL;
+}
@@ -0,0 +1,129 @@
+#ifndef MOVIDIUS_TELEMETRY_H
+#define MOVIDIUS_TELEMETRY_H
+
+#include "movidiusdevice.h"
+
+/**
+ * Thermal throttling level and per layer timings of a device, sampled according to a policy
+ * instead of after every inference. Each sample costs one or two USB round trips
+ */
+
+/**
+ * Most layer timings kept per sample, longer MVNC_TIME_TAKEN lists are cut off
+ */
+#define MOVIDIUS_MAX_LAYERS 512
+
+/**
+ * When telemetry is sampled, see movidius_setTelemetry()
+ */
+enum
+{
+    /**
+     * Never query, nothing but LoadTensor and GetResult is sent to the device
+     */
+    MOVIDIUS_TELEMETRY_OFF = 0,
+
+    /**
+     * Query after every n:th result. Every result was queried before these policies existed
+     */
+    MOVIDIUS_TELEMETRY_EVERY = 1,
+
+    /**
+     * Query after the first result once the interval has passed since the last sample. The default
+     */
+    MOVIDIUS_TELEMETRY_INTERVAL = 2,
+
+    /**
+     * A monitor thread queries the throttling level every interval, layer timings are sampled
+     * like MOVIDIUS_TELEMETRY_INTERVAL as they only exist right after a result
+     */
+    MOVIDIUS_TELEMETRY_BACKGROUND = 3
+};
+
+/**
+ * The latest sampled values
+ */
+typedef struct
+{
+    /**
+     * MVNC_THERMAL_THROTTLING_LEVEL: 0 normal, 1 throttling, 2 critical. -1 until first sampled
+     */
+    int throttlingLevel;
+
+    /**
+     * Sum of layerMs
+     */
+    float inferenceMs;
+
+    /**
+     * Number of entries in layerMs, 0 until first sampled
+     */
+    unsigned int numLayers;
+
+    /**
+     * MVNC_TIME_TAKEN of the sampled inference, milliseconds per layer
+     */
+    float layerMs[MOVIDIUS_MAX_LAYERS];
+
+    /**
+     * Samples taken so far
+     */
+    unsigned long samples;
+
+    /**
+     * Queries that failed. A failed query never fails the inference it follows
+     */
+    unsigned long failures;
+
+    /**
+     * Milliseconds the queries after results have taken in total, profiling included
+     */
+    double queryMs;
+
+    /**
+     * Milliseconds spent at throttling level 0, 1 and 2 since the level was first sampled,
+     * as far as the samples tell
+     */
+    double levelMs[3];
+} movidius_telemetry;
+
+/**
+ * Sets the MOVIDIUS_TELEMETRY_* policy of a device
+ * @param every: For MOVIDIUS_TELEMETRY_EVERY, sample after every this many results
+ * @param interval_ms: For MOVIDIUS_TELEMETRY_INTERVAL and MOVIDIUS_TELEMETRY_BACKGROUND
+ * Returns 0 on success
+ */
+extern int movidius_setTelemetry(movidius_device* dev, int mode, unsigned int every, unsigned int interval_ms);
+
+/**
+ * Copies the latest sampled values of a device
+ */
+extern void movidius_getTelemetry(movidius_device* dev, movidius_telemetry* telemetry);
+
+/**
+ * The cached throttling level of a device, -1 if not known. Never talks to the device
+ */
+extern int movidius_throttlingLevel(movidius_device* dev);
+
+/**
+ * Like movidius_throttlingLevel(), but if the cached level is older than the telemetry
+ * interval (a second for the MOVIDIUS_TELEMETRY_EVERY policy) it is queried first, so a stick
+ * that gets no work because it is too hot is still noticed when it cools down
+ * Never queries with MOVIDIUS_TELEMETRY_OFF, or MOVIDIUS_TELEMETRY_BACKGROUND which keeps it fresh anyway
+ */
+extern int movidius_refreshThrottlingLevel(movidius_device* dev);
+
+/**
+ * Called by the device after every result of graph, samples if the policy says so
+ * While dev->profiling is set the layer timings are fetched after every result and
+ * recorded with movidius_profileResult(), whatever the policy
+ * Returns the failing mvnc status, or 0
+ */
+extern int movidius_sampleTelemetry(movidius_device* dev, movidius_graph* graph, unsigned long long submitted_us);
+
+/**
+ * Stops the monitor thread and frees the telemetry state, done by movidius_closeDevice()
+ */
+extern void movidius_destroyTelemetry(movidius_device* dev);
+
+#endif // MOVIDIUS_TELEMETRY_H
@@ -0,0 +1,182 @@
+#include "movidius_threadpool.h"
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * One movidius_parallelFor() call. Lives on the stack of the caller, which waits until
+ * no worker references it anymore before returning
+ */
+struct parallel_job
+{
+    movidius_parallel_fn fn;
+    void* arg;
+    unsigned int count;
+    unsigned int chunks;
+    std::atomic<unsigned int> nextChunk;
+    unsigned int pendingChunks;
+    unsigned int activeWorkers;
+};
+
+struct movidius_threadpool
+{
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    parallel_job* job;
+    unsigned long generation;
+    bool stopping;
+};
+
+static void pool_runChunks(movidius_threadpool* pool, parallel_job* job)
+{
+    for (;;)
+    {
+        unsigned int chunk = job->nextChunk.fetch_add(1);
+        if (chunk >= job->chunks)
+            break;
+
+        unsigned int begin = (unsigned int)((unsigned long long)job->count * chunk / job->chunks);
+        unsigned int end = (unsigned int)((unsigned long long)job->count * (chunk + 1) / job->chunks);
+        if (begin < end)
+            job->fn(begin, end, chunk, job->arg);
+
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        if (--job->pendingChunks == 0)
+            pool->finished.notify_all();
+    }
+}
+
+static void pool_worker(movidius_threadpool* pool)
+{
+    unsigned long seen = 0;
+
+    for (;;)
+    {
+        parallel_job* job;
+        {
+            std::unique_lock<std::mutex> lock(pool->mutex);
+            pool->wake.wait(lock, [&] { return pool->stopping || (pool->job != NULL && pool->generation != seen); });
+
+            if (pool->stopping)
+                return;
+
+            seen = pool->generation;
+            job = pool->job;
+            job->activeWorkers++;
+        }
+
+        pool_runChunks(pool, job);
+
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        if (--job->activeWorkers == 0)
+            pool->finished.notify_all();
+    }
+}
+
+static void pool_pin(std::thread& thread, int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    int rc = pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+    if (rc != 0)
+        fprintf(stderr, "movidius: failed pinning preprocessing thread to cpu %d: %d\n", cpu, rc);
+#else
+    (void)thread;
+    fprintf(stderr, "movidius: cpu affinity not supported on this platform, ignoring cpu %d\n", cpu);
+#endif
+}
+
+movidius_threadpool* movidius_createThreadPool(unsigned int threads, const int* cpus, unsigned int ncpus)
+{
+    movidius_threadpool* pool = new movidius_threadpool;
+    pool->job = NULL;
+    pool->generation = 0;
+    pool->stopping = false;
+
+    for (unsigned int i = 0; i < threads; i++)
+    {
+        try
+        {
+            pool->workers.push_back(std::thread(pool_worker, pool));
+        }
+        catch (const std::system_error& e)
+        {
+            fprintf(stderr, "movidius: failed starting preprocessing thread %d: %s\n", i, e.what());
+            movidius_destroyThreadPool(pool);
+            return NULL;
+        }
+
+        if (cpus != NULL && ncpus > 0)
+            pool_pin(pool->workers.back(), cpus[i % ncpus]);
+    }
+
+    return pool;
+}
+
+void movidius_destroyThreadPool(movidius_threadpool* pool)
+{
+    if (pool == NULL)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->stopping = true;
+    }
+    pool->wake.notify_all();
+
+    for (size_t i = 0; i < pool->workers.size(); i++)
+        pool->workers[i].join();
+
+    delete pool;
+}
+
+unsigned int movidius_threadPoolChunks(const movidius_threadpool* pool)
+{
+    return pool == NULL ? 1 : (unsigned int)pool->workers.size() + 1;
+}
+
+void movidius_parallelFor(movidius_threadpool* pool, unsigned int count, movidius_parallel_fn fn, void* arg)
+{
+    if (pool == NULL || pool->workers.empty() || count < 2)
+    {
+        if (count > 0)
+            fn(0, count, 0, arg);
+        return;
+    }
+
+    parallel_job job;
+    job.fn = fn;
+    job.arg = arg;
+    job.count = count;
+    job.chunks = movidius_threadPoolChunks(pool);
+    job.nextChunk = 0;
+    job.pendingChunks = job.chunks;
+    job.activeWorkers = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->job = &job;
+        pool->generation++;
+    }
+    pool->wake.notify_all();
+
+    pool_runChunks(pool, &job);
+
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    pool->finished.wait(lock, [&] { return job.pendingChunks == 0 && job.activeWorkers == 0; });
+    pool->job = NULL;
+}
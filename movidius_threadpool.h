@@ -0,0 +1,44 @@
+#ifndef MOVIDIUS_THREADPOOL_H
+#define MOVIDIUS_THREADPOOL_H
+
+/**
+ * A fixed set of worker threads for splitting host side work, like image preprocessing,
+ * into bands that are processed in parallel
+ */
+struct movidius_threadpool;
+
+/**
+ * Work function for movidius_parallelFor(), called for the items [begin, end)
+ * chunk is unique among the calls running at the same time and smaller than
+ * movidius_threadPoolChunks(), so it can be used to pick per thread scratch buffers
+ */
+typedef void (*movidius_parallel_fn)(unsigned int begin, unsigned int end, unsigned int chunk, void* arg);
+
+/**
+ * Starts the given amount of worker threads
+ * If cpus is not NULL, worker i is pinned to cpu cpus[i % ncpus]. Listing the cores of one
+ * NUMA node keeps the workers next to the memory of the frames they process
+ * Returns NULL if the threads could not be started
+ */
+extern movidius_threadpool* movidius_createThreadPool(unsigned int threads, const int* cpus, unsigned int ncpus);
+
+/**
+ * Stops and joins the worker threads
+ */
+extern void movidius_destroyThreadPool(movidius_threadpool* pool);
+
+/**
+ * Number of chunks movidius_parallelFor() splits work into, the workers plus the calling thread
+ * Returns 1 for a NULL pool
+ */
+extern unsigned int movidius_threadPoolChunks(const movidius_threadpool* pool);
+
+/**
+ * Splits [0, count) into movidius_threadPoolChunks() contiguous chunks and runs fn for each of them
+ * The calling thread works on chunks too, the call returns once all of them are done
+ * With a NULL pool fn is simply called once for the whole range
+ * Only one movidius_parallelFor() may run on a pool at a time
+ */
+extern void movidius_parallelFor(movidius_threadpool* pool, unsigned int count, movidius_parallel_fn fn, void* arg);
+
+#endif // MOVIDIUS_THREADPOOL_H
@@ -4,32 +4,24 @@
 #include <stdlib.h>
 #include <algorithm>
 #include <assert.h>
-#include <sstream>
-#include <iomanip>
-#include <openssl/sha.h>
+#include "movidius_backend.h"
 #include "movidius_fp16.h"
-
-const char* AgeNetworkHash = "8c67db0340212e05de2ed2c7752df7ba42e54f6aef01b1e6547bc958491eaddf";
-const char* GenderNetworkHash = "ee7b247b0e0366aa8fc10e38261bd7cd75c9884ed8b067a5084ee07052a3c2a2";
+#include "movidius_integrity.h"
+#include "movidius_network.h"
+#include "movidius_preprocess.h"
+#include "movidius_profile.h"
+#include "movidius_telemetry.h"
 
 /**
- * This function is here to validate graph data is loaded into memory correctly
+ * Whether MOVIDIUS_CONVERT_DEFAULT looks channel values up once a network is uploaded
+ * The NEON table lookup beats the fused kernel, on x86 the lookup is a scalar loop and the
+ * fused SIMD kernel is about 20% faster, see convertImage/ in movidius_microbench
  */
-std::string sha256(char* buffer, size_t len)
-{
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, buffer, len);
-    SHA256_Final(hash, &sha256);
-
-    std::stringstream ss;
-    for(int i = 0; i < SHA256_DIGEST_LENGTH; i++)
-    {
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
-    }
-    return ss.str();
-}
+#if defined(__aarch64__)
+static const bool movidius_defaultLut = true;
+#else
+static const bool movidius_defaultLut = false;
+#endif
 
 void printMovidiusError(int rc)
 {
@@ -51,81 +43,274 @@ void printMovidiusError(int rc)
     }
 }
 
+/**
+ * Makes sure movidius_image is allocated for the reqsize of the graph
+ */
+static void movidius_prepareImageBuffers(movidius_graph* graph)
+{
+    if (graph->currentImageSize != graph->reqsize)
+    {
+        if (graph->movidius_image != NULL)
+            free(graph->movidius_image);
+        graph->movidius_image = (movidius_RGB_f16*)malloc(sizeof(movidius_RGB_f16) * graph->reqsize * graph->reqsize);
+        movidius_countAllocation();
+        memset(graph->movidius_image, 0, sizeof(movidius_RGB_f16) * graph->reqsize * graph->reqsize);
+
+        if (graph->scaled_image != NULL)
+            free(graph->scaled_image);
+        graph->scaled_image = NULL;
+
+        graph->currentImageSize = graph->reqsize;
+    }
+}
+
 int movidius_convertImage(movidius_RGB* colorimage,
     unsigned int color_width, unsigned int color_height, movidius_device* dev)
 {
-    if (color_width != dev->reqsize || color_height != dev->reqsize)
+    if (dev->convertMode != MOVIDIUS_CONVERT_TWO_PASS)
     {
-        fprintf(stderr, "movidius: error, given image is wrong size: "
-                "%d, %d. Expecting size: %d, %d\n", color_width, color_height, dev->reqsize, dev->reqsize);
-        return INVALID_INPUT_DATA;
+        return movidius_convertFrame((const unsigned char*)colorimage, MOVIDIUS_PIXEL_RGB, color_width,
+                                     color_height, 3 * color_width, NULL, MOVIDIUS_RESIZE_BILINEAR, dev);
     }
 
-    if (dev->currentImageSize != dev->reqsize)
+    movidius_graph* graph = dev->graph;
+    if (graph == NULL)
     {
-        if (dev->movidius_image != NULL)
-            free(dev->movidius_image);
-        dev->movidius_image = (movidius_RGB_f16*)malloc(sizeof(movidius_RGB_f16) * dev->reqsize * dev->reqsize);
-        memset(dev->movidius_image, 0, sizeof(movidius_RGB_f16) * dev->reqsize * dev->reqsize);
+        fprintf(stderr, "movidius: cannot convert image before uploading a network\n");
+        return NOT_ALLOWED_THIS_TIME;
+    }
 
-        if (dev->scaled_image != NULL)
-            free(dev->scaled_image);
+    if (color_width != graph->reqsize || color_height != graph->reqsize)
+    {
+        fprintf(stderr, "movidius: error, given image is wrong size: "
+                "%d, %d. Expecting size: %d, %d\n", color_width, color_height, graph->reqsize, graph->reqsize);
+        return INVALID_INPUT_DATA;
+    }
+
+    movidius_prepareImageBuffers(graph);
 
-        dev->scaled_image = (float*)malloc(sizeof(float) * dev->reqsize * dev->reqsize * 3);
-        memset(dev->scaled_image, 0, sizeof(float) * dev->reqsize * dev->reqsize * 3);
-        dev->currentImageSize = dev->reqsize;
+    if (graph->scaled_image == NULL)
+    {
+        graph->scaled_image = (float*)malloc(sizeof(float) * graph->reqsize * graph->reqsize * 3);
+        movidius_countAllocation();
+        memset(graph->scaled_image, 0, sizeof(float) * graph->reqsize * graph->reqsize * 3);
     }
 
-    for (unsigned int y = 0; y < dev->reqsize; y++)
+    for (unsigned int y = 0; y < graph->reqsize; y++)
     {
-        for (unsigned int x = 0; x < dev->reqsize; x++)
+        for (unsigned int x = 0; x < graph->reqsize; x++)
         {
             const movidius_RGB& temp = colorimage[y * color_width + x];
-            dev->scaled_image[3 * (y * dev->reqsize + x) + 0] = (((float)temp.r) - dev->mean[0]) * dev->standard_deviation[0];
-            dev->scaled_image[3 * (y * dev->reqsize + x) + 1] = (((float)temp.g) - dev->mean[1]) * dev->standard_deviation[1];
-            dev->scaled_image[3 * (y * dev->reqsize + x) + 2] = (((float)temp.b) - dev->mean[2]) * dev->standard_deviation[2];
+            graph->scaled_image[3 * (y * graph->reqsize + x) + 0] = (((float)temp.r) - graph->mean[0]) * graph->standard_deviation[0];
+            graph->scaled_image[3 * (y * graph->reqsize + x) + 1] = (((float)temp.g) - graph->mean[1]) * graph->standard_deviation[1];
+            graph->scaled_image[3 * (y * graph->reqsize + x) + 2] = (((float)temp.b) - graph->mean[2]) * graph->standard_deviation[2];
         }
     }
 
-    floattofp16((unsigned char*)dev->movidius_image, dev->scaled_image, 3*dev->reqsize*dev->reqsize);
+    floattofp16((unsigned char*)graph->movidius_image, graph->scaled_image, 3*graph->reqsize*graph->reqsize);
 
     return 0;
 }
 
-int movidius_runInference(movidius_device* dev, float* results)
+int movidius_convertImageRegion(const movidius_RGB* colorimage, unsigned int color_width,
+                                unsigned int color_height, unsigned int stride,
+                                const movidius_rect* roi, int filter, movidius_device* dev)
+{
+    return movidius_convertFrame((const unsigned char*)colorimage, MOVIDIUS_PIXEL_RGB, color_width,
+                                 color_height, stride, roi, filter, dev);
+}
+
+/**
+ * Bytes per pixel in the first plane of the format, 0 for unknown formats
+ */
+static unsigned int movidius_pixelSize(int format)
 {
-    unsigned int i = 0;
-    unsigned int throttling = 0;
-    float* timetaken = NULL;
-    unsigned int timetakenlen = 0;
-    unsigned int throttlinglen = 0;
+    switch (format)
+    {
+    case MOVIDIUS_PIXEL_RGB:
+    case MOVIDIUS_PIXEL_BGR:
+        return 3;
+    case MOVIDIUS_PIXEL_RGBA:
+    case MOVIDIUS_PIXEL_BGRA:
+        return 4;
+    case MOVIDIUS_PIXEL_NV12:
+        return 1;
+    case MOVIDIUS_PIXEL_YUYV:
+        return 2;
+    default:
+        return 0;
+    }
+}
 
-    int rc = mvncLoadTensor(dev->currentGraphHandle, dev->movidius_image,
-        dev->reqsize * dev->reqsize * sizeof(movidius_RGB_f16), NULL);
+int movidius_convertFrame(const unsigned char* pixels, int format, unsigned int width,
+                          unsigned int height, unsigned int stride, const movidius_rect* roi,
+                          int filter, movidius_device* dev)
+{
+    movidius_rect full = { 0, 0, width, height };
+    if (roi == NULL)
+        roi = &full;
+
+    movidius_graph* graph = dev->graph;
+    if (graph == NULL)
+    {
+        fprintf(stderr, "movidius: cannot convert image before uploading a network\n");
+        return NOT_ALLOWED_THIS_TIME;
+    }
+
+    unsigned int pixelsize = movidius_pixelSize(format);
+    if (pixelsize == 0)
+    {
+        fprintf(stderr, "movidius: error, unknown pixel format %d\n", format);
+        return INVALID_INPUT_DATA;
+    }
+
+    bool subsampled = format == MOVIDIUS_PIXEL_NV12 || format == MOVIDIUS_PIXEL_YUYV;
+    if ((subsampled && (width & 1)) || (format == MOVIDIUS_PIXEL_NV12 && (height & 1)))
+    {
+        fprintf(stderr, "movidius: error, chroma subsampled frame has odd size %d x %d\n", width, height);
+        return INVALID_INPUT_DATA;
+    }
+
+    if (pixels == NULL || stride < pixelsize * width ||
+        roi->width == 0 || roi->height == 0 ||
+        roi->x >= width || roi->width > width - roi->x ||
+        roi->y >= height || roi->height > height - roi->y)
+    {
+        fprintf(stderr, "movidius: error, invalid region %d, %d, %d x %d for image of size "
+                "%d x %d, stride %d\n", roi->x, roi->y, roi->width, roi->height,
+                width, height, stride);
+        return INVALID_INPUT_DATA;
+    }
+
+    if (filter != MOVIDIUS_RESIZE_BILINEAR && filter != MOVIDIUS_RESIZE_AREA)
+    {
+        fprintf(stderr, "movidius: error, unknown resize filter %d\n", filter);
+        return INVALID_INPUT_DATA;
+    }
+
+    if (dev->convertMode == MOVIDIUS_CONVERT_LUT && !graph->channelLutValid)
+    {
+        fprintf(stderr, "movidius: lookup table conversion requested before uploading a network\n");
+        return NOT_ALLOWED_THIS_TIME;
+    }
+
+    bool use_lut = graph->channelLutValid &&
+        ((dev->convertMode == MOVIDIUS_CONVERT_DEFAULT && movidius_defaultLut) ||
+         dev->convertMode == MOVIDIUS_CONVERT_LUT);
+
+    movidius_prepareImageBuffers(graph);
+
+    if (graph->converter == NULL)
+    {
+        graph->converter = movidius_createConverter();
+        movidius_countAllocation();
+    }
+
+    movidius_frame frame = { pixels, format, width, height, stride };
+    movidius_convertRegion((movidius_converter*)graph->converter, (movidius_threadpool*)dev->preprocessPool,
+                           &frame, roi, filter, graph->reqsize, graph->movidius_image, graph->mean, graph->standard_deviation,
+                           use_lut ? graph->channelLut : NULL);
+    return 0;
+}
+
+int movidius_setPreprocessThreads(movidius_device* dev, unsigned int threads, const int* cpus, unsigned int ncpus)
+{
+    movidius_destroyThreadPool((movidius_threadpool*)dev->preprocessPool);
+    dev->preprocessPool = NULL;
+
+    if (threads <= 1)
+        return 0;
+
+    dev->preprocessPool = movidius_createThreadPool(threads - 1, cpus, ncpus);
+    if (dev->preprocessPool == NULL)
+    {
+        fprintf(stderr, "movidius: failed starting %d preprocessing threads\n", threads);
+        return NOT_ALLOWED_THIS_TIME;
+    }
+
+    return 0;
+}
+
+/**
+ * Remembers a stick that was unplugged or crashed, nothing is sent to it until it is reopened
+ * Returns MOVIDIUS_DEVICE_GONE for those, error for every other failure
+ */
+static int movidius_checkGone(movidius_device* dev, int rc, int error)
+{
+    if (rc != MVNC_GONE)
+        return error;
+
+    if (!dev->gone)
+        fprintf(stderr, "movidius: device %s is gone, excluding it\n", dev->dev_name);
+
+    dev->gone = 1;
+    return MOVIDIUS_DEVICE_GONE;
+}
+
+/**
+ * Switches mvncGetResult() between blocking and returning right away when no result is ready
+ */
+static int movidius_setDontBlock(movidius_device* dev, movidius_graph* graph, int dont_block)
+{
+    if (graph->dontBlock == dont_block)
+        return 0;
+
+    int rc = movidius_getBackend()->setGraphOption(graph->handle, MVNC_DONT_BLOCK,
+                                                   &dont_block, sizeof(dont_block));
+    if (rc != MVNC_OK)
+    {
+        fprintf(stderr, "movidius: SetGraphOption failed for MVNC_DONT_BLOCK, rc=%d\n", rc);
+        printMovidiusError(rc);
+        return movidius_checkGone(dev, rc, MOVIDIUS_GETGRAPHOPT_FAILED);
+    }
+
+    graph->dontBlock = dont_block;
+    return 0;
+}
+
+static int movidius_loadTensor(movidius_device* dev, movidius_graph* graph, void* userParam)
+{
+    int rc = movidius_getBackend()->loadTensor(graph->handle, graph->movidius_image,
+        graph->reqsize * graph->reqsize * sizeof(movidius_RGB_f16), userParam);
 
     if (rc != MVNC_OK)
     {
         fprintf(stderr, "movidius: LoadTensor failed: %d. Image dims: "
-                "%d x %d, bytes: %d\n", rc, dev->reqsize, dev->reqsize,
-                dev->reqsize * dev->reqsize * (int)sizeof(movidius_RGB_f16));
+                "%d x %d, bytes: %d\n", rc, graph->reqsize, graph->reqsize,
+                graph->reqsize * graph->reqsize * (int)sizeof(movidius_RGB_f16));
 
         printMovidiusError(rc);
-        return MOVIDIUS_LOADTENSOR_ERROR;
+        return movidius_checkGone(dev, rc, MOVIDIUS_LOADTENSOR_ERROR);
     }
 
-    void* resultData16;
-    void* userParam;
-    unsigned int lenResultData;
-    rc = mvncGetResult(dev->currentGraphHandle, &resultData16, &lenResultData, &userParam);
+    return 0;
+}
+
+/**
+ * Fetches the next finished result from the device
+ * Returns MOVIDIUS_RESULT_PENDING if dontBlock is set and nothing is ready yet
+ */
+static int movidius_getResult(movidius_device* dev, movidius_graph* graph, void** resultData16,
+                              unsigned int* lenResultData, void** userParam)
+{
+    // mvnc reuses its result buffer, the previous result is gone from here on
+    graph->lastResult = NULL;
+    graph->lastResultCount = 0;
+
+    int rc = movidius_getBackend()->getResult(graph->handle, resultData16, lenResultData, userParam);
 
     if (rc != MVNC_OK)
     {
+        if (graph->dontBlock && (rc == MVNC_NO_DATA || rc == MVNC_BUSY))
+            return MOVIDIUS_RESULT_PENDING;
+
         if (rc == MVNC_MYRIAD_ERROR)
         {
             char* debuginfo;
             unsigned debuginfolen;
 
-            rc = mvncGetGraphOption(dev->currentGraphHandle, MVNC_DEBUG_INFO, (void**)&debuginfo, &debuginfolen);
+            rc = movidius_getBackend()->getGraphOption(graph->handle, MVNC_DEBUG_INFO,
+                                                       (void**)&debuginfo, &debuginfolen);
             if (rc == MVNC_OK)
             {
                 fprintf(stderr, "movidius: GetResult failed, myriad error: %s\n", debuginfo);
@@ -135,195 +320,316 @@ int movidius_runInference(movidius_device* dev, float* results)
 
         fprintf(stderr, "movidius: GetResult failed, rc=%d\n", rc);
         printMovidiusError(rc);
-        return MOVIDIUS_GETRESULT_FAILED;
+        return movidius_checkGone(dev, rc, MOVIDIUS_GETRESULT_FAILED);
     }
 
-    // convert half precision floats to full floats
-    int numResults = lenResultData / sizeof(uint16_t);
-    float* resultData32;
-    resultData32 = (float*)malloc(numResults * sizeof(*resultData32));
-    fp16tofloat(resultData32, (unsigned char*)resultData16, numResults);
+    return 0;
+}
+
+/**
+ * Converts a result to floats and samples the telemetry of the device when its policy says so
+ */
+static int movidius_finishResult(movidius_device* dev, movidius_graph* graph, void* resultData16,
+                                 unsigned int lenResultData, float* results, unsigned int num_results,
+                                 unsigned long long submitted_us)
+{
+    unsigned int numResults = lenResultData / sizeof(uint16_t);
+    graph->lastResult = (const uint16_t*)resultData16;
+    graph->lastResultCount = numResults;
 
-    for (int index = 0; index < numResults; index++)
+    if (results != NULL)
     {
-        results[index] = resultData32[index];
+        if (numResults > num_results)
+        {
+            fprintf(stderr, "movidius: %u results do not fit in %u\n", numResults, num_results);
+            return MOVIDIUS_RESULTS_TOO_SMALL;
+        }
+
+        // convert half precision floats to full floats
+        fp16tofloat(results, (unsigned char*)resultData16, numResults);
     }
-    free(resultData32);
 
-    rc = mvncGetGraphOption(dev->currentGraphHandle, MVNC_TIME_TAKEN, (void **)&timetaken, &timetakenlen);
-    if (rc)
+    // the result is good even if the telemetry queries fail, a lost stick shows up on the next call
+    int rc = movidius_sampleTelemetry(dev, graph, submitted_us);
+    if (rc != MVNC_OK)
     {
-        fprintf(stderr, "movidius: GetGraphOption failed for getting MVNC_TIMETAKEN, rc=%d\n", rc);
         printMovidiusError(rc);
-        return MOVIDIUS_GETGRAPHOPT_FAILED;
+        movidius_checkGone(dev, rc, MOVIDIUS_GETGRAPHOPT_FAILED);
     }
 
-    timetakenlen = timetakenlen / sizeof(*timetaken);
-    float sum = 0;
-    for (i = 0; i < timetakenlen; i++)
-        sum += timetaken[i];
-
-    if (sum > 100)
-        fprintf(stderr, "movidius: Inference time was long: %f ms\n", sum);
+    return 0;
+}
 
-    rc = mvncGetDeviceOption(dev->dev_handle, MVNC_THERMAL_THROTTLING_LEVEL, (void **)&throttling, &throttlinglen);
-    if (rc)
+/**
+ * The request submitted first among those in flight, NULL if there are none
+ */
+static movidius_request* movidius_oldestRequest(movidius_graph* graph)
+{
+    movidius_request* oldest = NULL;
+    for (int i = 0; i < MOVIDIUS_MAX_INFLIGHT; i++)
     {
-        fprintf(stderr, "movidus: GetGraphOption failed for MVNC_THERMAL_THROTTLING_LEVEL, rc=%d\n", rc);
-        printMovidiusError(rc);
-        return MOVIDIUS_GETGRAPHOPT_FAILED;
+        movidius_request* request = &graph->requests[i];
+        if (request->busy && (oldest == NULL || (int)(request->sequence - oldest->sequence) < 0))
+            oldest = request;
     }
+    return oldest;
+}
+
+/**
+ * Takes the request a result belongs to off the in flight list
+ */
+static void movidius_completeRequest(movidius_graph* graph, void* userParam, void** tag,
+                                     unsigned long long* submitted_us)
+{
+    movidius_request* request = (movidius_request*)userParam;
 
-    if (throttling == 1)
-        fprintf(stderr, "movidius: ** NCS temperature high - thermal throttling initiated **\n");
-    else if (throttling == 2)
+    // mvnc returns results in the order the tensors were loaded, so the result is the oldest request's
+    if (request < graph->requests || request >= graph->requests + MOVIDIUS_MAX_INFLIGHT || !request->busy)
     {
-        fprintf(stderr, "movidius: *********************** WARNING *************************\n");
-        fprintf(stderr, "movidius: * NCS temperature critical                              *\n");
-        fprintf(stderr, "movidius: * Aggressive thermal throttling initiated               *\n");
-        fprintf(stderr, "movidius: * Continued use may result in device damage             *\n");
-        fprintf(stderr, "movidius: *********************************************************\n");
+        fprintf(stderr, "movidius: result for unknown request %p, taking it as the oldest one\n", userParam);
+        request = movidius_oldestRequest(graph);
     }
 
-    return 0;
+    if (tag != NULL)
+        *tag = request->tag;
+    *submitted_us = request->submittedUs;
+
+    request->busy = 0;
+    request->tag = NULL;
+    graph->numInflight--;
 }
 
-void* movidius_loadfile(const char* path, unsigned int* length)
+int movidius_runInference(movidius_device* dev, float* results, unsigned int num_results)
 {
-    FILE *fp;
-    char *buf;
-
-    fp = fopen(path, "rb");
-    if (fp == NULL)
+    movidius_graph* graph = dev->graph;
+    if (graph == NULL)
     {
-        fprintf(stderr, "movidius: Cannot read file: %s\n", path);
-        return NULL;
+        fprintf(stderr, "movidius: cannot run an inference without a graph\n");
+        return NOT_ALLOWED_THIS_TIME;
     }
 
-    fseek(fp, 0, SEEK_END);
-    *length = ftell(fp);
-    rewind(fp);
+    if (dev->gone)
+        return MOVIDIUS_DEVICE_GONE;
 
-    if (*length == 0)
+    if (graph->numInflight > 0)
     {
-        fclose(fp);
-        fprintf(stderr, "movidius: file length is 0\n");
-        return NULL;
+        fprintf(stderr, "movidius: cannot run a blocking inference with %d submitted inferences in flight\n",
+                graph->numInflight);
+        return NOT_ALLOWED_THIS_TIME;
     }
 
-    if (!(buf = (char*)malloc(*length)))
+    int rc = movidius_setDontBlock(dev, graph, 0);
+    if (rc != 0)
+        return rc;
+
+    unsigned long long submitted_us = dev->profiling ? movidius_profileClockUs() : 0;
+    rc = movidius_loadTensor(dev, graph, NULL);
+    if (rc != 0)
+        return rc;
+
+    void* resultData16;
+    void* userParam;
+    unsigned int lenResultData;
+    rc = movidius_getResult(dev, graph, &resultData16, &lenResultData, &userParam);
+    if (rc != 0)
+        return rc;
+
+    return movidius_finishResult(dev, graph, resultData16, lenResultData, results, num_results, submitted_us);
+}
+
+int movidius_submitInference(movidius_device* dev, void* tag)
+{
+    movidius_graph* graph = dev->graph;
+    if (graph == NULL)
     {
-        fclose(fp);
-        fprintf(stderr, "movidius: Cannot allocate buffer of size %d for file %s\n", *length, path);
-        return NULL;
+        fprintf(stderr, "movidius: cannot submit an inference without a graph\n");
+        return NOT_ALLOWED_THIS_TIME;
     }
 
-    if (fread(buf, 1, *length, fp) != *length)
+    if (dev->gone)
+        return MOVIDIUS_DEVICE_GONE;
+
+    if (graph->numInflight >= MOVIDIUS_MAX_INFLIGHT)
+        return MOVIDIUS_QUEUE_FULL;
+
+    movidius_request* request = NULL;
+    for (int i = 0; i < MOVIDIUS_MAX_INFLIGHT; i++)
     {
-        fclose(fp);
-        free(buf);
-        fprintf(stderr, "movidius: Failed reading %d bytes from file %s\n", *length, path);
-        return NULL;
+        if (!graph->requests[i].busy)
+        {
+            request = &graph->requests[i];
+            break;
+        }
     }
 
-    fclose(fp);
-    return buf;
+    unsigned long long submitted_us = dev->profiling ? movidius_profileClockUs() : 0;
+    int rc = movidius_loadTensor(dev, graph, request);
+    if (rc != 0)
+        return rc;
+
+    request->submittedUs = submitted_us;
+    request->tag = tag;
+    request->sequence = graph->nextSequence++;
+    request->busy = 1;
+    graph->numInflight++;
+    return 0;
 }
 
-int movidius_loadGraphData(const char* dir, unsigned int* reqsize, float* mean, float* std)
+/**
+ * Gives up on the oldest request when fetching its result failed, or the device is gone,
+ * so its result will never arrive. Returns error
+ */
+static int movidius_dropOldestRequest(movidius_graph* graph, void** tag, int error)
 {
-    char path[1024];
-    int i;
+    movidius_request* oldest = movidius_oldestRequest(graph);
 
-    if (strlen(dir) > 1000)
-    {
-        fprintf(stderr, "Given dir path is too long: %s\n", dir);
-        return -1;
-    }
+    if (tag != NULL)
+        *tag = oldest->tag;
+
+    oldest->busy = 0;
+    oldest->tag = NULL;
+    graph->numInflight--;
+    return error;
+}
 
-    snprintf(path, sizeof(path), "%s/stat.txt", dir);
-    FILE *fp = fopen(path, "r");
-    if (!fp)
+/**
+ * Shared part of movidius_pollInference() and movidius_waitInference()
+ */
+static int movidius_collectInference(movidius_device* dev, float* results, unsigned int num_results, void** tag,
+                                     int dont_block)
+{
+    movidius_graph* graph = dev->graph;
+    if (graph == NULL)
     {
-        fprintf(stderr, "movidius: Failed opening stat.txt in dir: %s\n", dir);
-        return -1;
+        fprintf(stderr, "movidius: cannot collect inferences without a graph\n");
+        return NOT_ALLOWED_THIS_TIME;
     }
 
-    if (fscanf(fp, "%f %f %f\n%f %f %f\n", mean, mean+1, mean+2, std, std+1, std+2) != 6)
+    if (graph->numInflight == 0)
     {
-        fprintf(stderr, "movidius: %s: mean and stddev not found in file\n", path);
-        fclose(fp);
-        return -1;
+        fprintf(stderr, "movidius: no submitted inferences to collect\n");
+        return NOT_ALLOWED_THIS_TIME;
     }
 
-    fclose(fp);
+    if (dev->gone)
+        return movidius_dropOldestRequest(graph, tag, MOVIDIUS_DEVICE_GONE);
 
-    for (i = 0; i < 3; i++)
-    {
-        mean[i] = 255.0 * mean[i];
-        std[i] = 1.0 / (255.0 * std[i]);
-    }
+    int rc = movidius_setDontBlock(dev, graph, dont_block);
+    if (rc == MOVIDIUS_DEVICE_GONE)
+        return movidius_dropOldestRequest(graph, tag, rc);
+    if (rc != 0)
+        return rc;
 
-    snprintf(path, sizeof(path), "%s/inputsize.txt", dir);
-    fp = fopen(path, "r");
-    if (!fp)
-    {
-        fprintf(stderr, "movidius: Failed opening inputsize.txt in dir %s\n", dir);
-        return -1;
-    }
+    void* resultData16;
+    void* userParam = NULL;
+    unsigned int lenResultData;
+    rc = movidius_getResult(dev, graph, &resultData16, &lenResultData, &userParam);
+    if (rc == MOVIDIUS_RESULT_PENDING)
+        return rc;
+
+    // a failed mvncGetResult() has used up the tensor, without telling which one it was
+    if (rc != 0)
+        return movidius_dropOldestRequest(graph, tag, rc);
+
+    unsigned long long submitted_us;
+    movidius_completeRequest(graph, userParam, tag, &submitted_us);
+
+    return movidius_finishResult(dev, graph, resultData16, lenResultData, results, num_results, submitted_us);
+}
 
-    if (fscanf(fp, "%d", reqsize) != 1)
+unsigned int movidius_abandonInferences(movidius_device* dev)
+{
+    movidius_graph* graph = dev->graph;
+    if (graph == NULL)
+        return 0;
+
+    unsigned int abandoned = graph->numInflight;
+    for (int i = 0; i < MOVIDIUS_MAX_INFLIGHT; i++)
     {
-        fprintf(stderr, "movidius: %s: inputsize not found in file\n", path);
-        fclose(fp);
-        return -1;
+        graph->requests[i].busy = 0;
+        graph->requests[i].tag = NULL;
     }
+    graph->numInflight = 0;
 
-    fclose(fp);
-    return 0;
+    if (abandoned > 0)
+        fprintf(stderr, "movidius: gave up on %u inferences in flight on %s\n", abandoned, dev->dev_name);
+    return abandoned;
+}
+
+int movidius_pollInference(movidius_device* dev, float* results, unsigned int num_results, void** tag)
+{
+    return movidius_collectInference(dev, results, num_results, tag, 1);
+}
+
+int movidius_waitInference(movidius_device* dev, float* results, unsigned int num_results, void** tag)
+{
+    return movidius_collectInference(dev, results, num_results, tag, 0);
 }
 
-int movidius_loadCategories(const char* path, movidius_device* dev)
+/**
+ * Frees the converted image buffers of a graph, they are allocated again when needed
+ */
+static void movidius_freeImageBuffers(movidius_graph* graph)
+{
+    if (graph->scaled_image)
+        free(graph->scaled_image);
+    graph->scaled_image = NULL;
+
+    if (graph->movidius_image)
+        free(graph->movidius_image);
+    graph->movidius_image = NULL;
+
+    graph->currentImageSize = 0;
+
+    if (graph->converter)
+        movidius_destroyConverter((movidius_converter*)graph->converter);
+    graph->converter = NULL;
+}
+
+/**
+ * Frees all host memory of a graph slot and clears it, the device side handle is not touched
+ */
+static void movidius_freeGraph(movidius_graph* graph)
 {
-    char line[1024];
-    char* p;
+    movidius_freeImageBuffers(graph);
+
+    movidius_releaseNetwork((movidius_network*)graph->network);
+    movidius_destroyProfile(graph);
 
-    FILE *fp = fopen(path, "r");
+    memset(graph, 0, sizeof(*graph));
+}
 
-    if (!fp)
+/**
+ * The resident graph loaded from network_path, or NULL
+ */
+static movidius_graph* movidius_findGraph(movidius_device* dev, const char* network_path)
+{
+    for (int slot = 0; slot < MOVIDIUS_MAX_GRAPHS; slot++)
     {
-        fprintf(stderr, "movidius: Failed opening file: %s\n", path);
-        return -1;
+        movidius_graph* graph = &dev->graphs[slot];
+        if (graph->handle != NULL && strcmp(graph->networkPath, network_path) == 0)
+            return graph;
     }
 
-    dev->numCategories = 0;
-    dev->categories = (char**)malloc(1000 * sizeof(*dev->categories));
-    std::stringstream ss;
+    return NULL;
+}
 
-    while (fgets(line, sizeof(line), fp))
+int movidius_selectNetwork(movidius_device* dev, const char* network_path)
+{
+    movidius_graph* graph = movidius_findGraph(dev, network_path);
+    if (graph == NULL)
     {
-        ss << line;
-        p = strchr(line, '\n');
-        if (p)
-            *p = 0;
-
-        if (strcasecmp(line, "classes"))
-        {
-            dev->categories[dev->numCategories++] = strdup(line);
-            if (dev->numCategories == 1000)
-                break;
-        }
+        fprintf(stderr, "movidius: network %s is not on device %s\n", network_path, dev->dev_name);
+        return INVALID_INPUT_DATA;
     }
 
-    if (dev->numCategories == 0)
+    if (dev->graph != NULL && dev->graph != graph && dev->graph->numInflight > 0)
     {
-        fprintf(stderr, "movidius: device numCategories is 0 after loading categories\n");
-        fprintf(stderr, "Full contents of categories file: %s\n", ss.str().c_str());
-        fprintf(stderr, "File was: %s", path);
-        return 1;
+        fprintf(stderr, "movidius: Cannot switch networks with inferences in flight\n");
+        return NOT_ALLOWED_THIS_TIME;
     }
 
-    fclose(fp);
+    dev->graph = graph;
     return 0;
 }
 
@@ -341,96 +647,135 @@ int movidius_uploadNetwork(movidius_device* dev)
         return INVALID_INPUT_DATA;
     }
 
-    if (dev->graphFileContents != NULL || dev->currentGraphHandle != NULL || dev->numCategories > 0 || dev->categories != NULL)
+    if (movidius_findGraph(dev, dev->networkPath) != NULL)
+        return movidius_selectNetwork(dev, dev->networkPath);
+
+    if (dev->graph != NULL && dev->graph->numInflight > 0)
     {
-        fprintf(stderr, "movidius: Cannot upload a new network before calling movidius_deallocateGraph\n");
+        fprintf(stderr, "movidius: Cannot switch networks with inferences in flight\n");
         return NOT_ALLOWED_THIS_TIME;
     }
 
-    int rc, i;
-    void* g = NULL;
-    char path[1024];
-
-    snprintf(path, sizeof(path), "%s/graph", dev->networkPath);
-    dev->graphFileContents = movidius_loadfile(path, &dev->graphFileLen);
+    movidius_graph* graph = NULL;
+    for (int slot = 0; slot < MOVIDIUS_MAX_GRAPHS && graph == NULL; slot++)
+    {
+        if (dev->graphs[slot].handle == NULL)
+            graph = &dev->graphs[slot];
+    }
 
-    if (dev->graphFileContents == NULL)
+    if (graph == NULL)
     {
-        fprintf(stderr, "movidius: %s/graph not found\n", dev->networkPath);
-        return DATA_LOAD_FAILED;
+        fprintf(stderr, "movidius: Cannot upload more than %d networks, call movidius_deallocateGraph first\n",
+                MOVIDIUS_MAX_GRAPHS);
+        return NOT_ALLOWED_THIS_TIME;
     }
 
-    snprintf(path, sizeof(path), "%s/categories.txt", dev->networkPath);
+    strcpy(graph->networkPath, dev->networkPath);
+
+    int rc;
+    void* g = NULL;
 
-    if (movidius_loadCategories(path, dev) != 0)
+    movidius_network* network = movidius_acquireNetwork(dev->networkPath);
+
+    if (network == NULL)
     {
-        fprintf(stderr, "movidius: Error loading categories\n");
-        free(dev->graphFileContents);
-        dev->graphFileContents = NULL;
+        fprintf(stderr, "movidius: Failed loading network %s\n", dev->networkPath);
+        movidius_freeGraph(graph);
         return DATA_LOAD_FAILED;
     }
 
-    if (movidius_loadGraphData(dev->networkPath, &dev->reqsize, dev->mean, dev->standard_deviation) != 0)
+    graph->network = network;
+    graph->graphFileContents = network->graphData;
+    graph->graphFileLen = network->graphLength;
+    graph->categories = network->categories;
+    graph->numCategories = network->numCategories;
+    graph->reqsize = network->reqsize;
+    memcpy(graph->mean, network->mean, sizeof(graph->mean));
+    memcpy(graph->standard_deviation, network->standard_deviation, sizeof(graph->standard_deviation));
+    memcpy(graph->channelLut, network->channelLut, sizeof(graph->channelLut));
+    graph->channelLutValid = 1;
+
+    // a hash known before allocating keeps a bad graph off the device
+    movidius_integritycheck* check = NULL;
+    int integrity = movidius_beginIntegrityCheck(dev->networkPath, network, &check);
+    if (integrity != 0)
     {
-        fprintf(stderr, "movidius: loadGraphData failed\n");
-        return DATA_LOAD_FAILED;
+        movidius_freeGraph(graph);
+        return integrity;
     }
 
-    rc = mvncAllocateGraph(dev->dev_handle, &g, dev->graphFileContents, dev->graphFileLen);
+    rc = movidius_getBackend()->allocateGraph(dev->dev_handle, &g, graph->graphFileContents, graph->graphFileLen);
+
+    // joins the hashing thread, which ran alongside the upload
+    integrity = movidius_finishIntegrityCheck(check);
 
     if (rc != MVNC_OK)
     {
         fprintf(stderr, "movidius: AllocateGraph failed, rc = %d for network %s, "
-                        "len: %d\n", rc, dev->networkPath, dev->graphFileLen);
+                        "len: %d\n", rc, dev->networkPath, graph->graphFileLen);
 
         printMovidiusError(rc);
 
         fprintf(stderr, "state after allocgraph fail\n");
-        for (int cat = 0; cat < dev->numCategories; cat++)
+        for (int cat = 0; cat < graph->numCategories; cat++)
         {
-            fprintf(stderr, "category %d: %s\n", cat, dev->categories[cat]);
+            fprintf(stderr, "category %d: %s\n", cat, graph->categories[cat]);
         }
 
-        if (dev->graphFileContents == NULL)
-        {
-            fprintf(stderr, "Graph file is null\n");
-            return 1;
-        }
+        if (check == NULL)
+            fprintf(stderr, "No expected hash for network %s, or it matched before allocating\n", dev->networkPath);
+        else if (integrity == 0)
+            fprintf(stderr, "graph file hash identical to the manifest\n");
 
-        std::string hashed = sha256((char*)dev->graphFileContents, dev->graphFileLen);
-        std::string expected_hash;
+        movidius_freeGraph(graph);
 
-        if (strcmp(dev->networkPath, "./network/Age") == 0)
-            expected_hash = AgeNetworkHash;
-        else if (strcmp(dev->networkPath, "./network/Gender") == 0)
-            expected_hash = GenderNetworkHash;
-        else
-        {
-            fprintf(stderr, "Network path is not either age or gender: %s\n", dev->networkPath);
-            return 1;
-        }
+        return movidius_checkGone(dev, rc, integrity != 0 ? integrity : MOVIDIUS_ALLOCATEGRAPH_ERROR);
+    }
 
-        if (hashed.compare(expected_hash) != 0)
-        {
-            fprintf(stderr, "graph file sha256sum in memory differs: %s vs %s\n",
-                    hashed.c_str(), expected_hash.c_str());
-        }
-        fprintf(stderr, "graph file hash identical: %s\n", hashed.c_str());
+    if (integrity != 0)
+    {
+        movidius_freeGraph(graph);
+        rc = movidius_getBackend()->deallocateGraph(g);
+        if (rc != MVNC_OK)
+            fprintf(stderr, "movidius: Failed deallocating corrupt graph: %d\n", rc);
+        return integrity;
+    }
+
+    graph->handle = g;
+    graph->dontBlock = 0;
+    dev->graph = graph;
+
+    fprintf(stderr, "movidius: Graph allocated\n");
+    return 0;
+}
+
+/**
+ * Deallocates one resident graph and frees everything that belongs to it
+ */
+static int movidius_deallocateSlot(movidius_graph* graph)
+{
+    if (graph->numCategories == 0)
+        fprintf(stderr, "movidiusdevice: Warning: Deallocating graph when numCategories == 0\n");
+
+    // results of anything still on the device go away with the graph
+    void* handle = graph->handle;
+    movidius_freeGraph(graph);
 
-        free(dev->graphFileContents);
-        for (i = 0; i < dev->numCategories; i++)
-            free(dev->categories[i]);
-        free(dev->categories);
-        dev->graphFileContents = NULL;
-        dev->categories = NULL;
-        dev->numCategories = 0;
+    int rc = movidius_getBackend()->deallocateGraph(handle);
 
-        return MOVIDIUS_ALLOCATEGRAPH_ERROR;
+    if (rc != MVNC_OK)
+    {
+        fprintf(stderr, "movidius: Failed deallocating graph: %d\n", rc);
+        printMovidiusError(rc);
+
+        // Assume these errors happen if the device does not support deallocating graphs
+        // I suppose we have to restart device then? The slot is free either way,
+        // as we've done all we can
+        return MOVIDIUS_DEALLOCATEGRAPH_ERROR;
     }
 
-    dev->currentGraphHandle = g;
+    fprintf(stderr, "movidius: graph deallocated\n");
 
-    fprintf(stderr, "movidius: Graph allocated\n");
     return 0;
 }
 
@@ -442,60 +787,80 @@ int movidius_deallocateGraph(movidius_device* dev)
         return INVALID_DEV_HANDLE;
     }
 
-    if (dev->currentGraphHandle == NULL)
+    if (dev->graph == NULL)
     {
         fprintf(stderr, "movidius: cannot unload null graph\n");
         return INVALID_INPUT_DATA;
     }
 
-    if (dev->numCategories > 0)
+    if (dev->graph->numInflight > 0)
     {
-        for (int i = 0; i < dev->numCategories; i++)
-            free(dev->categories[i]);
-        free(dev->categories);
+        fprintf(stderr, "movidius: Cannot unload a network with inferences in flight\n");
+        return NOT_ALLOWED_THIS_TIME;
     }
-    else
+
+    int rc = movidius_deallocateSlot(dev->graph);
+    dev->graph = NULL;
+    return rc;
+}
+
+int movidius_deallocateAllGraphs(movidius_device* dev)
+{
+    if (dev->dev_handle == NULL)
     {
-        fprintf(stderr, "movidiusdevice: Warning: Deallocating graph when numCategories == 0\n");
+        fprintf(stderr, "movidius: cannot unload graphs for null device\n");
+        return INVALID_DEV_HANDLE;
     }
 
-    dev->categories = NULL;
-    dev->numCategories = 0;
-    if (dev->graphFileContents != NULL)
-        free(dev->graphFileContents);
-    dev->graphFileContents = NULL;
+    int ret = 0;
+    for (int slot = 0; slot < MOVIDIUS_MAX_GRAPHS; slot++)
+    {
+        if (dev->graphs[slot].handle == NULL)
+            continue;
 
-    int rc = mvncDeallocateGraph(dev->currentGraphHandle);
+        int rc = movidius_deallocateSlot(&dev->graphs[slot]);
+        if (rc != 0)
+            ret = rc;
+    }
 
-    if (rc != MVNC_OK)
+    dev->graph = NULL;
+    return ret;
+}
+
+int movidius_deallocateNetwork(movidius_device* dev, const char* network_path)
+{
+    if (dev->dev_handle == NULL)
     {
-        fprintf(stderr, "movidius: Failed deallocating graph: %d\n", rc);
-        printMovidiusError(rc);
+        fprintf(stderr, "movidius: cannot unload graph for null device\n");
+        return INVALID_DEV_HANDLE;
+    }
 
-        // Assume these errors happen if the device does not support deallocating graphs
-        // I suppose we have to restart device then? Well, assign this pointer to NULL
-        // as we've done all we can
-        dev->currentGraphHandle = NULL;
-        return MOVIDIUS_DEALLOCATEGRAPH_ERROR;
+    movidius_graph* graph = movidius_findGraph(dev, network_path);
+    if (graph == NULL)
+    {
+        fprintf(stderr, "movidius: network %s is not on device %s\n", network_path, dev->dev_name);
+        return INVALID_INPUT_DATA;
     }
 
-    dev->currentGraphHandle = NULL;
-    fprintf(stderr, "movidius: graph deallocated\n");
+    if (graph->numInflight > 0)
+    {
+        fprintf(stderr, "movidius: Cannot unload a network with inferences in flight\n");
+        return NOT_ALLOWED_THIS_TIME;
+    }
 
-    return 0;
+    if (dev->graph == graph)
+        dev->graph = NULL;
+    return movidius_deallocateSlot(graph);
 }
 
 int movidius_openDevice(movidius_device* dev)
 {
-    assert(sizeof(dev->dev_name) >= MVNC_MAX_NAME_SIZE);
-
     char name[MVNC_MAX_NAME_SIZE];
     int loglevel = 1;
-    void* h = NULL;
 
-    mvncSetGlobalOption(MVNC_LOG_LEVEL, &loglevel, sizeof(loglevel));
+    movidius_getBackend()->setGlobalOption(MVNC_LOG_LEVEL, &loglevel, sizeof(loglevel));
 
-    int rc = mvncGetDeviceName(0, name, sizeof(name));
+    int rc = movidius_getBackend()->getDeviceName(0, name, sizeof(name));
     if (rc != MVNC_OK)
     {
         fprintf(stderr, "movidius: No devices found\n");
@@ -503,7 +868,16 @@ int movidius_openDevice(movidius_device* dev)
         return MOVIDIUS_NODEVICE_FOUND;
     }
 
-    rc = mvncOpenDevice(name, &h);
+    return movidius_openDeviceName(dev, name);
+}
+
+int movidius_openDeviceName(movidius_device* dev, const char* name)
+{
+    assert(sizeof(dev->dev_name) >= MVNC_MAX_NAME_SIZE);
+
+    void* h = NULL;
+
+    int rc = movidius_getBackend()->openDevice(name, &h);
     if (rc != MVNC_OK)
     {
         fprintf(stderr, "movidius: OpenDevice %s failed, rc=%d\n", name, rc);
@@ -513,6 +887,7 @@ int movidius_openDevice(movidius_device* dev)
 
     fprintf(stderr, "movidius: OpenDevice %s succeeded\n", name);
     dev->dev_handle = h;
+    dev->gone = 0;
     strcpy(dev->dev_name, name);
 
     return 0;
@@ -526,20 +901,21 @@ int movidius_closeDevice(movidius_device* dev, bool dealloc_graph)
         return INVALID_DEV_HANDLE;
     }
 
-    if (dev->scaled_image)
-        free(dev->scaled_image);
-    dev->scaled_image = NULL;
+    movidius_destroyThreadPool((movidius_threadpool*)dev->preprocessPool);
+    dev->preprocessPool = NULL;
 
-    if (dev->movidius_image)
-        free(dev->movidius_image);
-    dev->movidius_image = NULL;
-
-    dev->currentImageSize = 0;
+    movidius_destroyTelemetry(dev);
 
     if (dealloc_graph)
-        movidius_deallocateGraph(dev);
+        movidius_deallocateAllGraphs(dev);
+
+    // graphs left on the device go away with it, their network references and buffers must not
+    for (int slot = 0; slot < MOVIDIUS_MAX_GRAPHS; slot++)
+        movidius_freeGraph(&dev->graphs[slot]);
+    dev->graph = NULL;
 
-    int rc = mvncCloseDevice(dev->dev_handle);
+    int rc = movidius_getBackend()->closeDevice(dev->dev_handle);
+    dev->dev_handle = NULL;
     if (rc != MVNC_OK)
     {
         fprintf(stderr, "movidius: Device close failed: %d, dealloc: %d\n", rc, dealloc_graph);
@@ -28,9 +28,124 @@ enum
     MOVIDIUS_OPENDEVICE_FAILED = 1004,
     MOVIDIUS_CLOSEDEVICE_FAILED = 1005,
     MOVIDIUS_GETRESULT_FAILED = 1006,
-    MOVIDIUS_GETGRAPHOPT_FAILED = 1007
+    MOVIDIUS_GETGRAPHOPT_FAILED = 1007,
+    MOVIDIUS_RESULT_PENDING = 1008,
+    MOVIDIUS_QUEUE_FULL = 1009,
+    MOVIDIUS_DEVICE_GONE = 1010,
+    MOVIDIUS_INTEGRITY_FAILED = 1011,
+    MOVIDIUS_RESULTS_TOO_SMALL = 1012
 };
 
+/**
+ * Ways movidius_convertImage() can produce the half float image, see movidius_device::convertMode
+ */
+enum
+{
+    /**
+     * The fastest path measured for the CPU: MOVIDIUS_CONVERT_FUSED on x86, where the SIMD kernel
+     * beats the scalar table lookup, and on ARM MOVIDIUS_CONVERT_LUT once a network is uploaded,
+     * with MOVIDIUS_CONVERT_FUSED before that
+     */
+    MOVIDIUS_CONVERT_DEFAULT = 0,
+
+    /**
+     * Normalizes and converts to half floats in a single pass over the image
+     */
+    MOVIDIUS_CONVERT_FUSED = 1,
+
+    /**
+     * The original implementation: normalize the whole image into scaled_image,
+     * then convert that to half floats. Kept for comparing the numeric output of the other paths
+     */
+    MOVIDIUS_CONVERT_TWO_PASS = 2,
+
+    /**
+     * Looks every channel value up from movidius_device::channelLut
+     * Only available after movidius_uploadNetwork() has built the tables
+     */
+    MOVIDIUS_CONVERT_LUT = 3
+};
+
+/**
+ * Size of movidius_device::channelLut, 256 values for each of the 3 channels
+ */
+#define MOVIDIUS_LUT_ENTRIES (3 * 256)
+
+/**
+ * Filters movidius_convertImageRegion() can scale the input with
+ */
+enum
+{
+    /**
+     * Interpolates between the 4 nearest source pixels. Fast, but skips source pixels when
+     * shrinking by more than 2x
+     */
+    MOVIDIUS_RESIZE_BILINEAR = 0,
+
+    /**
+     * Averages all source pixels covered by the output pixel. Use this for shrinking large
+     * camera frames. Behaves like bilinear when enlarging
+     */
+    MOVIDIUS_RESIZE_AREA = 1
+};
+
+/**
+ * Pixel layouts movidius_convertFrame() accepts
+ */
+enum
+{
+    MOVIDIUS_PIXEL_RGB = 0,  // 3 bytes per pixel: r, g, b. Same as movidius_RGB
+    MOVIDIUS_PIXEL_BGR = 1,  // 3 bytes per pixel: b, g, r
+    MOVIDIUS_PIXEL_RGBA = 2, // 4 bytes per pixel: r, g, b, alpha is ignored
+    MOVIDIUS_PIXEL_BGRA = 3, // 4 bytes per pixel: b, g, r, alpha is ignored
+    MOVIDIUS_PIXEL_NV12 = 4, // luma plane, followed by a half height plane of interleaved u, v pairs
+    MOVIDIUS_PIXEL_YUYV = 5  // 2 bytes per pixel, each pixel pair stored as y0, u, y1, v
+};
+
+/**
+ * Tensors the device queues per graph, loading more blocks until one of them finishes
+ */
+#define MOVIDIUS_MAX_INFLIGHT 2
+
+/**
+ * One inference submitted with movidius_submitInference() that has not been collected yet
+ * A pointer to this is handed to mvncLoadTensor() as the userParam, and mvncGetResult()
+ * gives it back together with the result it belongs to
+ */
+typedef struct
+{
+    /**
+     * Whatever the caller passed to movidius_submitInference()
+     */
+    void* tag;
+
+    /**
+     * Order the requests were submitted in, from movidius_device::nextSequence
+     */
+    unsigned int sequence;
+
+    /**
+     * Non-zero while the tensor is on the device
+     */
+    int busy;
+
+    /**
+     * movidius_profileClockUs() when the tensor was loaded, only set while profiling
+     */
+    unsigned long long submittedUs;
+} movidius_request;
+
+/**
+ * A rectangle in pixels, used to select a part of an input image
+ */
+typedef struct
+{
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+} movidius_rect;
+
 typedef struct
 {
     unsigned char r;
@@ -46,52 +161,49 @@ typedef struct
 } movidius_RGB_f16;
 
 /**
-  * Memset this struct to 0 before calling any of the functions for the first time
-  * Start with movidius_openDevice() to get the device opened,
-  * followed by uploading networks via movidius_uploadNetwork()
-  * After this you can call movidius_runInference() to get results
-  * Before allocating a new network make sure to call movidius_deallocateGraph()
-  */
+ * Most networks that fit in the memory of a stick at the same time
+ */
+#define MOVIDIUS_MAX_GRAPHS 4
+
+/**
+ * One network allocated on a device, with everything that depends on it
+ * A device keeps up to MOVIDIUS_MAX_GRAPHS of these resident, so switching between networks
+ * does not have to read and upload the graph again
+ */
 typedef struct
 {
     /**
-      * Name assigned by the mvnc API to the currently opened device
-      * Make sure this is larger MVNC_MAXNAMESIZE
-      */
-    char dev_name[512];
-
-    /**
-     * Filled in openDevice()
-     * Make sure to close this at some point
+     * The network folder this graph was loaded from, used to find it again
      */
-    void* dev_handle;
+    char networkPath[1024];
 
     /**
-      * Path to a folder containing caffe network files
-      * set this to a value before calling movidius_uploadNetwork()
-      */
-    char networkPath[1024];
+     * The parsed network folder, a movidius_network from the process wide cache
+     * The graph file contents and categories below point into it
+     */
+    void* network;
 
     /**
-     * Contents of the currently loaded graph file, filled in loadGraphData
+     * Contents of the mapped graph file
      */
-    void* graphFileContents;
+    const void* graphFileContents;
 
     /**
-     * Amount of bytes loaded to memory from the above graph file
+     * Size of the above graph file in bytes
      */
     unsigned int graphFileLen;
 
     /**
-     * Handle to a graph that's been uploaded to the movidius device
+     * Handle to the graph uploaded to the movidius device, NULL for an unused slot
      */
-    void* currentGraphHandle;
+    void* handle;
 
     /**
-     * For the currently used network, the list of categories listed in categories.txt
+     * For this network, the list of categories listed in categories.txt
      * The categories.txt is a caffe specific file that defines how many different classification
      * categories there are to be found in the analyzed neural network
      * These are for, for example the gender, the following: male, female, other
+     * Shared with every other graph loaded from the same network, don't modify
      */
     char** categories;
 
@@ -101,13 +213,13 @@ typedef struct
     int numCategories;
 
     /**
-      * The mean value of all data points in the current network, loaded from stats.txt
+      * The mean value of all data points in the network, loaded from stats.txt
       * The stats.txt is generated by using some tool that's part of the movidius API, I think?
       */
     float mean[3];
 
     /**
-     * The standard deviation of all the points in the current network data, loaded from stat.txt
+     * The standard deviation of all the points in the network data, loaded from stat.txt
      * Generated using the same tool as above, I think
      */
     float standard_deviation[3];
@@ -132,15 +244,136 @@ typedef struct
     unsigned int currentImageSize;
 
     /**
-     * buffer for containing the current image into reqsize * reqsize resolution of half floats
+     * buffer for containing the current image into reqsize * reqsize resolution of floats
+     * Only allocated when convertMode is MOVIDIUS_CONVERT_TWO_PASS
      */
     float* scaled_image;
 
     /**
-     * The resolution the currently used network expects the images to be in
+     * The resolution the network expects the images to be in
      */
     unsigned int reqsize;
 
+    /**
+     * Every possible output of the normalization as half floats, indexed by channel * 256 + value
+     * The mean and standard deviation don't change for a loaded network, so movidius_uploadNetwork()
+     * computes these once and movidius_convertImage() only has to look the values up
+     */
+    uint16_t channelLut[MOVIDIUS_LUT_ENTRIES];
+
+    /**
+     * Non-zero when channelLut has been built
+     */
+    int channelLutValid;
+
+    /**
+     * Resampling tables and row buffers kept by movidius_convertFrame() between calls
+     * Created on first use, freed with the graph
+     */
+    void* converter;
+
+    /**
+     * Per layer latency histograms, see movidius_profile.h. NULL until a result is profiled
+     */
+    void* profile;
+
+    /**
+     * Inferences submitted but not collected yet, see movidius_submitInference()
+     */
+    movidius_request requests[MOVIDIUS_MAX_INFLIGHT];
+
+    /**
+     * Number of busy entries in requests
+     */
+    unsigned int numInflight;
+
+    /**
+     * Sequence number the next submitted request gets
+     */
+    unsigned int nextSequence;
+
+    /**
+     * Current MVNC_DONT_BLOCK setting of handle, so it is only changed when needed
+     */
+    int dontBlock;
+
+    /**
+     * The half float output of the last collected inference, lastResultCount values
+     * Points into mvnc's buffer, which stays valid until the next result of this graph is fetched
+     * See movidius_topK()
+     */
+    const uint16_t* lastResult;
+    unsigned int lastResultCount;
+} movidius_graph;
+
+/**
+  * Memset this struct to 0 before calling any of the functions for the first time
+  * Start with movidius_openDevice() to get the device opened,
+  * followed by uploading networks via movidius_uploadNetwork()
+  * After this you can call movidius_runInference() to get results
+  * Uploaded networks stay on the device until movidius_deallocateGraph(), uploading one
+  * that is already there just switches back to it
+  */
+typedef struct
+{
+    /**
+      * Name assigned by the mvnc API to the currently opened device
+      * Make sure this is larger MVNC_MAXNAMESIZE
+      */
+    char dev_name[512];
+
+    /**
+     * Filled in openDevice()
+     * Make sure to close this at some point
+     */
+    void* dev_handle;
+
+    /**
+      * Path to a folder containing caffe network files
+      * set this to a value before calling movidius_uploadNetwork()
+      */
+    char networkPath[1024];
+
+    /**
+     * The networks allocated on the device, slots with a NULL handle are free
+     */
+    movidius_graph graphs[MOVIDIUS_MAX_GRAPHS];
+
+    /**
+     * The network images are converted for and inferences run on, one of graphs
+     * NULL until a network has been uploaded
+     */
+    movidius_graph* graph;
+
+    /**
+     * One of the MOVIDIUS_CONVERT_* values, selects how movidius_convertImage() works
+     * Left at 0 this uses the fastest path. All paths produce identical results
+     */
+    unsigned int convertMode;
+
+    /**
+     * Worker threads splitting movidius_convertFrame() into bands of rows
+     * NULL converts on the calling thread, see movidius_setPreprocessThreads()
+     */
+    void* preprocessPool;
+
+    /**
+     * Sampling policy and latest throttling level and layer timings, see movidius_telemetry.h
+     * Created on first use with the default policy
+     */
+    void* telemetry;
+
+    /**
+     * Non-zero records the layer timings of every result into histograms, see movidius_profile.h
+     */
+    int profiling;
+
+    /**
+     * Set once mvnc reports MVNC_GONE for this stick, after that every call on it
+     * fails with MOVIDIUS_DEVICE_GONE without touching the hardware
+     */
+    int gone;
+
 } movidius_device;
 
 /**
@@ -152,39 +385,128 @@ typedef struct
  */
 extern int movidius_openDevice(movidius_device* dev);
 
+/**
+ * Opens the stick with the given mvnc device name, as listed by mvncGetDeviceName()
+ * Returns 0 on success
+ */
+extern int movidius_openDeviceName(movidius_device* dev, const char* name);
+
 /**
  * Closes the device, frees all allocated buffers, etc
- * @param dealloc_graph: If true, first tries to deallocate any graphs on the device
+ * @param dealloc_graph: If true, first tries to deallocate all graphs on the device
+ * The host side of every graph is freed either way and dev->dev_handle is set to NULL
  * Returns 0 on success
  */
 extern int movidius_closeDevice(movidius_device* dev, bool dealloc_graph);
 
 /**
  * Uploads the caffe network at dev->networkPath onto the movidius device memory
- * Returns 0 on success
+ * and makes it the current network, dev->graph
+ * Networks uploaded earlier stay on the device. If this one is among them, nothing is
+ * read or uploaded, it simply becomes the current network again
+ * Returns 0 on success, NOT_ALLOWED_THIS_TIME if MOVIDIUS_MAX_GRAPHS networks are already
+ * on the device or the current one still has inferences in flight, MOVIDIUS_INTEGRITY_FAILED
+ * if the graph does not match its manifest entry, see movidius_integrity.h
  */
 extern int movidius_uploadNetwork(movidius_device* dev);
 
+/**
+ * Makes a network uploaded earlier the current one, without touching the device
+ * Returns 0 on success, INVALID_INPUT_DATA if no network from network_path is on the device,
+ * NOT_ALLOWED_THIS_TIME if the current network still has inferences in flight
+ */
+extern int movidius_selectNetwork(movidius_device* dev, const char* network_path);
+
 /**
  * Runs the inference for the current device and it's current image
  * The image is stored in the struct by running movidius_convertImage()
- * @param results: A list of dev->numCategories floats to be filled with results,
+ * Blocks until the result is available, and can not be mixed with inferences
+ * still in flight from movidius_submitInference()
+ * @param results: A list of dev->graph->numCategories floats to be filled with results,
  * ie: [male 7%, female 90%, other 3%]
+ * @param num_results: Room in results, MOVIDIUS_RESULTS_TOO_SMALL is returned and results
+ * is left untouched if the network outputs more than that
+ * results can be NULL when only movidius_topK() or movidius_argmax() are needed afterwards,
+ * this skips converting every output to a float
  * Returns 0 on success
  */
-extern int movidius_runInference(movidius_device* dev, float* results);
+extern int movidius_runInference(movidius_device* dev, float* results, unsigned int num_results);
+
+/**
+ * Starts an inference on the current image without waiting for it to finish
+ * mvncLoadTensor() copies the image to the device before returning, so the next image can
+ * be converted right away while the device is busy with this one
+ * @param tag: Anything, handed back by movidius_pollInference() or movidius_waitInference()
+ * together with the results of this image
+ * Returns 0 on success, MOVIDIUS_QUEUE_FULL if MOVIDIUS_MAX_INFLIGHT inferences are already
+ * running, collect one of them first
+ */
+extern int movidius_submitInference(movidius_device* dev, void* tag);
+
+/**
+ * Collects the oldest submitted inference if the device has finished it
+ * @param results, num_results: Filled like in movidius_runInference()
+ * @param tag: If not NULL, set to the tag the inference was submitted with
+ * Returns 0 on success, MOVIDIUS_RESULT_PENDING if the device is still working on it
+ * and NOT_ALLOWED_THIS_TIME if nothing has been submitted
+ * If fetching the result fails, the oldest request is given up on and the error is returned
+ * with its tag, so the caller can resubmit that image. MOVIDIUS_DEVICE_GONE means the device
+ * is not usable anymore and the image should go elsewhere
+ */
+extern int movidius_pollInference(movidius_device* dev, float* results, unsigned int num_results, void** tag);
+
+/**
+ * Like movidius_pollInference(), but blocks until the oldest submitted inference is done
+ */
+extern int movidius_waitInference(movidius_device* dev, float* results, unsigned int num_results, void** tag);
+
+/**
+ * Gives up on every inference in flight on the current network without collecting them, for a
+ * device that cannot deliver their results. Deallocate the network afterwards, results still
+ * arriving for it could not be told apart from those of later inferences
+ * Returns the number of inferences given up on
+ */
+extern unsigned int movidius_abandonInferences(movidius_device* dev);
 
 /**
- * Deallocates the currently used graph on the device
+ * Number of heap allocations made on the inference path so far: image buffers, conversion
+ * scratch space and profiling tables
+ * These are sized by the first inferences of a network, after that converting, submitting and
+ * collecting allocates nothing and the count stays the same. Tests can check that after a warm-up
+ */
+extern unsigned long movidius_allocationCount();
+
+/**
+ * Adds one to movidius_allocationCount(), for the modules allocating on the inference path
+ */
+extern void movidius_countAllocation();
+
+/**
+ * Deallocates the currently used graph on the device, other resident graphs stay
  * Apparently the deallocation call does not exist on all devices though?
  * Returns 0 on success, pointers are set to NULL, host memory is freed
+ * NOT_ALLOWED_THIS_TIME if the graph still has inferences in flight, collect them first or
+ * give up on them with movidius_abandonInferences()
  */
 extern int movidius_deallocateGraph(movidius_device* dev);
 
+/**
+ * Deallocates the graph uploaded from network_path, whether it is the current one or not
+ * Returns 0 on success, INVALID_INPUT_DATA if no network from network_path is on the device,
+ * NOT_ALLOWED_THIS_TIME if that graph still has inferences in flight
+ */
+extern int movidius_deallocateNetwork(movidius_device* dev, const char* network_path);
+
+/**
+ * Deallocates every graph on the device
+ * Returns 0 on success, otherwise the error of the last graph that failed
+ */
+extern int movidius_deallocateAllGraphs(movidius_device* dev);
+
 /**
  * Reads the given RGB888 image and converts its data into the internal float16 buffer,
  * to the format which movidius API expects. If the given image resolution does not match
- * dev->reqsize, error is printed and nothing is done
+ * dev->reqsize, the image is scaled with movidius_convertImageRegion() using bilinear filtering
  * This function also applies the following function on the target image pixels:
  *
  *      (pixeldata - mean) * standard_deviation
@@ -194,4 +516,39 @@ extern int movidius_deallocateGraph(movidius_device* dev);
  */
 extern int movidius_convertImage(movidius_RGB* colorimage, unsigned int color_width, unsigned int color_height, movidius_device* dev);
 
+/**
+ * Like movidius_convertImage(), but takes any part of any size RGB888 image
+ * Same as movidius_convertFrame() with MOVIDIUS_PIXEL_RGB
+ */
+extern int movidius_convertImageRegion(const movidius_RGB* colorimage, unsigned int color_width,
+                                       unsigned int color_height, unsigned int stride,
+                                       const movidius_rect* roi, int filter, movidius_device* dev);
+
+/**
+ * Converts any part of a camera frame straight into the internal float16 buffer
+ * The region is read in the given pixel format, cropped, scaled to dev->reqsize * dev->reqsize,
+ * normalized and stored as half floats in one pass, without intermediate full size copies
+ * @param format: One of the MOVIDIUS_PIXEL_* values. NV12 and YUYV frames must have an even width,
+ * NV12 frames an even height too
+ * @param stride: Bytes between the starts of two rows, for NV12 the luma row stride
+ * @param roi: The part of the frame to use, or NULL for the whole frame
+ * @param filter: One of the MOVIDIUS_RESIZE_* values, only used when the roi is not dev->reqsize sized
+ * Returns 0 on success
+ */
+extern int movidius_convertFrame(const unsigned char* pixels, int format, unsigned int width,
+                                 unsigned int height, unsigned int stride, const movidius_rect* roi,
+                                 int filter, movidius_device* dev);
+
+/**
+ * Spreads the image conversion done by movidius_convertFrame() and friends over threads
+ * The calling thread always takes part, so threads is the total amount of threads used
+ * and 0 or 1 goes back to converting on the calling thread only
+ * @param cpus: If not NULL, the extra threads are pinned to these cpus in turn, for example
+ * the cores of the NUMA node the camera frames are written to
+ * @param ncpus: Number of entries in cpus
+ * Returns 0 on success
+ */
+extern int movidius_setPreprocessThreads(movidius_device* dev, unsigned int threads,
+                                         const int* cpus, unsigned int ncpus);
+
 #endif // MOVIDIUSDEVICE_H
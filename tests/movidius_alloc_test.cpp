@@ -0,0 +1,218 @@
+#include <stdint.h>
+#include <atomic>
+#include <new>
+#include <vector>
+
+#include "movidius_test.h"
+#include "movidius_telemetry.h"
+
+/**
+ * Checks that inferring allocates nothing once the first inferences sized the buffers
+ * malloc() and operator new are replaced in this binary only, so every heap allocation is counted:
+ * the library's own, the C++ library's and the simulated sticks'. After a warm-up the single stick
+ * calls and movidius_poolRunBatch() run again and the count must stay the same
+ * Usage: movidius_alloc_test
+ */
+
+static std::atomic<unsigned long> test_allocations(0);
+
+#ifdef __GLIBC__
+extern "C"
+{
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* p, size_t size);
+extern void __libc_free(void* p);
+
+void* malloc(size_t size)
+{
+    test_allocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    test_allocations++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size)
+{
+    test_allocations++;
+    return __libc_realloc(p, size);
+}
+
+void free(void* p)
+{
+    __libc_free(p);
+}
+}
+
+/**
+ * Goes through the counting malloc() above
+ */
+static void* test_new(size_t size)
+{
+    void* p = malloc(size != 0 ? size : 1);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+#else
+/**
+ * Without glibc only operator new is counted
+ */
+static void* test_new(size_t size)
+{
+    test_allocations++;
+    void* p = malloc(size != 0 ? size : 1);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+#endif
+
+void* operator new(size_t size)
+{
+    return test_new(size);
+}
+
+void* operator new[](size_t size)
+{
+    return test_new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+static const unsigned int test_categories = 3;
+static const unsigned int test_batchSize = 40;
+static const unsigned int test_frameWidth = 64;
+static const unsigned int test_frameHeight = 48;
+
+/**
+ * The calls that must not allocate once warmed up: converting camera frames of two formats and
+ * sizes, movidius_runInference(), submitting and collecting through the pool, and a batch
+ * Returns the number of calls that failed
+ */
+static unsigned int test_infer(movidius_pool* pool, const std::vector<unsigned char>& frame,
+                               const std::vector<movidius_batchitem>& items, std::vector<float>& results,
+                               std::vector<int>& status)
+{
+    unsigned int failed = 0;
+    movidius_rect roi = { 4, 2, 32, 32 };
+    float single[test_categories];
+
+    for (unsigned int i = 0; i < pool->numDevices; i++)
+    {
+        movidius_device* dev = &pool->devices[i];
+        failed += movidius_convertFrame(frame.data(), MOVIDIUS_PIXEL_RGB, test_frameWidth, test_frameHeight,
+                                        test_frameWidth * 3, &roi, MOVIDIUS_RESIZE_AREA, dev) != 0;
+        failed += movidius_runInference(dev, single, test_categories) != 0;
+    }
+
+    for (unsigned int i = 0; i < pool->numDevices; i++)
+    {
+        movidius_device* dev = NULL;
+        failed += movidius_poolAcquire(pool, &dev) != 0;
+        if (dev == NULL)
+            continue;
+        failed += movidius_convertFrame(frame.data(), MOVIDIUS_PIXEL_BGRA, test_frameWidth, test_frameHeight,
+                                        test_frameWidth * 4, NULL, MOVIDIUS_RESIZE_BILINEAR, dev) != 0;
+        failed += movidius_poolSubmit(pool, dev, (void*)(uintptr_t)i) != 0;
+    }
+    while (pool->numOrder > 0)
+        failed += movidius_poolWait(pool, single, test_categories, NULL, NULL) != 0;
+
+    failed += movidius_poolRunBatch(pool, items.data(), (unsigned int)items.size(), MOVIDIUS_RESIZE_AREA,
+                                    results.data(), test_categories, status.data()) != 0;
+    return failed;
+}
+
+int main()
+{
+    std::string dir;
+    if (test_makeNetwork(dir, test_categories) != 0)
+        return 1;
+
+    movidius_simconfig config;
+    memset(&config, 0, sizeof(config));
+    config.devices = 2;
+    config.outputs = test_categories;
+    config.stages = 5;
+
+    movidius_pool pool;
+    TEST_CHECK(test_openPool(&pool, config, dir) == 0);
+
+    // profiling and telemetry run on every inference too
+    for (unsigned int i = 0; i < pool.numDevices; i++)
+    {
+        pool.devices[i].profiling = 1;
+        movidius_setTelemetry(&pool.devices[i], MOVIDIUS_TELEMETRY_EVERY, 1, 0);
+        movidius_setPreprocessThreads(&pool.devices[i], 2, NULL, 0);
+    }
+
+    // one gray value, every crop of it converts to the same image whatever the format and filter
+    std::vector<unsigned char> frame(test_frameWidth * test_frameHeight * 4, 77);
+    movidius_rect crops[2] = { { 0, 0, 32, 32 }, { 10, 5, 40, 40 } };
+    std::vector<movidius_batchitem> items(test_batchSize);
+    for (unsigned int i = 0; i < test_batchSize; i++)
+    {
+        bool bgra = i % 3 == 0;
+        movidius_batchitem item = { frame.data(), bgra ? MOVIDIUS_PIXEL_BGRA : MOVIDIUS_PIXEL_RGB,
+                                    test_frameWidth, test_frameHeight, test_frameWidth * (bgra ? 4 : 3),
+                                    &crops[i % 2] };
+        items[i] = item;
+    }
+    std::vector<float> results(test_batchSize * test_categories);
+    std::vector<int> status(test_batchSize);
+
+    TEST_CHECK(test_infer(&pool, frame, items, results, status) == 0);
+
+    unsigned long warm = test_allocations;
+    unsigned long warmLibrary = movidius_allocationCount();
+    unsigned int failed = 0;
+    for (unsigned int run = 0; run < 10; run++)
+        failed += test_infer(&pool, frame, items, results, status);
+    unsigned long steady = test_allocations - warm;
+    unsigned long steadyLibrary = movidius_allocationCount() - warmLibrary;
+
+    TEST_CHECK(failed == 0);
+    for (unsigned int i = 0; i < test_batchSize; i++)
+        TEST_CHECK(status[i] == 0 && test_isResultOf(results[i * test_categories], 77));
+    TEST_CHECK(steady == 0);
+    TEST_CHECK(steadyLibrary == 0);
+    printf("%lu heap allocations after the warm-up, %lu of them by the library\n", steady, steadyLibrary);
+
+    // a results array that is too small is refused before anything is written
+    float small[test_categories] = { -5.0f, -5.0f, -5.0f };
+    movidius_device* dev = &pool.devices[0];
+    TEST_CHECK(movidius_convertFrame(frame.data(), MOVIDIUS_PIXEL_RGB, test_frameWidth, test_frameHeight,
+                                     test_frameWidth * 3, NULL, MOVIDIUS_RESIZE_AREA, dev) == 0);
+    TEST_CHECK(movidius_runInference(dev, small, test_categories - 1) == MOVIDIUS_RESULTS_TOO_SMALL);
+    TEST_CHECK(small[0] == -5.0f);
+    TEST_CHECK(dev->graph->numInflight == 0);
+
+    movidius_closePool(&pool);
+    movidius_simRemoveNetwork(dir.c_str());
+
+    printf("%d failed checks\n", test_failures);
+    return test_failures != 0;
+}
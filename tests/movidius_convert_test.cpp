@@ -0,0 +1,150 @@
+#include <stdint.h>
+#include <vector>
+
+#include "movidius_network.h"
+#include "movidius_test.h"
+
+/**
+ * Checks that movidius_convertImage() gives bit identical half floats with MOVIDIUS_CONVERT_TWO_PASS,
+ * MOVIDIUS_CONVERT_FUSED and MOVIDIUS_CONVERT_LUT
+ * Random images of every network input size below are converted with each path, on the calling
+ * thread and split over preprocessing threads. The sizes include odd ones and the widths around
+ * powers of two, where the vector loops end with and without a scalar tail
+ * Usage: movidius_convert_test
+ */
+
+static const unsigned int test_sizes[] = { 1, 2, 3, 5, 7, 8, 15, 16, 17, 31, 33, 63, 64, 65,
+                                           127, 128, 129, 224, 227, 255, 256, 257, 300 };
+
+static const unsigned int test_threads[] = { 1, 3 };
+
+static const unsigned int test_images = 3;
+
+/**
+ * Per channel statistics that are not exact in binary, unlike those movidius_simWriteNetwork() writes
+ */
+static int test_writeStats(const std::string& dir)
+{
+    FILE* fp = fopen((dir + "/stat.txt").c_str(), "w");
+    if (fp == NULL)
+        return 1;
+
+    fprintf(fp, "0.485 0.456 0.406\n0.229 0.224 0.225\n");
+    return fclose(fp) != 0;
+}
+
+/**
+ * Converts image with mode and copies the half floats into out
+ */
+static int test_convert(movidius_device* dev, int mode, std::vector<movidius_RGB>& image, unsigned int size,
+                        std::vector<uint16_t>& out)
+{
+    dev->convertMode = mode;
+    int rc = movidius_convertImage(image.data(), size, size, dev);
+
+    const uint16_t* halves = (const uint16_t*)dev->graph->movidius_image;
+    out.assign(halves, halves + 3 * size * size);
+    return rc;
+}
+
+/**
+ * Counts the half floats that differ from the two pass reference, printing the first few
+ */
+static unsigned long test_compare(const char* name, unsigned int size, const std::vector<uint16_t>& reference,
+                                  const std::vector<uint16_t>& halves)
+{
+    unsigned long mismatches = 0;
+    for (size_t i = 0; i < reference.size(); i++)
+    {
+        if (halves[i] != reference[i])
+        {
+            if (mismatches++ < 5)
+                fprintf(stderr, "%s %ux%u: value %zu is %04x instead of %04x\n", name, size, size, i, halves[i],
+                        reference[i]);
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Uploads a network of the given input size and compares the paths on random images
+ * Returns the number of mismatching half floats, or 1 if something failed outright
+ */
+static unsigned long test_size(movidius_device* dev, unsigned int size, unsigned int& seed)
+{
+    std::string dir;
+    if (test_makeNetwork(dir, 3) != 0 || movidius_simWriteNetwork(dir.c_str(), 3, size, 1) != 0 ||
+        test_writeStats(dir) != 0)
+    {
+        fprintf(stderr, "Cannot write a network of size %u\n", size);
+        return 1;
+    }
+
+    strcpy(dev->networkPath, dir.c_str());
+    unsigned long mismatches = 0;
+    if (movidius_uploadNetwork(dev) != 0)
+        mismatches = 1;
+
+    std::vector<movidius_RGB> image(size * size);
+    std::vector<uint16_t> reference, fused, lut;
+
+    for (unsigned int n = 0; n < test_images && mismatches == 0; n++)
+    {
+        unsigned char* bytes = (unsigned char*)image.data();
+        for (size_t b = 0; b < 3 * image.size(); b++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            bytes[b] = (unsigned char)(seed >> 16);
+        }
+
+        for (size_t t = 0; t < sizeof(test_threads) / sizeof(test_threads[0]); t++)
+        {
+            movidius_setPreprocessThreads(dev, test_threads[t], NULL, 0);
+
+            if (test_convert(dev, MOVIDIUS_CONVERT_TWO_PASS, image, size, reference) != 0 ||
+                test_convert(dev, MOVIDIUS_CONVERT_FUSED, image, size, fused) != 0 ||
+                test_convert(dev, MOVIDIUS_CONVERT_LUT, image, size, lut) != 0)
+            {
+                fprintf(stderr, "Converting a %ux%u image failed\n", size, size);
+                return 1;
+            }
+
+            mismatches += test_compare("fused", size, reference, fused);
+            mismatches += test_compare("lut", size, reference, lut);
+        }
+    }
+
+    movidius_setPreprocessThreads(dev, 1, NULL, 0);
+    dev->convertMode = MOVIDIUS_CONVERT_DEFAULT;
+    movidius_deallocateGraph(dev);
+    movidius_flushNetworkCache();
+    movidius_simRemoveNetwork(dir.c_str());
+    return mismatches;
+}
+
+int main()
+{
+    movidius_simconfig config;
+    memset(&config, 0, sizeof(config));
+    config.devices = 1;
+    config.outputs = 3;
+    movidius_setBackend(movidius_simBackend(&config));
+
+    movidius_device dev;
+    memset(&dev, 0, sizeof(dev));
+    if (movidius_openDevice(&dev) != 0)
+        return 1;
+
+    // the same images every run
+    unsigned int seed = 12345;
+
+    for (size_t s = 0; s < sizeof(test_sizes) / sizeof(test_sizes[0]); s++)
+    {
+        unsigned long mismatches = test_size(&dev, test_sizes[s], seed);
+        printf("%3ux%-3u %lu mismatches\n", test_sizes[s], test_sizes[s], mismatches);
+        TEST_CHECK(mismatches == 0);
+    }
+
+    movidius_closeDevice(&dev, true);
+    return test_failures != 0;
+}
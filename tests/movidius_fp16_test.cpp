@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "movidius_fp16.h"
+
+/**
+ * Checks every floattofp16()/fp16tofloat() kernel the CPU supports against float2half() and half2float()
+ * All 65536 half floats are converted to floats, and a dense sample of floats to half floats: every
+ * float at a fixed stride over the whole 32 bit range, plus the floats around every rounding boundary
+ * --full converts every float instead of the sample, which takes a few minutes per kernel
+ * Usage: movidius_fp16_test [--full]
+ */
+
+static const int test_kernels[] = { FP16_KERNEL_SCALAR, FP16_KERNEL_BRANCHLESS, FP16_KERNEL_F16C,
+                                    FP16_KERNEL_AVX512, FP16_KERNEL_NEON };
+
+/**
+ * Floats converted per call, not a multiple of the vector widths so the tail loops run too
+ */
+static const unsigned int test_chunk = (1 << 16) - 3;
+
+static unsigned long test_halfToFloat(int kernel)
+{
+    std::vector<unsigned short> halves(65536);
+    std::vector<unsigned int> floats(65536);
+    for (unsigned int h = 0; h < 65536; h++)
+        halves[h] = (unsigned short)h;
+
+    fp16tofloat((float*)floats.data(), (unsigned char*)halves.data(), 65536);
+
+    unsigned long mismatches = 0;
+    for (unsigned int h = 0; h < 65536; h++)
+    {
+        if (floats[h] != half2float((unsigned short)h))
+        {
+            if (mismatches++ < 5)
+                fprintf(stderr, "%s: half %04x gave %08x instead of %08x\n", fp16_kernelName(kernel), h,
+                        floats[h], half2float((unsigned short)h));
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Converts count floats and compares them to float2half()
+ */
+static unsigned long test_floatsToHalf(int kernel, std::vector<unsigned int>& floats, unsigned int count,
+                                       std::vector<unsigned short>& halves)
+{
+    floattofp16((unsigned char*)halves.data(), (float*)floats.data(), count);
+
+    unsigned long mismatches = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (halves[i] != float2half(floats[i]))
+        {
+            if (mismatches++ < 5)
+                fprintf(stderr, "%s: float %08x gave %04x instead of %04x\n", fp16_kernelName(kernel), floats[i],
+                        halves[i], float2half(floats[i]));
+        }
+    }
+    return mismatches;
+}
+
+static unsigned long test_floatToHalf(int kernel, bool full)
+{
+    std::vector<unsigned int> floats(test_chunk);
+    std::vector<unsigned short> halves(test_chunk);
+    unsigned long mismatches = 0;
+
+    // a prime stride walks through every exponent with ever changing low significand bits
+    const unsigned long long stride = full ? 1 : 251;
+    unsigned int count = 0;
+    for (unsigned long long f = 0; f < (1ull << 32); f += stride)
+    {
+        floats[count++] = (unsigned int)f;
+        if (count == test_chunk)
+        {
+            mismatches += test_floatsToHalf(kernel, floats, count, halves);
+            count = 0;
+        }
+    }
+
+    // the floats halfway between two half floats and their neighbours, where rounding goes wrong
+    for (unsigned int h = 0; h < 65536; h++)
+    {
+        unsigned int f = half2float((unsigned short)h);
+        for (int delta = -2; delta <= 2; delta++)
+        {
+            floats[count++] = f + 0x1000u + (unsigned int)delta;
+            floats[count++] = f + (unsigned int)delta;
+        }
+        if (count + 10 > test_chunk)
+        {
+            mismatches += test_floatsToHalf(kernel, floats, count, halves);
+            count = 0;
+        }
+    }
+
+    return mismatches + test_floatsToHalf(kernel, floats, count, halves);
+}
+
+int main(int argc, char** argv)
+{
+    bool full = argc > 1 && strcmp(argv[1], "--full") == 0;
+    int failed = 0;
+
+    for (size_t k = 0; k < sizeof(test_kernels) / sizeof(test_kernels[0]); k++)
+    {
+        int kernel = test_kernels[k];
+        if (fp16_selectKernel(kernel) != 0)
+        {
+            printf("%-10s not supported, skipped\n", fp16_kernelName(kernel));
+            continue;
+        }
+
+        unsigned long toFloat = test_halfToFloat(kernel);
+        unsigned long toHalf = test_floatToHalf(kernel, full);
+        printf("%-10s %lu half to float and %lu float to half mismatches\n", fp16_kernelName(kernel), toFloat, toHalf);
+
+        if (toFloat != 0 || toHalf != 0)
+            failed = 1;
+    }
+
+    fp16_selectKernel(FP16_KERNEL_AUTO);
+    return failed;
+}
@@ -0,0 +1,122 @@
+#include "movidius_test.h"
+#include "movidius_integrity.h"
+
+/**
+ * Uploads a simulated network with a wrong and with the right manifest hash, counting the
+ * mvncAllocateGraph() calls that reach the stick
+ * A blocking check, and a hash kept from an earlier upload, must refuse a bad graph before it is
+ * allocated. The background check allocates while hashing and deallocates the graph again
+ * Usage: movidius_integrity_test
+ */
+
+static const movidius_backend* test_sim = NULL;
+static unsigned int test_allocations = 0;
+static unsigned int test_deallocations = 0;
+
+static mvncStatus test_allocateGraph(void* deviceHandle, void** graphHandle, const void* graphFile,
+                                     unsigned int graphFileLength)
+{
+    test_allocations++;
+    return test_sim->allocateGraph(deviceHandle, graphHandle, graphFile, graphFileLength);
+}
+
+static mvncStatus test_deallocateGraph(void* graphHandle)
+{
+    test_deallocations++;
+    return test_sim->deallocateGraph(graphHandle);
+}
+
+/**
+ * The hex SHA-256 of the graph in dir, as sha256sum would print it
+ */
+static std::string test_graphHash(const std::string& dir)
+{
+    movidius_network* network = movidius_acquireNetwork(dir.c_str());
+    if (network == NULL)
+        return std::string(64, '0');
+
+    unsigned char hash[32];
+    movidius_networkGraphHash(network, hash);
+    movidius_releaseNetwork(network);
+
+    char hex[65];
+    for (int i = 0; i < 32; i++)
+        snprintf(hex + 2 * i, 3, "%02x", hash[i]);
+    return hex;
+}
+
+/**
+ * Uploads the network in dir to dev, forgetting cached networks first so the graph is hashed
+ * again unless keep_hash is set
+ * Returns what movidius_uploadNetwork() returned, the graph is deallocated again on success
+ */
+static int test_upload(movidius_device* dev, const std::string& dir, bool keep_hash)
+{
+    if (!keep_hash)
+        movidius_flushNetworkCache();
+
+    strcpy(dev->networkPath, dir.c_str());
+    int rc = movidius_uploadNetwork(dev);
+    if (rc == 0)
+        movidius_deallocateGraph(dev);
+    return rc;
+}
+
+int main()
+{
+    std::string dir;
+    if (test_makeNetwork(dir, 3) != 0)
+        return 1;
+
+    std::string right = test_graphHash(dir);
+    std::string wrong = right;
+    wrong[0] = wrong[0] == '0' ? '1' : '0';
+
+    movidius_simconfig config;
+    memset(&config, 0, sizeof(config));
+    config.devices = 1;
+    config.outputs = 3;
+
+    test_sim = movidius_simBackend(&config);
+    movidius_backend backend = *test_sim;
+    backend.allocateGraph = test_allocateGraph;
+    backend.deallocateGraph = test_deallocateGraph;
+    movidius_setBackend(&backend);
+
+    movidius_device dev;
+    memset(&dev, 0, sizeof(dev));
+    TEST_CHECK(movidius_openDevice(&dev) == 0);
+
+    // blocking: the bad graph never reaches the stick
+    TEST_CHECK(movidius_addExpectedHash(dir.c_str(), wrong.c_str()) == 0);
+    movidius_setIntegrityMode(MOVIDIUS_INTEGRITY_BLOCKING);
+    TEST_CHECK(test_upload(&dev, dir, false) == MOVIDIUS_INTEGRITY_FAILED);
+    TEST_CHECK(test_allocations == 0);
+    TEST_CHECK(dev.graph == NULL);
+
+    // background: allocated while hashing, then deallocated when the hash turns out wrong
+    movidius_setIntegrityMode(MOVIDIUS_INTEGRITY_BACKGROUND);
+    TEST_CHECK(test_upload(&dev, dir, false) == MOVIDIUS_INTEGRITY_FAILED);
+    TEST_CHECK(test_allocations == 1);
+    TEST_CHECK(test_deallocations == 1);
+    TEST_CHECK(dev.graph == NULL);
+
+    // the hash is known from the last upload now, background mode refuses before allocating too
+    TEST_CHECK(test_upload(&dev, dir, true) == MOVIDIUS_INTEGRITY_FAILED);
+    TEST_CHECK(test_allocations == 1);
+
+    // the right hash uploads in both modes, whether it is known already or not
+    TEST_CHECK(movidius_addExpectedHash(dir.c_str(), right.c_str()) == 0);
+    TEST_CHECK(test_upload(&dev, dir, true) == 0);
+    TEST_CHECK(test_upload(&dev, dir, false) == 0);
+    movidius_setIntegrityMode(MOVIDIUS_INTEGRITY_BLOCKING);
+    TEST_CHECK(test_upload(&dev, dir, false) == 0);
+    TEST_CHECK(test_allocations == 4);
+
+    movidius_closeDevice(&dev, true);
+    movidius_flushNetworkCache();
+    movidius_simRemoveNetwork(dir.c_str());
+
+    printf("%d failed checks\n", test_failures);
+    return test_failures != 0;
+}
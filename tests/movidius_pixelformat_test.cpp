@@ -0,0 +1,211 @@
+#include <stdint.h>
+#include <vector>
+
+#include "movidius_network.h"
+#include "movidius_test.h"
+
+/**
+ * Checks every MOVIDIUS_PIXEL_* format against MOVIDIUS_PIXEL_RGB through movidius_convertFrame()
+ * Each frame is made from random pixels, and the same pixels are also written as packed RGB. For
+ * the YUV formats that RGB comes from the BT.601 formula below, computed one pixel at a time. Both
+ * frames must convert to identical half floats. Strides are padded with random bytes, and the
+ * regions start at odd x so chroma pairs are split and the vector loops get tails
+ * Usage: movidius_pixelformat_test
+ */
+
+static const int test_formats[] = { MOVIDIUS_PIXEL_BGR, MOVIDIUS_PIXEL_RGBA, MOVIDIUS_PIXEL_BGRA,
+                                    MOVIDIUS_PIXEL_NV12, MOVIDIUS_PIXEL_YUYV };
+
+static const char* const test_formatNames[] = { "rgb", "bgr", "rgba", "bgra", "nv12", "yuyv" };
+
+/**
+ * Network input sizes: a multiple of the vector width, and one with a tail after the vectors
+ */
+static const unsigned int test_sizes[] = { 16, 37 };
+
+/**
+ * Frame size, even for the chroma subsampled formats, and the padding after every row
+ */
+static const unsigned int test_width = 102;
+static const unsigned int test_height = 58;
+static const unsigned int test_padding = 13;
+
+static unsigned int test_seed = 12345;
+
+static unsigned char test_random()
+{
+    test_seed = test_seed * 1103515245u + 12345u;
+    return (unsigned char)(test_seed >> 16);
+}
+
+static unsigned char test_clamp(int value)
+{
+    return (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+/**
+ * BT.601 limited range in 8 bit fixed point, the conversion movidius_pixelformat.cpp documents
+ */
+static void test_yuvToRgb(int y, int u, int v, unsigned char* rgb)
+{
+    int c = 298 * (y - 16) + 128;
+    int d = u - 128;
+    int e = v - 128;
+
+    rgb[0] = test_clamp((c + 409 * e) >> 8);
+    rgb[1] = test_clamp((c - 100 * d - 208 * e) >> 8);
+    rgb[2] = test_clamp((c + 516 * d) >> 8);
+}
+
+/**
+ * Fills frame with random pixels of format and padding, and rgb with the same pixels as packed RGB
+ * Returns the stride of frame
+ */
+static unsigned int test_makeFrame(int format, std::vector<unsigned char>& frame, std::vector<unsigned char>& rgb)
+{
+    unsigned int bytes = format == MOVIDIUS_PIXEL_NV12 ? 1 : (format == MOVIDIUS_PIXEL_YUYV ? 2 : 3);
+    if (format == MOVIDIUS_PIXEL_RGBA || format == MOVIDIUS_PIXEL_BGRA)
+        bytes = 4;
+
+    unsigned int stride = bytes * test_width + test_padding;
+    unsigned int rows = format == MOVIDIUS_PIXEL_NV12 ? test_height + test_height / 2 : test_height;
+    frame.resize((size_t)stride * rows);
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = test_random();
+
+    rgb.resize(3 * test_width * test_height);
+    for (unsigned int y = 0; y < test_height; y++)
+    {
+        const unsigned char* row = &frame[(size_t)y * stride];
+        const unsigned char* chroma = &frame[(size_t)(test_height + y / 2) * stride];
+
+        for (unsigned int x = 0; x < test_width; x++)
+        {
+            unsigned char* out = &rgb[3 * (y * test_width + x)];
+            const unsigned char* in = row + bytes * x;
+            unsigned int pair = x & ~1u;
+
+            switch (format)
+            {
+            case MOVIDIUS_PIXEL_BGR:
+            case MOVIDIUS_PIXEL_BGRA:
+                out[0] = in[2];
+                out[1] = in[1];
+                out[2] = in[0];
+                break;
+            case MOVIDIUS_PIXEL_RGBA:
+                out[0] = in[0];
+                out[1] = in[1];
+                out[2] = in[2];
+                break;
+            case MOVIDIUS_PIXEL_NV12:
+                test_yuvToRgb(row[x], chroma[pair], chroma[pair + 1], out);
+                break;
+            case MOVIDIUS_PIXEL_YUYV:
+                test_yuvToRgb(row[2 * x], row[2 * pair + 1], row[2 * pair + 3], out);
+                break;
+            }
+        }
+    }
+
+    return stride;
+}
+
+/**
+ * Converts roi of the frame and of the packed RGB copy, and counts the half floats that differ
+ */
+static unsigned long test_compare(movidius_device* dev, int format, const std::vector<unsigned char>& frame,
+                                  unsigned int stride, const std::vector<unsigned char>& rgb,
+                                  const movidius_rect& roi, int filter)
+{
+    if (movidius_convertFrame(rgb.data(), MOVIDIUS_PIXEL_RGB, test_width, test_height, 3 * test_width, &roi,
+                              filter, dev) != 0)
+        return 1;
+
+    // the image buffer is allocated by the first conversion
+    unsigned int count = 3 * dev->graph->reqsize * dev->graph->reqsize;
+    const uint16_t* halves = (const uint16_t*)dev->graph->movidius_image;
+    std::vector<uint16_t> expected(halves, halves + count);
+
+    if (movidius_convertFrame(frame.data(), format, test_width, test_height, stride, &roi, filter, dev) != 0)
+        return 1;
+
+    unsigned long mismatches = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        if (halves[i] != expected[i])
+        {
+            if (mismatches++ < 5)
+                fprintf(stderr, "%s region %u, %u, %u x %u: pixel %u channel %u is %04x instead of %04x\n",
+                        test_formatNames[format], roi.x, roi.y, roi.width, roi.height, i / 3, i % 3, halves[i],
+                        expected[i]);
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Uploads a network of the given size and compares every format on unscaled and scaled regions
+ */
+static void test_size(movidius_device* dev, unsigned int size)
+{
+    std::string dir;
+    TEST_CHECK(test_makeNetwork(dir, 3) == 0);
+    TEST_CHECK(movidius_simWriteNetwork(dir.c_str(), 3, size, 1) == 0);
+    strcpy(dev->networkPath, dir.c_str());
+    TEST_CHECK(movidius_uploadNetwork(dev) == 0);
+    if (dev->graph == NULL)
+        return;
+
+    // unscaled at even and odd x up to the right edge, then scaled with both filters
+    const movidius_rect regions[] = { { 0, 0, size, size },
+                                      { 1, 3, size, size },
+                                      { 7, 1, size, size },
+                                      { test_width - size, test_height - size, size, size },
+                                      { test_width - size - 1, 2, size, size },
+                                      { 3, 5, 77, 45 },
+                                      { 0, 0, test_width, test_height } };
+
+    std::vector<unsigned char> frame, rgb;
+    for (size_t f = 0; f < sizeof(test_formats) / sizeof(test_formats[0]); f++)
+    {
+        int format = test_formats[f];
+        unsigned int stride = test_makeFrame(format, frame, rgb);
+
+        unsigned long mismatches = 0;
+        for (size_t r = 0; r < sizeof(regions) / sizeof(regions[0]); r++)
+        {
+            mismatches += test_compare(dev, format, frame, stride, rgb, regions[r], MOVIDIUS_RESIZE_BILINEAR);
+            mismatches += test_compare(dev, format, frame, stride, rgb, regions[r], MOVIDIUS_RESIZE_AREA);
+        }
+
+        printf("%-5s %2ux%-2u %lu mismatches\n", test_formatNames[format], size, size, mismatches);
+        TEST_CHECK(mismatches == 0);
+    }
+
+    movidius_deallocateGraph(dev);
+    movidius_flushNetworkCache();
+    movidius_simRemoveNetwork(dir.c_str());
+}
+
+int main()
+{
+    movidius_simconfig config;
+    memset(&config, 0, sizeof(config));
+    config.devices = 1;
+    config.outputs = 3;
+    movidius_setBackend(movidius_simBackend(&config));
+
+    movidius_device dev;
+    memset(&dev, 0, sizeof(dev));
+    if (movidius_openDevice(&dev) != 0)
+        return 1;
+
+    for (size_t s = 0; s < sizeof(test_sizes) / sizeof(test_sizes[0]); s++)
+        test_size(&dev, test_sizes[s]);
+
+    movidius_closeDevice(&dev, true);
+
+    printf("%d failed checks\n", test_failures);
+    return test_failures != 0;
+}
@@ -0,0 +1,491 @@
+#include <stdint.h>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include "movidius_telemetry.h"
+#include "movidius_test.h"
+
+/**
+ * Runs the device pool on simulated sticks: least outstanding scheduling, images lost to an
+ * unplugged stick or a failing mvncGetResult() being run again, movidius_poolRunBatch(), a stick
+ * failing a batch without giving up its items, deallocating with inferences in flight, and
+ * scheduling by thermal throttling level
+ * Usage: movidius_pool_test
+ */
+
+/**
+ * Fills the input of dev with an image of value and submits it with the image's index as tag
+ */
+static int test_submit(movidius_pool* pool, movidius_device* dev, unsigned int index, unsigned char value)
+{
+    std::vector<movidius_RGB> image(test_inputSize * test_inputSize);
+    memset(image.data(), value, image.size() * sizeof(movidius_RGB));
+
+    int rc = movidius_convertImage(image.data(), test_inputSize, test_inputSize, dev);
+    if (rc != 0)
+        return rc;
+
+    return movidius_poolSubmit(pool, dev, (void*)(uintptr_t)index);
+}
+
+/**
+ * Runs images 0 to count - 1, each filled with its index, submitting the ones that are lost again
+ * The stick at unplug_index is pulled out after unplug_after submissions, 0 never does
+ * collected gets the number of results every image got, returns the number of lost inferences
+ */
+static unsigned int test_runImages(movidius_pool* pool, unsigned int count, unsigned int unplug_after,
+                                   unsigned int unplug_index, std::vector<unsigned int>& collected)
+{
+    std::deque<unsigned int> todo;
+    for (unsigned int c = 0; c < count; c++)
+        todo.push_back(c);
+    collected.assign(count, 0);
+
+    unsigned int submitted = 0;
+    unsigned int lost = 0;
+
+    // every round submits or collects one image, a stuck pool ends the loop instead of hanging the test
+    for (unsigned int round = 0; round < 10 * count && (!todo.empty() || pool->numOrder > 0); round++)
+    {
+        movidius_device* dev = NULL;
+        int rc = todo.empty() ? MOVIDIUS_QUEUE_FULL : movidius_poolAcquire(pool, &dev);
+
+        if (rc == 0)
+        {
+            rc = test_submit(pool, dev, todo.front(), (unsigned char)todo.front());
+
+            // the stick was unplugged, the next acquire picks another one
+            if (rc == MOVIDIUS_DEVICE_GONE)
+                continue;
+
+            TEST_CHECK(rc == 0);
+            todo.pop_front();
+            if (++submitted == unplug_after)
+                movidius_simUnplug(unplug_index);
+            continue;
+        }
+
+        TEST_CHECK(rc == MOVIDIUS_QUEUE_FULL);
+
+        float result = 0.0f;
+        void* tag = NULL;
+        rc = movidius_poolWait(pool, &result, 1, &tag, NULL);
+
+        unsigned int c = (unsigned int)(uintptr_t)tag;
+        TEST_CHECK(c < count);
+        if (c >= count)
+            break;
+
+        if (rc != 0)
+        {
+            lost++;
+            todo.push_back(c);
+            continue;
+        }
+
+        TEST_CHECK(test_isResultOf(result, (unsigned char)c));
+        collected[c]++;
+    }
+
+    TEST_CHECK(todo.empty() && pool->numOrder == 0);
+    return lost;
+}
+
+static void test_leastOutstanding(const std::string& dir)
+{
+    movidius_simconfig config;
+    memset(&config, 0, sizeof(config));
+    config.devices = 4;
+    config.outputs = 1;
+
+    movidius_pool pool;
+    TEST_CHECK(test_openPool(&pool, config, dir) == 0);
+    TEST_CHECK(pool.numDevices == 4);
+
+    // the first round goes to idle sticks only, after that every stick is equally busy
+    unsigned int submitted[4] = { 0, 0, 0, 0 };
+    movidius_device* first = NULL;
+    for (unsigned int i = 0; i < 4 * MOVIDIUS_MAX_INFLIGHT; i++)
+    {
+        movidius_device* dev = NULL;
+        TEST_CHECK(movidius_poolAcquire(&pool, &dev) == 0);
+        if (dev == NULL)
+            break;
+
+        unsigned int index = (unsigned int)(dev - pool.devices);
+        if (i < 4)
+            TEST_CHECK(submitted[index] == 0);
+        if (i == 0)
+            first = dev;
+
+        submitted[index]++;
+        TEST_CHECK(test_submit(&pool, dev, i, (unsigned char)i) == 0);
+    }
+
+    for (unsigned int d = 0; d < 4; d++)
+        TEST_CHECK(submitted[d] == MOVIDIUS_MAX_INFLIGHT);
+
+    movidius_device* dev = NULL;
+    TEST_CHECK(movidius_poolAcquire(&pool, &dev) == MOVIDIUS_QUEUE_FULL);
+
+    // collecting the oldest image frees its stick, which is then the only one with room
+    float result = 0.0f;
+    void* tag = NULL;
+    TEST_CHECK(movidius_poolWait(&pool, &result, 1, &tag, &dev) == 0);
+    TEST_CHECK(tag == (void*)0 && dev == first);
+    TEST_CHECK(test_isResultOf(result, 0));
+
+    dev = NULL;
+    TEST_CHECK(movidius_poolAcquire(&pool, &dev) == 0);
+    TEST_CHECK(dev == first);
+
+    while (pool.numOrder > 0)
+        TEST_CHECK(movidius_poolWait(&pool, &result, 1, &tag, NULL) == 0);
+
+    movidius_closePool(&pool);
+}
+
+static void test_unplugged(const std::string& dir)
+{
+    movidius_simconfig config;
+    memset(&config, 0, sizeof(config));
+    config.devices = 4;
+    config.outputs = 1;
+
+    movidius_pool pool;
+    TEST_CHECK(test_openPool(&pool, config, dir) == 0);
+
+    std::vector<unsigned int> collected;
+    unsigned int lost = test_runImages(&pool, 100, 30, 2, collected);
+
+    // what was in flight on the unplugged stick ran again on the others
+    TEST_CHECK(lost > 0);
+    for (unsigned int c = 0; c < collected.size(); c++)
+        TEST_CHECK(collected[c] == 1);
+    TEST_CHECK(movidius_poolHealthyDevices(&pool) == 3);
+
+    movidius_closePool(&pool);
+}
+
+static void test_getResultFailure(const std::string& dir)
+{
+    movidius_simconfig config;
+    memset(&config, 0, sizeof(config));
+    config.devices = 2;
+    config.outputs = 1;
+
+    movidius_pool pool;
+    TEST_CHECK(test_openPool(&pool, config, dir) == 0);
+
+    movidius_simInjectError(1, MOVIDIUS_SIM_GETRESULT, MVNC_ERROR, 2);
+
+    std::vector<unsigned int> collected;
+    TEST_CHECK(test_runImages(&pool, 40, 0, 0, collected) == 2);
+    for (unsigned int c = 0; c < collected.size(); c++)
+        TEST_CHECK(collected[c] == 1);
+
+    // a failed result does not mean the stick is gone
+    TEST_CHECK(movidius_poolHealthyDevices(&pool) == 2);
+
+    movidius_closePool(&pool);
+}
+
+static void test_batch(const std::string& dir)
+{
+    movidius_simconfig config;
+    memset(&config, 0, sizeof(config));
+    config.devices = 3;
+    config.outputs = 3;
+
+    movidius_pool pool;
+    TEST_CHECK(test_openPool(&pool, config, dir) == 0);
+
+    // every frame has its index on the left half and 200 on the right, odd items crop the right half
+    const unsigned int count = 60;
+    const unsigned int width = 16;
+    const unsigned int height = 16;
+    const movidius_rect left = { 0, 0, width / 2, height };
+    const movidius_rect right = { width / 2, 0, width / 2, height };
+
+    std::vector<unsigned char> frames(count * width * height * 3);
+    std::vector<movidius_batchitem> items(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        unsigned char* frame = &frames[i * width * height * 3];
+        for (unsigned int p = 0; p < width * height; p++)
+            memset(frame + 3 * p, p % width < width / 2 ? i : 200, 3);
+
+        movidius_batchitem item = { frame, MOVIDIUS_PIXEL_RGB, width, height, 3 * width, i % 2 ? &right : &left };
+        items[i] = item;
+    }
+
+    // a stick unplugged while running the batch, its items run on the others
+    movidius_simInjectError(1, MOVIDIUS_SIM_GETRESULT, MVNC_GONE, 1);
+
+    const unsigned int stride = 4;
+    std::vector<float> results(count * stride, -1.0f);
+    std::vector<int> status(count, -1);
+    TEST_CHECK(movidius_poolRunBatch(&pool, items.data(), count, MOVIDIUS_RESIZE_AREA, results.data(), stride,
+                                     status.data()) == 0);
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        TEST_CHECK(status[i] == 0);
+        TEST_CHECK(test_isResultOf(results[i * stride], i % 2 ? 200 : (unsigned char)i));
+        TEST_CHECK(results[i * stride + 3] == -1.0f);
+    }
+
+    TEST_CHECK(movidius_poolHealthyDevices(&pool) == 2);
+    TEST_CHECK(pool.numOrder == 0);
+
+    // a bad crop fails its own item only
+    const movidius_rect outside = { 10, 0, 20, height };
+    items[5].roi = &outside;
+    TEST_CHECK(movidius_poolRunBatch(&pool, items.data(), 10, MOVIDIUS_RESIZE_AREA, results.data(), stride,
+                                     status.data()) != 0);
+    TEST_CHECK(status[5] != 0 && status[4] == 0 && status[6] == 0);
+
+    // without any stick left every item gets the error
+    movidius_simUnplug(0);
+    movidius_simUnplug(2);
+    TEST_CHECK(movidius_poolRunBatch(&pool, items.data(), 10, MOVIDIUS_RESIZE_AREA, results.data(), stride,
+                                     status.data()) == MOVIDIUS_NODEVICE_FOUND);
+    TEST_CHECK(status[9] == MOVIDIUS_NODEVICE_FOUND);
+
+    movidius_closePool(&pool);
+}
+
+/**
+ * The simulated sticks, except that switching MVNC_DONT_BLOCK fails while test_failDontBlock is set
+ * The request being waited for stays in flight then, like with a stick that stopped answering
+ */
+static const movidius_backend* test_sim = NULL;
+static bool test_failDontBlock = false;
+
+static mvncStatus test_setGraphOption(void* graphHandle, int option, const void* data, unsigned int dataLength)
+{
+    if (test_failDontBlock && option == MVNC_DONT_BLOCK)
+        return MVNC_ERROR;
+    return test_sim->setGraphOption(graphHandle, option, data, dataLength);
+}
+
+static void test_stuckBatch(const std::string& dir)
+{
+    movidius_simconfig config;
+    memset(&config, 0, sizeof(config));
+    config.devices = 2;
+    config.outputs = 1;
+
+    movidius_pool pool;
+    TEST_CHECK(test_openPool(&pool, config, dir) == 0);
+
+    test_sim = movidius_getBackend();
+    movidius_backend backend = *test_sim;
+    backend.setGraphOption = test_setGraphOption;
+    movidius_setBackend(&backend);
+
+    const unsigned int count = 20;
+    std::vector<unsigned char> pixels(count * test_inputSize * test_inputSize * 3);
+    std::vector<movidius_batchitem> items(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        unsigned char* image = &pixels[i * test_inputSize * test_inputSize * 3];
+        memset(image, i, test_inputSize * test_inputSize * 3);
+
+        movidius_batchitem item = { image, MOVIDIUS_PIXEL_RGB, test_inputSize, test_inputSize, 3 * test_inputSize,
+                                    NULL };
+        items[i] = item;
+    }
+
+    // the second stick was left non-blocking, so collecting from it has to switch the option and fails
+    pool.devices[1].graph->dontBlock = 1;
+    test_failDontBlock = true;
+
+    const unsigned int stride = 3;
+    std::vector<float> results(count * stride, -1.0f);
+    std::vector<int> status(count, -1);
+    TEST_CHECK(movidius_poolRunBatch(&pool, items.data(), count, MOVIDIUS_RESIZE_AREA, results.data(), stride,
+                                     status.data()) == MOVIDIUS_GETGRAPHOPT_FAILED);
+
+    // every item is accounted for, and nothing is left in flight to block the next batch
+    unsigned int failed = 0;
+    for (unsigned int i = 0; i < count; i++)
+    {
+        TEST_CHECK(status[i] == 0 || status[i] == MOVIDIUS_GETGRAPHOPT_FAILED);
+        if (status[i] == 0)
+            TEST_CHECK(test_isResultOf(results[i * stride], (unsigned char)i));
+        else
+            failed++;
+    }
+    TEST_CHECK(failed > 0);
+    TEST_CHECK(pool.numOrder == 0);
+    TEST_CHECK(pool.devices[1].graph == NULL);
+
+    test_failDontBlock = false;
+    status.assign(count, -1);
+    TEST_CHECK(movidius_poolRunBatch(&pool, items.data(), count, MOVIDIUS_RESIZE_AREA, results.data(), stride,
+                                     status.data()) == 0);
+    for (unsigned int i = 0; i < count; i++)
+        TEST_CHECK(status[i] == 0 && test_isResultOf(results[i * stride], (unsigned char)i));
+
+    // uploading again brings the stick back
+    TEST_CHECK(movidius_poolUploadNetwork(&pool, dir.c_str()) == 0);
+    TEST_CHECK(pool.devices[1].graph != NULL);
+
+    movidius_closePool(&pool);
+}
+
+static void test_deallocateInFlight(const std::string& dir)
+{
+    movidius_simconfig config;
+    memset(&config, 0, sizeof(config));
+    config.devices = 2;
+    config.outputs = 1;
+    config.inferenceMs = 2.0f;
+
+    movidius_pool pool;
+    TEST_CHECK(test_openPool(&pool, config, dir) == 0);
+
+    for (unsigned int i = 0; i < 2 * MOVIDIUS_MAX_INFLIGHT; i++)
+    {
+        movidius_device* dev = NULL;
+        TEST_CHECK(movidius_poolAcquire(&pool, &dev) == 0);
+        if (dev != NULL)
+            TEST_CHECK(test_submit(&pool, dev, i, (unsigned char)i) == 0);
+    }
+
+    // a single stick refuses, the pool collects everything first
+    TEST_CHECK(movidius_deallocateGraph(&pool.devices[0]) == NOT_ALLOWED_THIS_TIME);
+    TEST_CHECK(movidius_poolDeallocateGraph(&pool) == 0);
+    TEST_CHECK(pool.numOrder == 0);
+    TEST_CHECK(pool.devices[0].graph == NULL && pool.devices[1].graph == NULL);
+
+    movidius_closePool(&pool);
+}
+
+/**
+ * Acquires and submits until the pool is full, counting the images every stick got
+ */
+static void test_fill(movidius_pool* pool, unsigned int* submitted)
+{
+    for (unsigned int d = 0; d < pool->numDevices; d++)
+        submitted[d] = 0;
+
+    for (unsigned int i = 0; i <= pool->numDevices * MOVIDIUS_MAX_INFLIGHT; i++)
+    {
+        movidius_device* dev = NULL;
+        int rc = movidius_poolAcquire(pool, &dev);
+        if (rc == MOVIDIUS_QUEUE_FULL)
+            return;
+
+        TEST_CHECK(rc == 0);
+        if (rc != 0)
+            return;
+
+        submitted[dev - pool->devices]++;
+        TEST_CHECK(test_submit(pool, dev, i, (unsigned char)i) == 0);
+    }
+
+    TEST_CHECK(!"the pool never filled up");
+}
+
+static void test_drain(movidius_pool* pool)
+{
+    float result = 0.0f;
+    while (pool->numOrder > 0)
+        TEST_CHECK(movidius_poolWait(pool, &result, 1, NULL, NULL) == 0);
+}
+
+/**
+ * Lets the cached throttling levels go stale, so the pool queries idle sticks again
+ */
+static void test_staleLevels()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+}
+
+static void test_thermal(const std::string& dir)
+{
+    movidius_simconfig config;
+    memset(&config, 0, sizeof(config));
+    config.devices = 2;
+    config.outputs = 1;
+
+    movidius_pool pool;
+    TEST_CHECK(test_openPool(&pool, config, dir) == 0);
+    TEST_CHECK(pool.numDevices == 2);
+    for (unsigned int d = 0; d < pool.numDevices; d++)
+        movidius_setTelemetry(&pool.devices[d], MOVIDIUS_TELEMETRY_INTERVAL, 0, 1);
+
+    // a throttling stick gets one inference at a time, passing it over counts as a deferral
+    unsigned int submitted[2];
+    movidius_simSetThermalLevel(1, 1);
+    test_fill(&pool, submitted);
+    TEST_CHECK(submitted[0] == MOVIDIUS_MAX_INFLIGHT && submitted[1] == 1);
+    TEST_CHECK(movidius_throttlingLevel(&pool.devices[1]) == 1);
+    TEST_CHECK(pool.thermalDeferrals > 0);
+    test_drain(&pool);
+
+    // a critical stick gets nothing while the cooler one has room
+    test_staleLevels();
+    movidius_simSetThermalLevel(1, 2);
+    unsigned long deferrals = pool.thermalDeferrals;
+    test_fill(&pool, submitted);
+    TEST_CHECK(submitted[0] == MOVIDIUS_MAX_INFLIGHT && submitted[1] == 0);
+    TEST_CHECK(movidius_throttlingLevel(&pool.devices[1]) == 2);
+    TEST_CHECK(pool.thermalDeferrals > deferrals);
+    test_drain(&pool);
+
+    // with every stick critical they are still used, one inference each
+    test_staleLevels();
+    movidius_simSetThermalLevel(0, 2);
+    test_fill(&pool, submitted);
+    TEST_CHECK(submitted[0] == 1 && submitted[1] == 1);
+    test_drain(&pool);
+
+    // cooled down sticks keep their cached level until it is queried again
+    movidius_simSetThermalLevel(0, 0);
+    movidius_simSetThermalLevel(1, 0);
+    TEST_CHECK(movidius_throttlingLevel(&pool.devices[1]) == 2);
+    test_staleLevels();
+    TEST_CHECK(movidius_refreshThrottlingLevel(&pool.devices[1]) == 0);
+
+    deferrals = pool.thermalDeferrals;
+    test_staleLevels();
+    test_fill(&pool, submitted);
+    TEST_CHECK(submitted[0] == MOVIDIUS_MAX_INFLIGHT && submitted[1] == MOVIDIUS_MAX_INFLIGHT);
+    TEST_CHECK(pool.thermalDeferrals == deferrals);
+    test_drain(&pool);
+
+    // the throttled stick spent time at every level, the other one never throttled
+    movidius_telemetry telemetry;
+    movidius_getTelemetry(&pool.devices[1], &telemetry);
+    TEST_CHECK(telemetry.throttlingLevel == 0);
+    TEST_CHECK(telemetry.levelMs[1] > 0.0 && telemetry.levelMs[2] > 0.0);
+    movidius_getTelemetry(&pool.devices[0], &telemetry);
+    TEST_CHECK(telemetry.levelMs[1] == 0.0 && telemetry.levelMs[2] > 0.0);
+
+    movidius_closePool(&pool);
+}
+
+int main()
+{
+    std::string dir;
+    if (test_makeNetwork(dir, 3) != 0)
+        return 1;
+
+    test_leastOutstanding(dir);
+    test_unplugged(dir);
+    test_getResultFailure(dir);
+    test_batch(dir);
+    test_stuckBatch(dir);
+    test_deallocateInFlight(dir);
+    test_thermal(dir);
+
+    movidius_simRemoveNetwork(dir.c_str());
+
+    printf("%d failed checks\n", test_failures);
+    return test_failures != 0;
+}
@@ -0,0 +1,78 @@
+#ifndef MOVIDIUS_TEST_H
+#define MOVIDIUS_TEST_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "movidius_pool.h"
+#include "movidius_simbackend.h"
+
+/**
+ * Helpers shared by the tests that run on simulated sticks
+ * Every failed TEST_CHECK() is printed and counted, main returns the count so ctest sees failures
+ */
+static int test_failures = 0;
+
+#define TEST_CHECK(condition)                                                              \
+    do                                                                                     \
+    {                                                                                      \
+        if (!(condition))                                                                  \
+        {                                                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            test_failures++;                                                               \
+        }                                                                                  \
+    } while (0)
+
+/**
+ * Side of the square network input, and the mean and std stat.txt of movidius_simWriteNetwork() has
+ */
+static const unsigned int test_inputSize = 8;
+static const float test_mean = 0.5f;
+static const float test_std = 0.25f;
+
+/**
+ * Writes a simulated network with the given amount of categories into a new temporary directory
+ * Returns 0 on success
+ */
+static inline int test_makeNetwork(std::string& dir, unsigned int categories)
+{
+    char pattern[] = "/tmp/movidius_test.XXXXXX";
+    if (mkdtemp(pattern) == NULL)
+    {
+        fprintf(stderr, "Cannot create a directory for the simulated network\n");
+        return 1;
+    }
+
+    dir = pattern;
+    return movidius_simWriteNetwork(dir.c_str(), categories, test_inputSize, 1) != 0;
+}
+
+/**
+ * Switches to simulated sticks as configured, opens all of them into pool and uploads the network in dir
+ * Returns 0 on success
+ */
+static inline int test_openPool(movidius_pool* pool, const movidius_simconfig& config, const std::string& dir)
+{
+    movidius_setBackend(movidius_simBackend(&config));
+
+    memset(pool, 0, sizeof(movidius_pool));
+    if (movidius_openPool(pool, 0) != 0)
+        return 1;
+
+    return movidius_poolUploadNetwork(pool, dir.c_str()) != 0;
+}
+
+/**
+ * The first result of an image filled with value, the simulated sticks return the start of the input
+ * The result went through half floats, the tolerance still tells neighbouring values apart
+ */
+static inline bool test_isResultOf(float result, unsigned char value)
+{
+    float expected = (value / 255.0f - test_mean) / test_std;
+    return fabsf(result - expected) < 0.25f / (255.0f * test_std);
+}
+
+#endif // MOVIDIUS_TEST_H